@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+/*
+ * Allocator returning memory aligned to a cache line, so that kernels can
+ * use full-width vector loads on every row they start at.
+*/
+
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    // Through the aligned operator new, so that the Profiler counts it.
+    T *allocate(size_t n) {
+        size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        return static_cast<T *>(::operator new(bytes, std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *ptr, size_t) {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "autograd_tape.hpp"
+
+template <typename T>
+inline T tape_forward(TapeOp op, T lhs, T rhs) {
+    switch (op) {
+        case TapeOp::Leaf:
+            return lhs;
+        case TapeOp::Add:
+            return lhs + rhs;
+        case TapeOp::Sub:
+            return lhs - rhs;
+        case TapeOp::Mul:
+            return lhs * rhs;
+        case TapeOp::Div:
+            return lhs / rhs;
+        case TapeOp::Neg:
+            return -lhs;
+        case TapeOp::Pow:
+            return std::pow(lhs, rhs);
+        case TapeOp::ReLU:
+            return lhs < T(0.0) ? T(0.0) : lhs;
+        case TapeOp::Tanh:
+            return std::tanh(lhs);
+        case TapeOp::Sigmoid:
+            return T(1.0) / (T(1.0) + std::exp(-lhs));
+        case TapeOp::Exp:
+            return std::exp(lhs);
+    }
+    return lhs;
+}
+
+template <typename T>
+inline void tape_backward(TapeOp op, T data, T grad, T lhs, T rhs, T &lhs_grad, T &rhs_grad) {
+    switch (op) {
+        case TapeOp::Leaf:
+            break;
+        case TapeOp::Add:
+            lhs_grad += grad;
+            rhs_grad += grad;
+            break;
+        case TapeOp::Sub:
+            lhs_grad += grad;
+            rhs_grad -= grad;
+            break;
+        case TapeOp::Mul:
+            lhs_grad += rhs * grad;
+            rhs_grad += lhs * grad;
+            break;
+        case TapeOp::Div:
+            lhs_grad += grad / rhs;
+            rhs_grad -= data / rhs * grad;
+            break;
+        case TapeOp::Neg:
+            lhs_grad -= grad;
+            break;
+        case TapeOp::Pow:
+            lhs_grad += rhs * std::pow(lhs, rhs - T(1.0)) * grad;
+            if (lhs > T(0.0)) rhs_grad += data * std::log(lhs) * grad;
+            break;
+        case TapeOp::ReLU:
+            lhs_grad += T(data > T(0.0)) * grad;
+            break;
+        case TapeOp::Tanh:
+            lhs_grad += (T(1.0) - data * data) * grad;
+            break;
+        case TapeOp::Sigmoid:
+            lhs_grad += (data * (T(1.0) - data)) * grad;
+            break;
+        case TapeOp::Exp:
+            lhs_grad += data * grad;
+            break;
+    }
+}
+
+template <typename T>
+TapeVariable<T>::TapeVariable(Tape<T> *tape, uint32_t index) {
+    tape_ = tape;
+    index_ = index;
+}
+
+template <typename T>
+Tape<T> *TapeVariable<T>::get_tape() const {
+    return tape_;
+}
+
+template <typename T>
+uint32_t TapeVariable<T>::get_index() const {
+    return index_;
+}
+
+template <typename T>
+T TapeVariable<T>::get_data_value() const {
+    return tape_->node(index_).data;
+}
+
+template <typename T>
+T TapeVariable<T>::get_grad_value() const {
+    return tape_->node(index_).grad;
+}
+
+template <typename T>
+void TapeVariable<T>::backward() const {
+    tape_->backward(index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::operator-() const {
+    return tape_->push(TapeOp::Neg, tape_forward(TapeOp::Neg, get_data_value(), T(0.0)), index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::pow(const TapeVariable<T> &other) const {
+    return tape_->push(TapeOp::Pow, tape_forward(TapeOp::Pow, get_data_value(), other.get_data_value()), index_, other.index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::ReLU() const {
+    return tape_->push(TapeOp::ReLU, tape_forward(TapeOp::ReLU, get_data_value(), T(0.0)), index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::Tanh() const {
+    return tape_->push(TapeOp::Tanh, tape_forward(TapeOp::Tanh, get_data_value(), T(0.0)), index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::Sigmoid() const {
+    return tape_->push(TapeOp::Sigmoid, tape_forward(TapeOp::Sigmoid, get_data_value(), T(0.0)), index_);
+}
+
+template <typename T>
+TapeVariable<T> TapeVariable<T>::exp() const {
+    return tape_->push(TapeOp::Exp, tape_forward(TapeOp::Exp, get_data_value(), T(0.0)), index_);
+}
+
+template <typename T>
+Tape<T>::Tape(size_t capacity) {
+    nodes_.reserve(capacity);
+}
+
+template <typename T>
+TapeVariable<T> Tape<T>::variable(T data) {
+    return push(TapeOp::Leaf, data, 0);
+}
+
+template <typename T>
+TapeVariable<T> Tape<T>::bind(const std::shared_ptr<Variable<T>> &variable) {
+    TapeVariable<T> leaf = push(TapeOp::Leaf, variable->get_data_value(), 0);
+    bindings_.emplace_back(leaf.get_index(), variable.get());
+    return leaf;
+}
+
+template <typename T>
+TapeVariable<T> Tape<T>::push(TapeOp op, T data, uint32_t lhs, uint32_t rhs) {
+    uint32_t index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(TapeNode<T>{data, 0.0, {lhs, rhs}, op});
+    return TapeVariable<T>(this, index);
+}
+
+template <typename T>
+TapeNode<T> &Tape<T>::node(uint32_t index) {
+    return nodes_[index];
+}
+
+template <typename T>
+const std::vector<std::pair<uint32_t, Variable<T> *>> &Tape<T>::bindings() const {
+    return bindings_;
+}
+
+template <typename T>
+size_t Tape<T>::size() const {
+    return nodes_.size();
+}
+
+template <typename T>
+size_t Tape<T>::capacity() const {
+    return nodes_.capacity();
+}
+
+template <typename T>
+void Tape<T>::backward(uint32_t root) {
+    TapeNode<T> *nodes = nodes_.data();
+    nodes[root].grad = 1.0;
+
+    for (int64_t i = root; i >= 0; --i) {
+        const TapeNode<T> &node = nodes[i];
+        TapeNode<T> &lhs = nodes[node.parents[0]];
+        TapeNode<T> &rhs = nodes[node.parents[1]];
+        tape_backward(node.op, node.data, node.grad, lhs.data, rhs.data, lhs.grad, rhs.grad);
+    }
+
+    for (auto & [index, variable] : bindings_) {
+        variable->set_grad(variable->get_grad_value() + nodes[index].grad);
+    }
+}
+
+template <typename T>
+void Tape<T>::clear() {
+    nodes_.clear();
+    bindings_.clear();
+}
+
+template <typename T>
+TapeVariable<T> operator+(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs) {
+    return lhs.get_tape()->push(TapeOp::Add, tape_forward(TapeOp::Add, lhs.get_data_value(), rhs.get_data_value()), lhs.get_index(), rhs.get_index());
+}
+
+template <typename T>
+TapeVariable<T> operator-(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs) {
+    return lhs.get_tape()->push(TapeOp::Sub, tape_forward(TapeOp::Sub, lhs.get_data_value(), rhs.get_data_value()), lhs.get_index(), rhs.get_index());
+}
+
+template <typename T>
+TapeVariable<T> operator*(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs) {
+    return lhs.get_tape()->push(TapeOp::Mul, tape_forward(TapeOp::Mul, lhs.get_data_value(), rhs.get_data_value()), lhs.get_index(), rhs.get_index());
+}
+
+template <typename T>
+TapeVariable<T> operator/(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs) {
+    return lhs.get_tape()->push(TapeOp::Div, tape_forward(TapeOp::Div, lhs.get_data_value(), rhs.get_data_value()), lhs.get_index(), rhs.get_index());
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "autograd_variable.cpp"
+#include <cstdint>
+#include <vector>
+
+/*
+ * Arena-backed alternative to the shared_ptr graph built by Variable.
+ *
+ * Every node of a Tape lives in one contiguous buffer and stores its value,
+ * its gradient, at most two parent indices and an op code instead of a
+ * backward closure. Nodes are appended in creation order, so the tape is
+ * already topologically sorted and backward() is a single reverse sweep.
+ *
+ * clear() releases the whole graph at once but keeps the buffer capacity,
+ * so after the first step a forward + backward pass does not touch the heap.
+ *
+ * Trainable Variables enter the tape with bind(): the tape copies the value
+ * and, after backward(), adds the accumulated gradient back to the Variable.
+ * A bound Variable must outlive the step it is bound in.
+*/
+
+enum class TapeOp : uint8_t {
+    Leaf,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Neg,
+    Pow,
+    ReLU,
+    Tanh,
+    Sigmoid,
+    Exp
+};
+
+template <typename T = double>
+struct TapeNode {
+    T data;
+    T grad;
+    uint32_t parents[2];
+    TapeOp op;
+};
+
+/*
+ * Value of a node with op code op from the values of its parents, and the
+ * contributions of a node with value data and gradient grad to the
+ * gradients of its parents. Shared by Tape and StaticGraph.
+*/
+template <typename T>
+T tape_forward(TapeOp op, T lhs, T rhs);
+
+template <typename T>
+void tape_backward(TapeOp op, T data, T grad, T lhs, T rhs, T &lhs_grad, T &rhs_grad);
+
+template <typename T>
+class Tape;
+
+/*
+ * Lightweight handle to a node of a Tape. Copying it copies two words,
+ * arithmetic on it appends a node to the tape it belongs to.
+*/
+
+template <typename T = double>
+class TapeVariable {
+private:
+    Tape<T> *tape_;
+    uint32_t index_;
+
+public:
+    TapeVariable(Tape<T> *tape = nullptr, uint32_t index = 0);
+
+    Tape<T> *get_tape() const;
+    uint32_t get_index() const;
+    T get_data_value() const;
+    T get_grad_value() const;
+
+    void backward() const;
+
+    TapeVariable<T> operator-() const;
+    TapeVariable<T> pow(const TapeVariable<T> &other) const;
+
+    TapeVariable<T> ReLU() const;
+    TapeVariable<T> Tanh() const;
+    TapeVariable<T> Sigmoid() const;
+    TapeVariable<T> exp() const;
+};
+
+template <typename T = double>
+class Tape {
+private:
+    std::vector<TapeNode<T>> nodes_;
+    std::vector<std::pair<uint32_t, Variable<T> *>> bindings_;
+
+public:
+    Tape(size_t capacity = 0);
+
+    TapeVariable<T> variable(T data);
+    TapeVariable<T> bind(const std::shared_ptr<Variable<T>> &variable);
+    TapeVariable<T> push(TapeOp op, T data, uint32_t lhs, uint32_t rhs = 0);
+
+    TapeNode<T> &node(uint32_t index);
+    const std::vector<std::pair<uint32_t, Variable<T> *>> &bindings() const;
+    size_t size() const;
+    size_t capacity() const;
+
+    void backward(uint32_t root);
+    void clear();
+};
+
+template <typename T = double>
+TapeVariable<T> operator+(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs);
+
+template <typename T = double>
+TapeVariable<T> operator-(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs);
+
+template <typename T = double>
+TapeVariable<T> operator*(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs);
+
+template <typename T = double>
+TapeVariable<T> operator/(const TapeVariable<T> &lhs, const TapeVariable<T> &rhs);
@@ -0,0 +1,779 @@
+#pragma once
+
+#include "autograd_tensor.hpp"
+
+/*
+ * Row kernels shared by the broadcasting operations. a_step and b_step are
+ * the strides of the operands along the last dimension: 1 for a regular
+ * row, 0 for a broadcast one. Each stride combination gets its own loop
+ * with compile-time strides, so the compiler can vectorize all of them.
+*/
+
+template <typename T, typename Op>
+inline void tensor_binary_row(T *__restrict out, const T *__restrict a, const T *__restrict b,
+                              size_t n, size_t a_step, size_t b_step, Op op) {
+    if (a_step && b_step) {
+        for (size_t j = 0; j < n; ++j) out[j] = op(a[j], b[j]);
+    } else if (a_step) {
+        const T bv = b[0];
+        for (size_t j = 0; j < n; ++j) out[j] = op(a[j], bv);
+    } else if (b_step) {
+        const T av = a[0];
+        for (size_t j = 0; j < n; ++j) out[j] = op(av, b[j]);
+    } else {
+        const T value = op(a[0], b[0]);
+        for (size_t j = 0; j < n; ++j) out[j] = value;
+    }
+}
+
+// grad[j * grad_step] += derivative(g[j], j), reducing into grad[0] when grad_step is 0.
+template <typename T, typename Derivative>
+inline void tensor_accumulate_row(T *__restrict grad, const T *__restrict g, size_t n,
+                                  size_t grad_step, Derivative derivative) {
+    if (grad_step) {
+        for (size_t j = 0; j < n; ++j) grad[j] += derivative(g[j], j);
+    } else {
+        T sum = 0.0;
+        for (size_t j = 0; j < n; ++j) sum += derivative(g[j], j);
+        grad[0] += sum;
+    }
+}
+
+/*
+ * Calls row(out_offset, a_offset, b_offset) for every row (all dimensions
+ * but the last) of the broadcast output shape.
+*/
+template <typename Row>
+inline void tensor_for_each_row(const std::vector<size_t> &shape, const std::vector<size_t> &a_strides,
+                                const std::vector<size_t> &b_strides, Row row) {
+    size_t rank = shape.size();
+    size_t inner = rank ? shape[rank - 1] : 1;
+    size_t total = 1;
+    for (size_t dim : shape) total *= dim;
+    if (inner == 0) return;
+    if (rank == 0) {
+        row(0, 0, 0);
+        return;
+    }
+
+    std::vector<size_t> index(rank, 0);
+    size_t a_offset = 0, b_offset = 0;
+
+    for (size_t out_offset = 0; out_offset < total; out_offset += inner) {
+        row(out_offset, a_offset, b_offset);
+        for (size_t d = rank - 1; d-- > 0;) {
+            ++index[d];
+            a_offset += a_strides[d];
+            b_offset += b_strides[d];
+            if (index[d] < shape[d]) break;
+            a_offset -= a_strides[d] * shape[d];
+            b_offset -= b_strides[d] * shape[d];
+            index[d] = 0;
+        }
+    }
+}
+
+template <typename T>
+Tensor<T>::Tensor(
+    std::vector<size_t> shape,
+    T value,
+    std::vector<std::shared_ptr<Tensor<T>>> parents) {
+
+    this->shape_ = std::move(shape);
+    this->strides_.assign(shape_.size(), 1);
+    this->size_ = 1;
+    for (size_t d = shape_.size(); d-- > 0;) {
+        strides_[d] = size_;
+        size_ *= shape_[d];
+    }
+
+    this->storage_ = std::make_shared<AlignedVector<T>>(size_, value);
+    this->data_ = storage_->data();
+    if (NoGrad::grad_enabled()) this->parent_tensors_ = std::move(parents);
+    this->backward_ = nullptr;
+    this->visit_epoch_ = 0;
+}
+
+template <typename T>
+Tensor<T>::Tensor(
+    std::vector<size_t> shape,
+    const std::vector<T> &data,
+    std::vector<std::shared_ptr<Tensor<T>>> parents) : Tensor(std::move(shape), 0.0, std::move(parents)) {
+
+    if (data.size() != size_) {
+        throw std::invalid_argument("Tensor: data size does not match the shape");
+    }
+    std::copy(data.begin(), data.end(), data_);
+}
+
+/*
+ * Same iterative release of the parents as in ~Variable.
+*/
+template <typename T>
+Tensor<T>::~Tensor() {
+    if (parent_tensors_.empty()) return;
+
+    thread_local std::vector<std::shared_ptr<Tensor<T>>> pending;
+    thread_local bool draining = false;
+
+    for (auto & parent : parent_tensors_) {
+        pending.push_back(std::move(parent));
+    }
+    parent_tensors_.clear();
+    if (draining) return;
+
+    draining = true;
+    while (!pending.empty()) {
+        std::shared_ptr<Tensor<T>> parent = std::move(pending.back());
+        pending.pop_back();
+    }
+    draining = false;
+}
+
+/*
+ * Leaf tensor holding a copy of the values of scalar Variables. Its gradient
+ * is added to the Variables during backward(), which lets modules whose
+ * parameters are Variables run on tensors.
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::from_variables(
+    const std::vector<std::shared_ptr<Variable<T>>> &variables,
+    std::vector<size_t> shape) {
+
+    auto result = std::make_shared<Tensor<T>>(std::move(shape));
+    if (variables.size() != result->size_) {
+        throw std::invalid_argument("Tensor::from_variables: number of variables does not match the shape");
+    }
+    for (size_t i = 0; i < variables.size(); ++i) {
+        result->data_[i] = variables[i]->get_data_value();
+    }
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [variables, out = result.get()]() {
+        for (size_t i = 0; i < variables.size(); ++i) {
+            variables[i]->set_grad(variables[i]->get_grad_value() + out->grad_[i]);
+        }
+    };
+
+    return result;
+}
+
+/*
+ * Leaf tensor over external memory: its values are data[0, size) without
+ * a copy, and its gradient is added to grad[0, size) during backward().
+ * The memory must outlive the tensor.
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::from_buffer(std::vector<size_t> shape, T *data, T *grad) {
+    auto result = std::make_shared<Tensor<T>>(std::vector<size_t>{});
+    result->shape_ = std::move(shape);
+    result->strides_.assign(result->shape_.size(), 1);
+    result->size_ = 1;
+    for (size_t d = result->shape_.size(); d-- > 0;) {
+        result->strides_[d] = result->size_;
+        result->size_ *= result->shape_[d];
+    }
+    result->storage_ = nullptr;
+    result->data_ = data;
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [grad, out = result.get()]() {
+        const T *__restrict g = out->grad_.data();
+        T *__restrict target = grad;
+        for (size_t i = 0; i < out->size_; ++i) target[i] += g[i];
+    };
+
+    return result;
+}
+
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const std::shared_ptr<Tensor<T>> &tensor) {
+    os << "Tensor(shape=[";
+    for (size_t d = 0; d < tensor->get_shape().size(); ++d) {
+        os << (d ? ", " : "") << tensor->get_shape()[d];
+    }
+    os << "], data=[";
+    for (size_t i = 0; i < tensor->get_size(); ++i) {
+        if (i == 8) {
+            os << ", ...";
+            break;
+        }
+        os << (i ? ", " : "") << tensor->get_data()[i];
+    }
+    return os << "])";
+}
+
+template <typename T>
+const std::vector<size_t> &Tensor<T>::get_shape() const {
+    return shape_;
+}
+
+template <typename T>
+const std::vector<size_t> &Tensor<T>::get_strides() const {
+    return strides_;
+}
+
+template <typename T>
+size_t Tensor<T>::get_size() const {
+    return size_;
+}
+
+template <typename T>
+T *Tensor<T>::get_data() {
+    return data_;
+}
+
+template <typename T>
+T *Tensor<T>::get_grad() {
+    if (grad_.size() != size_) grad_.assign(size_, 0.0);
+    return grad_.data();
+}
+
+template <typename T>
+T Tensor<T>::get_data_value(size_t index) {
+    return data_[index];
+}
+
+template <typename T>
+T Tensor<T>::get_grad_value(size_t index) {
+    return get_grad()[index];
+}
+
+template <typename T>
+std::vector<std::shared_ptr<Tensor<T>>> Tensor<T>::get_node_parents() {
+    return parent_tensors_;
+}
+
+template <typename T>
+void Tensor<T>::get_info() {
+    std::cout << this->shared_from_this() << std::endl;
+}
+
+template <typename T>
+void Tensor<T>::zero_grad() {
+    grad_.assign(size_, 0.0);
+}
+
+template <typename T>
+void Tensor<T>::build_topological_order(std::vector<Tensor<T> *> &order) {
+    thread_local std::vector<std::pair<Tensor<T> *, size_t>> stack;
+
+    uint64_t epoch = epoch_counter_.fetch_add(1, std::memory_order_relaxed) + 1;
+    order.clear();
+    stack.clear();
+
+    visit_epoch_ = epoch;
+    stack.emplace_back(this, 0);
+
+    while (!stack.empty()) {
+        auto & [tensor, next] = stack.back();
+        if (next < tensor->parent_tensors_.size()) {
+            Tensor<T> *parent = tensor->parent_tensors_[next++].get();
+            if (parent->visit_epoch_ != epoch) {
+                parent->visit_epoch_ = epoch;
+                stack.emplace_back(parent, 0);
+            }
+        } else {
+            order.push_back(tensor);
+            stack.pop_back();
+        }
+    }
+}
+
+/*
+ * The output gradient is seeded with ones, so for a non-scalar output this
+ * computes the gradient of the sum of its elements.
+*/
+template <typename T>
+void Tensor<T>::backward(bool retain_graph) {
+    AUTOGRAD_PROFILE_SCOPE("Tensor::backward");
+    thread_local std::vector<Tensor<T> *> order;
+    build_topological_order(order);
+
+    for (auto tensor : order) {
+        if (tensor->backward_) tensor->grad_.assign(tensor->size_, 0.0);
+        else tensor->get_grad();
+    }
+    std::fill(grad_.begin(), grad_.end(), T(1.0));
+
+    for (size_t i = order.size(); i-- > 0;) {
+        if (order[i]->backward_) order[i]->backward_();
+    }
+
+    if (retain_graph) return;
+    for (auto tensor : order) {
+        tensor->backward_ = nullptr;
+        tensor->parent_tensors_.clear();
+    }
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::broadcast_binary(const std::shared_ptr<Tensor<T>> &other, char op) {
+    size_t rank = std::max(shape_.size(), other->shape_.size());
+    std::vector<size_t> shape(rank), a_strides(rank, 0), b_strides(rank, 0);
+
+    for (size_t d = 0; d < rank; ++d) {
+        size_t a_dim = d + shape_.size() >= rank ? shape_[d + shape_.size() - rank] : 1;
+        size_t b_dim = d + other->shape_.size() >= rank ? other->shape_[d + other->shape_.size() - rank] : 1;
+        if (a_dim != b_dim && a_dim != 1 && b_dim != 1) {
+            throw std::invalid_argument("Tensor: shapes cannot be broadcast together");
+        }
+        shape[d] = std::max(a_dim, b_dim);
+        if (a_dim != 1) a_strides[d] = strides_[d + shape_.size() - rank];
+        if (b_dim != 1) b_strides[d] = other->strides_[d + other->shape_.size() - rank];
+    }
+
+    auto result = std::make_shared<Tensor<T>>(
+        shape,
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this(),
+            other
+        }
+    );
+
+    size_t inner = rank ? shape[rank - 1] : 1;
+    size_t a_step = rank ? a_strides[rank - 1] : 1;
+    size_t b_step = rank ? b_strides[rank - 1] : 1;
+    const T *a = data_, *b = other->data_;
+    T *out = result->data_;
+
+    tensor_for_each_row(shape, a_strides, b_strides, [&](size_t o, size_t ao, size_t bo) {
+        switch (op) {
+            case '+':
+                tensor_binary_row(out + o, a + ao, b + bo, inner, a_step, b_step, [](T x, T y) { return x + y; });
+                break;
+            case '-':
+                tensor_binary_row(out + o, a + ao, b + bo, inner, a_step, b_step, [](T x, T y) { return x - y; });
+                break;
+            default:
+                tensor_binary_row(out + o, a + ao, b + bo, inner, a_step, b_step, [](T x, T y) { return x * y; });
+                break;
+        }
+    });
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, other = other.get(), out = result.get(), a_strides, b_strides, op, inner, a_step, b_step]() {
+        const T *g = out->grad_.data();
+        T *ga = grad_.data(), *gb = other->grad_.data();
+        const T *a = data_, *b = other->data_;
+
+        tensor_for_each_row(out->shape_, a_strides, b_strides, [&](size_t o, size_t ao, size_t bo) {
+            const T *row_a = a + ao, *row_b = b + bo;
+            switch (op) {
+                case '+':
+                    tensor_accumulate_row(ga + ao, g + o, inner, a_step, [](T gj, size_t) { return gj; });
+                    tensor_accumulate_row(gb + bo, g + o, inner, b_step, [](T gj, size_t) { return gj; });
+                    break;
+                case '-':
+                    tensor_accumulate_row(ga + ao, g + o, inner, a_step, [](T gj, size_t) { return gj; });
+                    tensor_accumulate_row(gb + bo, g + o, inner, b_step, [](T gj, size_t) { return -gj; });
+                    break;
+                default:
+                    tensor_accumulate_row(ga + ao, g + o, inner, a_step, [&](T gj, size_t j) { return gj * row_b[j * b_step]; });
+                    tensor_accumulate_row(gb + bo, g + o, inner, b_step, [&](T gj, size_t j) { return gj * row_a[j * a_step]; });
+                    break;
+            }
+        });
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::operator+(const std::shared_ptr<Tensor<T>> &other) {
+    return broadcast_binary(other, '+');
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::operator-(const std::shared_ptr<Tensor<T>> &other) {
+    return broadcast_binary(other, '-');
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::operator*(const std::shared_ptr<Tensor<T>> &other) {
+    return broadcast_binary(other, '*');
+}
+
+/*
+ * (M, K) x (K, N) -> (M, N). The product and both gradients
+ * (dA += dC * B^T, dB += A^T * dC) are computed by gemm().
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::matmul(const std::shared_ptr<Tensor<T>> &other) {
+    if (shape_.size() != 2 || other->shape_.size() != 2 || shape_[1] != other->shape_[0]) {
+        throw std::invalid_argument("Tensor::matmul: expected (M, K) and (K, N) matrices");
+    }
+    size_t M = shape_[0], K = shape_[1], N = other->shape_[1];
+
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{M, N},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this(),
+            other
+        }
+    );
+
+    gemm<T>(false, false, M, N, K, 1.0, data_, K, other->data_, N, 0.0, result->data_, N);
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, other = other.get(), out = result.get(), M, K, N]() {
+        const T *g = out->grad_.data();
+        gemm<T>(false, true, M, K, N, 1.0, g, N, other->data_, N, 1.0, grad_.data(), K);
+        gemm<T>(true, false, K, N, M, 1.0, data_, K, g, N, 1.0, other->grad_.data(), N);
+    };
+
+    return result;
+}
+
+template <typename T>
+template <typename Storage>
+std::shared_ptr<Tensor<T>> Tensor<T>::matmul(const std::shared_ptr<Tensor<T>> &other, const Storage *other_values) {
+    if (shape_.size() != 2 || other->shape_.size() != 2 || shape_[1] != other->shape_[0]) {
+        throw std::invalid_argument("Tensor::matmul: expected (M, K) and (K, N) matrices");
+    }
+    size_t M = shape_[0], K = shape_[1], N = other->shape_[1];
+
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{M, N},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this(),
+            other
+        }
+    );
+
+    gemm<T>(false, false, M, N, K, 1.0, data_, K, other_values, N, 0.0, result->data_, N);
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, other = other.get(), other_values, out = result.get(), M, K, N]() {
+        const T *g = out->grad_.data();
+        gemm<T>(false, true, M, K, N, 1.0, g, N, other_values, N, 1.0, grad_.data(), K);
+        gemm<T>(true, false, K, N, M, 1.0, data_, K, g, N, 1.0, other->grad_.data(), N);
+    };
+
+    return result;
+}
+
+/*
+ * The result shares the values of this tensor and has its own gradient.
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::reshape(std::vector<size_t> shape) {
+    size_t size = 1;
+    for (size_t dim : shape) size *= dim;
+    if (size != size_) {
+        throw std::invalid_argument("Tensor::reshape: number of elements does not match");
+    }
+
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->shape_ = std::move(shape);
+    result->strides_.assign(result->shape_.size(), 1);
+    for (size_t d = result->shape_.size(), stride = 1; d-- > 0;) {
+        result->strides_[d] = stride;
+        stride *= result->shape_[d];
+    }
+    result->size_ = size_;
+    result->storage_ = storage_;
+    result->data_ = data_;
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get()]() {
+        const T *__restrict g = out->grad_.data();
+        T *__restrict ga = grad_.data();
+        for (size_t i = 0; i < size_; ++i) ga[i] += g[i];
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::transpose() {
+    if (shape_.size() != 2) {
+        throw std::invalid_argument("Tensor::transpose: expected a matrix");
+    }
+    size_t M = shape_[0], N = shape_[1];
+
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{N, M},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+    for (size_t i = 0; i < M; ++i) {
+        for (size_t j = 0; j < N; ++j) result->data_[j * M + i] = data_[i * N + j];
+    }
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get(), M, N]() {
+        for (size_t i = 0; i < M; ++i) {
+            for (size_t j = 0; j < N; ++j) grad_[i * N + j] += out->grad_[j * M + i];
+        }
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::sum() {
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{1},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    T sum = 0.0;
+    for (size_t i = 0; i < size_; ++i) sum += data_[i];
+    result->data_[0] = sum;
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get()]() {
+        const T g = out->grad_[0];
+        T *__restrict ga = grad_.data();
+        for (size_t i = 0; i < size_; ++i) ga[i] += g;
+    };
+
+    return result;
+}
+
+/*
+ * Sums over one dimension and drops it (a 1-D tensor reduces to shape {1}).
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::sum(size_t axis) {
+    if (axis >= shape_.size()) {
+        throw std::invalid_argument("Tensor::sum: axis out of range");
+    }
+    std::vector<size_t> shape;
+    size_t outer = 1, inner = 1, length = shape_[axis];
+    for (size_t d = 0; d < shape_.size(); ++d) {
+        if (d < axis) outer *= shape_[d];
+        if (d > axis) inner *= shape_[d];
+        if (d != axis) shape.push_back(shape_[d]);
+    }
+    if (shape.empty()) shape.push_back(1);
+
+    auto result = std::make_shared<Tensor<T>>(
+        shape,
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    for (size_t o = 0; o < outer; ++o) {
+        T *__restrict out = result->data_ + o * inner;
+        for (size_t l = 0; l < length; ++l) {
+            const T *__restrict row = data_ + (o * length + l) * inner;
+            for (size_t i = 0; i < inner; ++i) out[i] += row[i];
+        }
+    }
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get(), outer, inner, length]() {
+        for (size_t o = 0; o < outer; ++o) {
+            const T *__restrict g = out->grad_.data() + o * inner;
+            for (size_t l = 0; l < length; ++l) {
+                T *__restrict ga = grad_.data() + (o * length + l) * inner;
+                for (size_t i = 0; i < inner; ++i) ga[i] += g[i];
+            }
+        }
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::mean() {
+    auto result = std::make_shared<Tensor<T>>(
+        std::vector<size_t>{1},
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    T sum = 0.0;
+    for (size_t i = 0; i < size_; ++i) sum += data_[i];
+    result->data_[0] = sum / static_cast<T>(size_);
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get()]() {
+        const T g = out->grad_[0] / static_cast<T>(size_);
+        T *__restrict ga = grad_.data();
+        for (size_t i = 0; i < size_; ++i) ga[i] += g;
+    };
+
+    return result;
+}
+
+/*
+ * Unary elementwise node: out = function(x), dx += g * derivative(out, x).
+ * Both are called with whole vectors of lanes and with single values.
+*/
+template <typename T>
+template <typename Function, typename Derivative>
+std::shared_ptr<Tensor<T>> Tensor<T>::elementwise(Function function, Derivative derivative) {
+    auto result = std::make_shared<Tensor<T>>(
+        shape_,
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    const T *__restrict x = data_;
+    T *__restrict y = result->data_;
+    simd_for<T>(size_, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        simd_store(y + i, function(simd_load<V>(x + i)));
+    });
+
+    if (!NoGrad::grad_enabled()) return result;
+    result->backward_ = [this, out = result.get(), derivative]() {
+        const T *__restrict x = data_, *__restrict y = out->data_, *__restrict g = out->grad_.data();
+        T *__restrict gx = grad_.data();
+        simd_for<T>(size_, [&](size_t i, auto lanes) {
+            using V = decltype(lanes);
+            V dy = simd_load<V>(g + i) * derivative(simd_load<V>(y + i), simd_load<V>(x + i));
+            simd_store(gx + i, simd_load<V>(gx + i) + dy);
+        });
+    };
+
+    return result;
+}
+
+/*
+ * out = x * s with s = sigmoid(gate(x)), for SiLU and GELU. s is kept for
+ * the backward pass, dx += g * (s + x * s * (1 - s) * gate'(x)).
+*/
+template <typename T>
+template <typename Gate, typename GateDerivative>
+std::shared_ptr<Tensor<T>> Tensor<T>::gated(Gate gate, GateDerivative gate_derivative) {
+    auto result = std::make_shared<Tensor<T>>(
+        shape_,
+        0.0,
+        std::vector<std::shared_ptr<Tensor<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    const T *__restrict x = data_;
+    T *__restrict y = result->data_;
+    if (!NoGrad::grad_enabled()) {
+        simd_for<T>(size_, [&](size_t i, auto lanes) {
+            using V = decltype(lanes);
+            V value = simd_load<V>(x + i);
+            simd_store(y + i, value * simd_sigmoid<SIMD_MATH_ULP>(gate(value)));
+        });
+        return result;
+    }
+
+    auto saved = std::make_shared<AlignedVector<T>>(size_);
+    T *__restrict s = saved->data();
+    simd_for<T>(size_, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        V value = simd_load<V>(x + i), sigmoid = simd_sigmoid<SIMD_MATH_ULP>(gate(value));
+        simd_store(s + i, sigmoid);
+        simd_store(y + i, value * sigmoid);
+    });
+
+    result->backward_ = [this, out = result.get(), saved, gate_derivative]() {
+        const T *__restrict x = data_, *__restrict s = saved->data(), *__restrict g = out->grad_.data();
+        T *__restrict gx = grad_.data();
+        simd_for<T>(size_, [&](size_t i, auto lanes) {
+            using V = decltype(lanes);
+            V value = simd_load<V>(x + i), sigmoid = simd_load<V>(s + i);
+            V derivative = sigmoid + value * sigmoid * (1 - sigmoid) * gate_derivative(value);
+            simd_store(gx + i, simd_load<V>(gx + i) + simd_load<V>(g + i) * derivative);
+        });
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::ReLU() {
+    return elementwise(
+        [](auto x) { return x > decltype(x){} ? x : decltype(x){}; },
+        [](auto y, auto) { return y > decltype(y){} ? simd_splat<decltype(y)>(T(1.0)) : decltype(y){}; }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::LeakyReLU(T slope) {
+    return elementwise(
+        [slope](auto x) { return simd_leaky_relu(x, slope); },
+        [slope](auto, auto x) { return x > decltype(x){} ? simd_splat<decltype(x)>(T(1.0)) : simd_splat<decltype(x)>(slope); }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::Tanh() {
+    return elementwise(
+        [](auto x) { return simd_tanh<SIMD_MATH_ULP>(x); },
+        [](auto y, auto) { return 1 - y * y; }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::Sigmoid() {
+    return elementwise(
+        [](auto x) { return simd_sigmoid<SIMD_MATH_ULP>(x); },
+        [](auto y, auto) { return y * (1 - y); }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::SiLU() {
+    return gated(
+        [](auto x) { return x; },
+        [](auto) { return T(1.0); }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::GELU() {
+    return gated(
+        [](auto x) { return simd_gelu_gate(x); },
+        [](auto x) { return simd_gelu_gate_derivative(x); }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Tensor<T>::exp() {
+    return elementwise(
+        [](auto x) { return simd_exp<SIMD_MATH_ULP>(x); },
+        [](auto y, auto) { return y; }
+    );
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> operator+(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs) {
+    return (*lhs) + rhs;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> operator-(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs) {
+    return (*lhs) - rhs;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> operator*(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs) {
+    return (*lhs) * rhs;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> matmul(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs) {
+    return lhs->matmul(rhs);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "autograd_variable.cpp"
+#include "gemm.cpp"
+#include "simd_math.hpp"
+#include <stdexcept>
+
+/*
+ * N-dimensional counterpart of Variable.
+ *
+ * A Tensor holds a contiguous row-major array of values with its shape and
+ * strides, and every operation on whole tensors (matmul, broadcasting
+ * +, - and *, activations, reductions) is a single node of the graph with
+ * a loop-based forward and backward kernel that the compiler vectorizes.
+ *
+ * Binary elementwise operations broadcast like numpy: shapes are aligned
+ * from the last dimension and dimensions of size 1 are stretched.
+ *
+ * Like Variable, a tensor is always used through a shared_ptr, backward()
+ * does an iterative topological sort and releases the graph unless
+ * retain_graph is set. Gradients are allocated on first use. Inside a
+ * NoGrad scope the operations only compute values.
+*/
+
+template <typename T = double>
+class Tensor : public std::enable_shared_from_this<Tensor<T>> {
+private:
+    std::vector<size_t> shape_;
+    std::vector<size_t> strides_;
+    size_t size_;
+    std::shared_ptr<AlignedVector<T>> storage_;
+    T *data_;
+    AlignedVector<T> grad_;
+
+    std::function<void()> backward_;
+    std::vector<std::shared_ptr<Tensor<T>>> parent_tensors_;
+
+    uint64_t visit_epoch_;
+    static inline std::atomic<uint64_t> epoch_counter_ = 0;
+
+    void build_topological_order(std::vector<Tensor<T> *> &order);
+    std::shared_ptr<Tensor<T>> broadcast_binary(const std::shared_ptr<Tensor<T>> &other, char op);
+    template <typename Function, typename Derivative>
+    std::shared_ptr<Tensor<T>> elementwise(Function function, Derivative derivative);
+    template <typename Gate, typename GateDerivative>
+    std::shared_ptr<Tensor<T>> gated(Gate gate, GateDerivative gate_derivative);
+
+public:
+    Tensor(
+        std::vector<size_t> shape,
+        T value = 0.0,
+        std::vector<std::shared_ptr<Tensor<T>>> parents = {}
+    );
+    Tensor(
+        std::vector<size_t> shape,
+        const std::vector<T> &data,
+        std::vector<std::shared_ptr<Tensor<T>>> parents = {}
+    );
+    ~Tensor();
+
+    static std::shared_ptr<Tensor<T>> from_variables(
+        const std::vector<std::shared_ptr<Variable<T>>> &variables,
+        std::vector<size_t> shape
+    );
+    static std::shared_ptr<Tensor<T>> from_buffer(std::vector<size_t> shape, T *data, T *grad);
+
+    const std::vector<size_t> &get_shape() const;
+    const std::vector<size_t> &get_strides() const;
+    size_t get_size() const;
+    T *get_data();
+    T *get_grad();
+    T get_data_value(size_t index = 0);
+    T get_grad_value(size_t index = 0);
+    std::vector<std::shared_ptr<Tensor<T>>> get_node_parents();
+    void get_info();
+
+    void zero_grad();
+    void backward(bool retain_graph = false);
+
+    std::shared_ptr<Tensor<T>> operator+(const std::shared_ptr<Tensor<T>> &other);
+    std::shared_ptr<Tensor<T>> operator-(const std::shared_ptr<Tensor<T>> &other);
+    std::shared_ptr<Tensor<T>> operator*(const std::shared_ptr<Tensor<T>> &other);
+    std::shared_ptr<Tensor<T>> matmul(const std::shared_ptr<Tensor<T>> &other);
+
+    /*
+     * matmul() that reads the values of other from other_values, a copy in
+     * a 16-bit format such as BFloat16 (see half.hpp), both in the forward
+     * pass and for the gradient of this tensor. The copy must outlive the
+     * backward pass; the gradient of other is computed in T as usual.
+    */
+    template <typename Storage>
+    std::shared_ptr<Tensor<T>> matmul(const std::shared_ptr<Tensor<T>> &other, const Storage *other_values);
+
+    std::shared_ptr<Tensor<T>> reshape(std::vector<size_t> shape);
+    std::shared_ptr<Tensor<T>> transpose();
+
+    std::shared_ptr<Tensor<T>> sum();
+    std::shared_ptr<Tensor<T>> sum(size_t axis);
+    std::shared_ptr<Tensor<T>> mean();
+
+    /*
+     * Activations are one vectorized pass over the tensor, with the
+     * kernels of simd_math.hpp for the transcendental ones; their backward
+     * reads the saved output (or for SiLU and GELU, the saved sigmoid)
+     * instead of evaluating them again.
+    */
+    std::shared_ptr<Tensor<T>> ReLU();
+    std::shared_ptr<Tensor<T>> LeakyReLU(T slope = 0.01);
+    std::shared_ptr<Tensor<T>> Tanh();
+    std::shared_ptr<Tensor<T>> Sigmoid();
+    std::shared_ptr<Tensor<T>> SiLU();
+    std::shared_ptr<Tensor<T>> GELU();
+    std::shared_ptr<Tensor<T>> exp();
+};
+
+template <typename T = double>
+std::ostream &operator<<(std::ostream &os, const std::shared_ptr<Tensor<T>> &tensor);
+
+template <typename T = double>
+std::shared_ptr<Tensor<T>> operator+(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs);
+
+template <typename T = double>
+std::shared_ptr<Tensor<T>> operator-(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs);
+
+template <typename T = double>
+std::shared_ptr<Tensor<T>> operator*(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs);
+
+template <typename T = double>
+std::shared_ptr<Tensor<T>> matmul(const std::shared_ptr<Tensor<T>> &lhs, const std::shared_ptr<Tensor<T>> &rhs);
@@ -1,15 +1,85 @@
+#pragma once
+
 #include "autograd_variable.hpp"
+#include "profiler.cpp"
+
+inline NoGrad::NoGrad() {
+    previous_ = grad_enabled_;
+    grad_enabled_ = false;
+}
+
+inline NoGrad::~NoGrad() {
+    grad_enabled_ = previous_;
+}
+
+inline bool NoGrad::grad_enabled() {
+    return grad_enabled_;
+}
 
 template <typename T>
 Variable<T>::Variable(
     T data,
-    std::set<std::shared_ptr<Variable<T>>> parents) {
+    std::vector<std::shared_ptr<Variable<T>>> parents) {
     
-    this->data_ = data;
-    this->grad_ = 0.0;
+    this->own_data_ = data;
+    this->own_grad_ = 0.0;
+    this->data_ = &own_data_;
+    this->grad_ = &own_grad_;
     this->parent_variables_ = std::move(parents);
-    this->backward_ = []() {};
+    this->backward_ = nullptr;
     this->additional_info_ = "";
+    this->op_ = VariableOp::Leaf;
+    this->constant_ = 0.0;
+    this->visit_epoch_ = 0;
+    this->order_generation_ = 0;
+    this->order_index_ = 0;
+}
+
+/*
+ * Releasing the parents recursively would overflow the stack on a deep
+ * graph, so the first destructor on a thread drains the parents of every
+ * node it releases from a thread-local worklist instead.
+*/
+template <typename T>
+Variable<T>::~Variable() {
+    if (parent_variables_.empty()) return;
+
+    thread_local std::vector<std::shared_ptr<Variable<T>>> pending;
+    thread_local bool draining = false;
+
+    for (auto & parent : parent_variables_) {
+        pending.push_back(std::move(parent));
+    }
+    parent_variables_.clear();
+    if (draining) return;
+
+    draining = true;
+    while (!pending.empty()) {
+        std::shared_ptr<Variable<T>> parent = std::move(pending.back());
+        pending.pop_back();
+    }
+    draining = false;
+}
+
+template <typename T>
+template <typename Expression>
+std::shared_ptr<Variable<T>> Variable<T>::from_expression(const Expression &expression) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Expression);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(expression.value);
+
+    std::vector<std::shared_ptr<Variable<T>>> parents;
+    parents.reserve(Expression::LEAVES);
+    expression.collect_leaves(parents);
+
+    auto result = std::make_shared<Variable<T>>(expression.value, std::move(parents));
+    result->op_ = VariableOp::Expression;
+    result->backward_ = [expression, out = result.get()]() {
+        expression.backward(*out->grad_, [](Variable<T> *leaf, T grad) {
+            leaf->accumulate_grad(grad);
+        });
+    };
+
+    return result;
 }
 
 template <typename T>
@@ -19,32 +89,50 @@ std::ostream &operator<<(std::ostream &os, const std::shared_ptr<Variable<T>> &v
 
 template <typename T>
 std::set<std::shared_ptr<Variable<T>>> Variable<T>::get_node_parents() {
-    return parent_variables_;
+    return std::set<std::shared_ptr<Variable<T>>>(parent_variables_.begin(), parent_variables_.end());
 }
 
 template <typename T>
 T Variable<T>::get_data_value() {
-    return data_;
+    return *data_;
 }
 
 template <typename T>
 T Variable<T>::get_grad_value() {
-    return grad_;
+    return *grad_;
+}
+
+template <typename T>
+VariableOp Variable<T>::get_op() const {
+    return op_;
 }
 
 template <typename T>
 void Variable<T>::get_info() {
-    std::cout << "Variable(data=" << data_ << ", grad=" << grad_ << ", info=" << additional_info_ << ")" << std::endl;
+    std::cout << "Variable(data=" << *data_ << ", grad=" << *grad_ << ", info=" << additional_info_ << ")" << std::endl;
 }
 
 template <typename T>
 void Variable<T>::set_grad(T grad) {
-    this->grad_ = grad;
+    *this->grad_ = grad;
 }
 
 template <typename T>
 void Variable<T>::set_data(T data) {
-    this->data_ = data;
+    *this->data_ = data;
+}
+
+/*
+ * Moves the value and the gradient of the variable to external memory,
+ * e.g. a slot of a model's flat parameter buffer. The current values are
+ * copied there; the memory must outlive the variable or be rebound.
+*/
+template <typename T>
+void Variable<T>::bind_storage(T *data, T *grad) {
+    *data = *data_;
+    *grad = *grad_;
+    data_ = data;
+    grad_ = grad;
 }
 
 template <typename T>
@@ -52,42 +140,415 @@ void Variable<T>::add_info(const std::string &info) {
     additional_info_ = std::move(info);
 }
 
+/*
+ * Iterative post-order DFS with an explicit stack. A node is visited once
+ * per traversal: it is stamped with the traversal epoch instead of being
+ * looked up in a visited set.
+*/
 template <typename T>
-void Variable<T>::backward() {
-    grad_ = 1.0;
-    std::vector<std::shared_ptr<Variable<T>>> order;
-    std::set<std::shared_ptr<Variable<T>>> visited;
+void Variable<T>::build_topological_order(std::vector<Variable<T> *> &order, bool leaves) {
+    thread_local std::vector<std::pair<Variable<T> *, size_t>> stack;
+
+    uint64_t epoch = epoch_counter_.fetch_add(1, std::memory_order_relaxed) + 1;
+    order.clear();
+    stack.clear();
+
+    visit_epoch_ = epoch;
+    stack.emplace_back(this, 0);
+
+    while (!stack.empty()) {
+        auto & [variable, next] = stack.back();
+        if (next < variable->parent_variables_.size()) {
+            Variable<T> *parent = variable->parent_variables_[next++].get();
+            if (parent->visit_epoch_ != epoch && (leaves || !parent->parent_variables_.empty())) {
+                parent->visit_epoch_ = epoch;
+                stack.emplace_back(parent, 0);
+            }
+        } else {
+            order.push_back(variable);
+            stack.pop_back();
+        }
+    }
+}
 
-    std::function<void(const std::shared_ptr<Variable<T>>&)> dfs = 
-    [&] (const std::shared_ptr<Variable<T>> &variable) {
-        if (visited.count(variable) > 0) return;
-        visited.insert(variable);
-        for (auto & parent : variable->parent_variables_) {
-            dfs(parent);
+/*
+ * Adds to the gradient of this node from the backward closure of one of
+ * its children, in the way required by the running sweep.
+*/
+template <typename T>
+inline void Variable<T>::accumulate_grad(T grad) {
+    switch (accumulation_) {
+        case Accumulation::Direct:
+            *grad_ += grad;
+            break;
+        case Accumulation::Atomic:
+            std::atomic_ref<T>(*grad_).fetch_add(grad, std::memory_order_relaxed);
+            break;
+        case Accumulation::Slots: {
+            size_t k = 0;
+            while (accumulating_parents_[k] != this) ++k;
+            accumulating_slots_[k] += grad;
+            break;
         }
-        order.push_back(variable);
+        case Accumulation::Deferred:
+            if (parent_variables_.empty()) {
+                (*deferred_leaves_)[this] += grad;
+            } else {
+                *grad_ += grad;
+            }
+            break;
+    }
+}
+
+/*
+ * The order cached by backward(true), or an empty one to build into. Any
+ * release of a graph, even of another root, may have cut links and freed
+ * nodes of the cached order, so it is only used while no release has
+ * happened since it was built.
+*/
+template <typename T>
+std::vector<Variable<T> *> &Variable<T>::cached_order() {
+    if (order_generation_ != release_generation_.load(std::memory_order_acquire)) topological_order_.clear();
+    return topological_order_;
+}
+
+/*
+ * Unless retain_graph is set, the closures and parent links of the traversed
+ * nodes are released once the gradients are propagated, so intermediate
+ * nodes are freed even while the output is still referenced.
+ *
+ * With retain_graph the topological order is cached in this node and reused
+ * by the next backward() call on the same graph, until a graph is released
+ * anywhere.
+*/
+template <typename T>
+std::vector<Variable<T> *> &Variable<T>::prepare_backward(bool retain_graph) {
+    thread_local std::vector<Variable<T> *> scratch;
+
+    std::vector<Variable<T> *> &cached = cached_order();
+    std::vector<Variable<T> *> &order = retain_graph || !cached.empty() ? cached : scratch;
+    if (order.empty()) {
+        order_generation_ = release_generation_.load(std::memory_order_acquire);
+        build_topological_order(order);
+    }
+
+    // Only leaves accumulate gradients across backward() calls.
+    for (auto variable : order) {
+        if (variable->backward_) *variable->grad_ = 0.0;
+    }
+    *grad_ = 1.0;
+    return order;
+}
+
+template <typename T>
+void Variable<T>::finish_backward(std::vector<Variable<T> *> &order, bool retain_graph) {
+    if (retain_graph) return;
+
+    release_generation_.fetch_add(1, std::memory_order_acq_rel);
+    // Parents precede their children in the order, so releasing from the front
+    // only frees nodes that have already been visited.
+    for (auto variable : order) {
+        variable->backward_ = nullptr;
+        variable->parent_variables_.clear();
+    }
+    order.clear();
+    if (&order == &topological_order_) topological_order_.shrink_to_fit();
+}
+
+template <typename T>
+void Variable<T>::backward(bool retain_graph) {
+    AUTOGRAD_PROFILE_SCOPE("Variable::backward");
+    std::vector<Variable<T> *> &order = prepare_backward(retain_graph);
+#ifdef AUTOGRAD_PROFILE
+    Profiler::global().record_graph(order.size(), graph_depth(order));
+#endif
+
+    for (size_t i = order.size(); i-- > 0;) {
+        if (order[i]->backward_) {
+            AUTOGRAD_PROFILE_BACKWARD(order[i]->op_);
+            order[i]->backward_();
+        }
+    }
+
+    finish_backward(order, retain_graph);
+}
+
+/*
+ * Without deterministic mode a single thread gains nothing over the
+ * sequential sweep, which is used instead.
+*/
+template <typename T>
+void Variable<T>::parallel_backward(bool retain_graph, bool deterministic, ThreadPool &pool) {
+    if (!deterministic && pool.get_size() == 1) {
+        backward(retain_graph);
+        return;
+    }
+
+    AUTOGRAD_PROFILE_SCOPE("Variable::parallel_backward");
+    std::vector<Variable<T> *> &order = prepare_backward(retain_graph);
+#ifdef AUTOGRAD_PROFILE
+    Profiler::global().record_graph(order.size(), graph_depth(order));
+#endif
+    parallel_sweep(order, deterministic, pool);
+    finish_backward(order, retain_graph);
+}
+
+/*
+ * Dependency-counting scheduler. Every distinct (child, parent) pair of the
+ * graph is an edge, and a node becomes ready when the closures of all its
+ * children have run. Ready nodes go to the queue of the worker that
+ * released them, except for the first one, which the worker runs next
+ * itself, so a chain of nodes stays on one thread. Idle workers steal.
+ *
+ * In deterministic mode the closure of a child writes to the slots of its
+ * edges, and a node adds up the slots of its incoming edges in the order of
+ * the sequential sweep before its own closure runs. Checkpoint nodes hand
+ * the gradients of the leaves their segments read back to the sweep, which
+ * adds them once all nodes are done, in the order of the sequential sweep
+ * as well.
+*/
+template <typename T>
+void Variable<T>::parallel_sweep(const std::vector<Variable<T> *> &order, bool deterministic, ThreadPool &pool) {
+    struct Scratch {
+        std::vector<size_t> edge_offsets, incoming_offsets, incoming_edges, cursor;
+        std::vector<Variable<T> *> edge_parents;
+        std::vector<T> slots;
+        DeferredGrads deferred;
     };
+    // The workers reach the buffers of the calling thread through these references.
+    thread_local Scratch scratch;
+    auto &[edge_offsets, incoming_offsets, incoming_edges, cursor, edge_parents, slots, deferred] = scratch;
+
+    const size_t n = order.size();
+    std::vector<std::atomic<uint32_t>> pending(n);
 
-    dfs(this->shared_from_this());
+    for (size_t i = 0; i < n; ++i) {
+        order[i]->order_index_ = i;
+    }
 
-    for (int i = (int) order.size() - 1; i >= 0; --i) {
-        order[i]->backward_();
+    // Unique parents of every node, in the order of its parent list.
+    edge_offsets.assign(n + 1, 0);
+    edge_parents.clear();
+    for (size_t i = 0; i < n; ++i) {
+        edge_offsets[i] = edge_parents.size();
+        const auto &parents = order[i]->parent_variables_;
+        for (size_t k = 0; k < parents.size(); ++k) {
+            bool seen = false;
+            for (size_t j = 0; j < k; ++j) seen |= parents[j] == parents[k];
+            if (seen) continue;
+            edge_parents.push_back(parents[k].get());
+            pending[parents[k]->order_index_].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    edge_offsets[n] = edge_parents.size();
+
+    if (deterministic) {
+        incoming_offsets.assign(n + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            incoming_offsets[i + 1] = incoming_offsets[i] + pending[i].load(std::memory_order_relaxed);
+        }
+        // Children are listed from the last to the first, as the sequential sweep visits them.
+        incoming_edges.resize(edge_parents.size());
+        cursor.assign(incoming_offsets.begin(), incoming_offsets.end() - 1);
+        for (size_t i = n; i-- > 0;) {
+            for (size_t e = edge_offsets[i]; e < edge_offsets[i + 1]; ++e) {
+                incoming_edges[cursor[edge_parents[e]->order_index_]++] = e;
+            }
+        }
+        slots.assign(edge_parents.size(), T(0.0));
+        deferred.grads.clear();
+    }
+
+    size_t n_workers = std::min(pool.get_size(), n);
+    std::vector<WorkStealingQueue<size_t>> queues(n_workers);
+    std::atomic<size_t> remaining = n;
+    queues[0].push(n - 1);
+
+    pool.parallel_for(n_workers, [&](size_t worker) {
+        accumulation_ = deterministic ? Accumulation::Slots : Accumulation::Atomic;
+        deferred_grads_ = deterministic ? &deferred : nullptr;
+
+        size_t node = 0;
+        bool have_node = false;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!have_node) have_node = queues[worker].pop(node);
+            for (size_t k = 1; !have_node && k < n_workers; ++k) {
+                have_node = queues[(worker + k) % n_workers].steal(node);
+            }
+            if (!have_node) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            Variable<T> *variable = order[node];
+            if (deterministic) {
+                for (size_t e = incoming_offsets[node]; e < incoming_offsets[node + 1]; ++e) {
+                    *variable->grad_ += slots[incoming_edges[e]];
+                }
+                accumulating_parents_ = edge_parents.data() + edge_offsets[node];
+                accumulating_slots_ = slots.data() + edge_offsets[node];
+            }
+            if (variable->backward_) {
+                AUTOGRAD_PROFILE_BACKWARD(variable->op_);
+                variable->backward_();
+            }
+
+            size_t done = node;
+            have_node = false;
+            for (size_t e = edge_offsets[done]; e < edge_offsets[done + 1]; ++e) {
+                size_t parent = edge_parents[e]->order_index_;
+                if (pending[parent].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+                if (!have_node) {
+                    node = parent;
+                    have_node = true;
+                } else {
+                    queues[worker].push(parent);
+                }
+            }
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        accumulation_ = Accumulation::Direct;
+        deferred_grads_ = nullptr;
+    });
+
+    if (deterministic && !deferred.grads.empty()) {
+        std::stable_sort(deferred.grads.begin(), deferred.grads.end(), [](const DeferredGrad &lhs, const DeferredGrad &rhs) {
+            return lhs.node > rhs.node;
+        });
+        for (auto & entry : deferred.grads) *entry.leaf->grad_ += entry.grad;
+        deferred.grads.clear();
     }
 }
 
+// Whether a node is in an order whose indices were just assigned.
+template <typename T>
+bool Variable<T>::in_order(const std::vector<Variable<T> *> &order, Variable<T> *variable) {
+    return variable->order_index_ < order.size() && order[variable->order_index_] == variable;
+}
+
+/*
+ * Number of nodes on the longest path to this node of the graph, whose
+ * topological order this is: one for a leaf.
+*/
+template <typename T>
+size_t Variable<T>::graph_depth(const std::vector<Variable<T> *> &order) {
+    thread_local std::vector<size_t> depths;
+    depths.assign(order.size(), 1);
+    for (size_t i = 0; i < order.size(); ++i) order[i]->order_index_ = i;
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (auto & parent : order[i]->parent_variables_) {
+            depths[i] = std::max(depths[i], depths[parent->order_index_] + 1);
+        }
+    }
+    return order.empty() ? 0 : depths.back();
+}
+
+template <typename T>
+std::vector<std::shared_ptr<Variable<T>>> Variable<T>::grad(const std::vector<std::shared_ptr<Variable<T>>> &inputs) {
+    std::vector<Variable<T> *> order;
+    build_topological_order(order);
+    for (size_t i = 0; i < order.size(); ++i) order[i]->order_index_ = i;
+
+    // Gradient nodes by order index; a null one is zero.
+    std::vector<std::shared_ptr<Variable<T>>> grads(order.size());
+    grads.back() = std::make_shared<Variable<T>>(1.0);
+    const std::shared_ptr<Variable<T>> none;
+
+    for (size_t i = order.size(); i-- > 0;) {
+        Variable<T> *variable = order[i];
+        auto & parents = variable->parent_variables_;
+        if (parents.empty() || !grads[i]) continue;
+
+        std::shared_ptr<Variable<T>> lhs_grad, rhs_grad;
+        chain_rule(variable->op_, variable->constant_, variable->shared_from_this(), parents[0],
+                   parents.size() > 1 ? parents[1] : none, grads[i], lhs_grad, rhs_grad);
+        add_rule_grad(grads[parents[0]->order_index_], lhs_grad);
+        if (parents.size() > 1) add_rule_grad(grads[parents[1]->order_index_], rhs_grad);
+    }
+
+    std::vector<std::shared_ptr<Variable<T>>> result;
+    result.reserve(inputs.size());
+    for (auto & input : inputs) {
+        bool reached = in_order(order, input.get()) && grads[input->order_index_];
+        result.push_back(reached ? grads[input->order_index_] : std::make_shared<Variable<T>>(0.0));
+    }
+    return result;
+}
+
+template <typename T>
+std::vector<T> Variable<T>::hvp(const std::vector<std::shared_ptr<Variable<T>>> &inputs, const std::vector<T> &direction) {
+    if (inputs.size() != direction.size()) {
+        throw std::invalid_argument("hvp: the direction must have one entry per input");
+    }
+
+    thread_local std::vector<Variable<T> *> scratch;
+    thread_local std::vector<Dual<T>> values;
+    thread_local std::vector<Dual<T>> adjoints;
+
+    // Reuses the order cached by backward(true) on a retained graph.
+    std::vector<Variable<T> *> &cached = cached_order();
+    std::vector<Variable<T> *> &order = cached.empty() ? scratch : cached;
+    if (&order == &scratch) build_topological_order(order);
+    const size_t n = order.size();
+    values.resize(n);
+    adjoints.assign(n, Dual<T>());
+    for (size_t i = 0; i < n; ++i) {
+        order[i]->order_index_ = i;
+        values[i] = Dual<T>(*order[i]->data_);
+    }
+    for (size_t j = 0; j < inputs.size(); ++j) {
+        if (!in_order(order, inputs[j].get())) continue;
+        values[inputs[j]->order_index_] = Dual<T>(*inputs[j]->data_, std::array<T, 1>{direction[j]});
+    }
+
+    const Dual<T> none;
+    for (size_t i = 0; i < n; ++i) {
+        auto & parents = order[i]->parent_variables_;
+        if (parents.empty()) continue;
+        values[i] = forward_rule(order[i]->op_, order[i]->constant_, values[parents[0]->order_index_],
+                                 parents.size() > 1 ? values[parents[1]->order_index_] : none);
+    }
+
+    adjoints[n - 1] = Dual<T>(1.0);
+    for (size_t i = n; i-- > 0;) {
+        auto & parents = order[i]->parent_variables_;
+        if (parents.empty()) continue;
+
+        size_t lhs = parents[0]->order_index_;
+        size_t rhs = parents.size() > 1 ? parents[1]->order_index_ : i;
+        Dual<T> lhs_grad, rhs_grad;
+        chain_rule(order[i]->op_, order[i]->constant_, values[i], values[lhs],
+                   parents.size() > 1 ? values[rhs] : none, adjoints[i], lhs_grad, rhs_grad);
+        adjoints[lhs] = adjoints[lhs] + lhs_grad;
+        if (parents.size() > 1) adjoints[rhs] = adjoints[rhs] + rhs_grad;
+    }
+
+    std::vector<T> result(inputs.size(), 0.0);
+    for (size_t j = 0; j < inputs.size(); ++j) {
+        if (in_order(order, inputs[j].get())) result[j] = adjoints[inputs[j]->order_index_].get_tangent();
+    }
+    return result;
+}
+
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::operator+(const std::shared_ptr<Variable<T>> &other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Add);
+    T value = *data_ + *other->data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        data_ + other->data_,
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this(),
             other
         }
     );
 
-    result->backward_ = [this, other, result]() {
-        grad_ += result->grad_;
-        other->grad_ += result->grad_;
+    result->op_ = VariableOp::Add;
+    result->backward_ = [this, other = other.get(), out = result.get()]() {
+        accumulate_grad(*out->grad_);
+        other->accumulate_grad(*out->grad_);
     };
 
     return result;
@@ -95,17 +556,22 @@ std::shared_ptr<Variable<T>> Variable<T>::operator+(const std::shared_ptr<Variab
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::operator*(const std::shared_ptr<Variable<T>> &other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Mul);
+    T value = *data_ * *other->data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        data_ * other->data_,
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this(),
             other
         }
     );
 
-    result->backward_ = [this, other, result]() {
-        grad_ += other->data_ * result->grad_;
-        other->grad_ += data_ * result->grad_;
+    result->op_ = VariableOp::Mul;
+    result->backward_ = [this, other = other.get(), out = result.get()]() {
+        accumulate_grad(*other->data_ * *out->grad_);
+        other->accumulate_grad(*data_ * *out->grad_);
     };
 
     return result;
@@ -113,16 +579,23 @@ std::shared_ptr<Variable<T>> Variable<T>::operator*(const std::shared_ptr<Variab
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::pow(const std::shared_ptr<Variable<T>> &other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Pow);
+    T value = std::pow(*data_, *other->data_);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        std::pow(data_, other->data_),
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this(),
             other
         }
     );
 
-    result->backward_ = [this, other, result]() {
-        grad_ += other->data_ * std::pow(data_, other->data_ - 1.0) * result->grad_;
+    result->op_ = VariableOp::Pow;
+    // The derivative in the exponent, base^exponent * log(base), only exists for a positive base.
+    result->backward_ = [this, other = other.get(), out = result.get()]() {
+        accumulate_grad(*other->data_ * std::pow(*data_, *other->data_ - T(1.0)) * *out->grad_);
+        if (*data_ > T(0.0)) other->accumulate_grad(*out->data_ * std::log(*data_) * *out->grad_);
     };
 
     return result;
@@ -130,15 +603,20 @@ std::shared_ptr<Variable<T>> Variable<T>::pow(const std::shared_ptr<Variable<T>>
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::ReLU() {
+    AUTOGRAD_PROFILE_OP(VariableOp::ReLU);
+    T value = *data_ < T(0.0) ? T(0.0) : *data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        data_ < 0.0 ? 0.0 : data_,
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this()
         }
     );
 
-    result->backward_ = [this, result]() {
-        grad_ += (result->data_ > 0.0) * result->grad_;
+    result->op_ = VariableOp::ReLU;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(T(*out->data_ > T(0.0)) * *out->grad_);
     };
 
     return result;
@@ -146,15 +624,20 @@ std::shared_ptr<Variable<T>> Variable<T>::ReLU() {
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::Tanh() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Tanh);
+    T value = std::tanh(*data_);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        (std::exp(2 * data_) - 1.0) / (std::exp(2 * data_) + 1.0),
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this()
         }
     );
 
-    result->backward_ = [this, result]() {
-        grad_ += (1.0 - result->data_ * result->data_) * result->grad_;
+    result->op_ = VariableOp::Tanh;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad((T(1.0) - *out->data_ * *out->data_) * *out->grad_);
     };
 
     return result;
@@ -162,15 +645,20 @@ std::shared_ptr<Variable<T>> Variable<T>::Tanh() {
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::Sigmoid() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Sigmoid);
+    T value = T(1.0) / (T(1.0) + std::exp(-*data_));
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        1.0 / (1.0 + std::exp(-data_)),
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this()
         }
     );
 
-    result->backward_ = [this, result]() {
-        grad_ += (result->data_ * (1.0 - result->data_)) * result->grad_;
+    result->op_ = VariableOp::Sigmoid;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad((*out->data_ * (T(1.0) - *out->data_)) * *out->grad_);
     };
 
     return result;
@@ -178,15 +666,62 @@ std::shared_ptr<Variable<T>> Variable<T>::Sigmoid() {
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::exp() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Exp);
+    T value = std::exp(*data_);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    result->op_ = VariableOp::Exp;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(*out->data_ * *out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::log() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Log);
+    T value = std::log(*data_);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+
+    result->op_ = VariableOp::Log;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(*out->grad_ / *data_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::sqrt() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Sqrt);
+    T value = std::sqrt(*data_);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
     auto result = std::make_shared<Variable<T>>(
-        std::exp(data_),
-        std::set<std::shared_ptr<Variable<T>>>{
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
             this->shared_from_this()
         }
     );
 
-    result->backward_ = [this, result]() {
-        grad_ += result->data_ * result->grad_;
+    result->op_ = VariableOp::Sqrt;
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(*out->grad_ / (T(2.0) * *out->data_));
     };
 
     return result;
@@ -194,19 +729,245 @@ std::shared_ptr<Variable<T>> Variable<T>::exp() {
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::operator-() {
-    return this->shared_from_this() * std::make_shared<Variable<T>>(-1.0);
+    AUTOGRAD_PROFILE_OP(VariableOp::Neg);
+    T value = -*data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::Neg;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(-*out->grad_);
+    };
+
+    return result;
 }
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::operator-(const std::shared_ptr<Variable<T>> &other) {
-    return this->shared_from_this() + (other->operator-());
+    AUTOGRAD_PROFILE_OP(VariableOp::Sub);
+    T value = *data_ - *other->data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this(),
+            other
+        }
+    );
+    result->op_ = VariableOp::Sub;
+
+    result->backward_ = [this, other = other.get(), out = result.get()]() {
+        accumulate_grad(*out->grad_);
+        other->accumulate_grad(-*out->grad_);
+    };
+
+    return result;
 }
 
 template <typename T>
 std::shared_ptr<Variable<T>> Variable<T>::operator/(const std::shared_ptr<Variable<T>> &other) {
-    return this->shared_from_this() * other->pow(std::make_shared<Variable<T>>(-1.0));
+    AUTOGRAD_PROFILE_OP(VariableOp::Div);
+    T value = *data_ / *other->data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this(),
+            other
+        }
+    );
+    result->op_ = VariableOp::Div;
+
+    result->backward_ = [this, other = other.get(), out = result.get()]() {
+        accumulate_grad(*out->grad_ / *other->data_);
+        other->accumulate_grad(-*out->data_ / *other->data_ * *out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::square() {
+    AUTOGRAD_PROFILE_OP(VariableOp::Square);
+    T value = *data_ * *data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::Square;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(T(2.0) * *data_ * *out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::operator+(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::AddScalar);
+    T value = *data_ + other;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::AddScalar;
+    result->constant_ = other;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(*out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::operator-(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::AddScalar);
+    T value = *data_ - other;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::AddScalar;
+    result->constant_ = -other;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(*out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::operator*(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::MulScalar);
+    T value = *data_ * other;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::MulScalar;
+    result->constant_ = other;
+
+    result->backward_ = [this, other, out = result.get()]() {
+        accumulate_grad(other * *out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::operator/(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::DivScalar);
+    T value = *data_ / other;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::DivScalar;
+    result->constant_ = other;
+
+    result->backward_ = [this, other, out = result.get()]() {
+        accumulate_grad(*out->grad_ / other);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::pow(T exponent) {
+    AUTOGRAD_PROFILE_OP(VariableOp::PowScalar);
+    T value = std::pow(*data_, exponent);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::PowScalar;
+    result->constant_ = exponent;
+
+    result->backward_ = [this, exponent, out = result.get()]() {
+        accumulate_grad(exponent * std::pow(*data_, exponent - T(1.0)) * *out->grad_);
+    };
+
+    return result;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::rsub(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::ScalarSub);
+    T value = other - *data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::ScalarSub;
+    result->constant_ = other;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(-*out->grad_);
+    };
+
+    return result;
 }
 
+template <typename T>
+std::shared_ptr<Variable<T>> Variable<T>::rdiv(T other) {
+    AUTOGRAD_PROFILE_OP(VariableOp::ScalarDiv);
+    T value = other / *data_;
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(
+        value,
+        std::vector<std::shared_ptr<Variable<T>>>{
+            this->shared_from_this()
+        }
+    );
+    result->op_ = VariableOp::ScalarDiv;
+    result->constant_ = other;
+
+    result->backward_ = [this, out = result.get()]() {
+        accumulate_grad(-*out->data_ / *data_ * *out->grad_);
+    };
+
+    return result;
+}
 
 template <typename T>
 std::shared_ptr<Variable<T>> operator+(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs) {
@@ -218,6 +979,11 @@ std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& lhs,
     return (*lhs) - rhs;
 }
 
+template <typename T>
+std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& operand) {
+    return -(*operand);
+}
+
 template <typename T>
 std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs) {
     return (*lhs) * rhs;
@@ -226,4 +992,200 @@ std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>>& lhs,
 template <typename T>
 std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs) {
     return (*lhs) / rhs;
-}
\ No newline at end of file
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator+(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs) {
+    return (*lhs) + rhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator+(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs) {
+    return (*rhs) + lhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs) {
+    return (*lhs) - rhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator-(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs) {
+    return rhs->rsub(lhs);
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs) {
+    return (*lhs) * rhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator*(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs) {
+    return (*rhs) * lhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs) {
+    return (*lhs) / rhs;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> operator/(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs) {
+    return rhs->rdiv(lhs);
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> ReLU(const std::shared_ptr<Variable<T>>& x) {
+    return x->ReLU();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Tanh(const std::shared_ptr<Variable<T>>& x) {
+    return x->Tanh();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> Sigmoid(const std::shared_ptr<Variable<T>>& x) {
+    return x->Sigmoid();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> exp(const std::shared_ptr<Variable<T>>& x) {
+    return x->exp();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> log(const std::shared_ptr<Variable<T>>& x) {
+    return x->log();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> sqrt(const std::shared_ptr<Variable<T>>& x) {
+    return x->sqrt();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> square(const std::shared_ptr<Variable<T>>& x) {
+    return x->square();
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> pow(const std::shared_ptr<Variable<T>>& x, const std::shared_ptr<Variable<T>>& exponent) {
+    return x->pow(exponent);
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> pow(const std::shared_ptr<Variable<T>>& x, std::type_identity_t<T> exponent) {
+    return x->pow(exponent);
+}
+
+template <typename T>
+T rule_value(const std::shared_ptr<Variable<T>> &x) {
+    return x->get_data_value();
+}
+
+template <typename T, size_t K>
+T rule_value(const Dual<T, K> &x) {
+    return x.get_data_value();
+}
+
+// sum += term, where a null gradient node stands for zero.
+template <typename T>
+void add_rule_grad(std::shared_ptr<Variable<T>> &sum, const std::shared_ptr<Variable<T>> &term) {
+    if (term) sum = sum ? sum + term : term;
+}
+
+template <typename T, typename S>
+S forward_rule(VariableOp op, T constant, const S &lhs, const S &rhs) {
+    switch (op) {
+        case VariableOp::Add: return lhs + rhs;
+        case VariableOp::Sub: return lhs - rhs;
+        case VariableOp::Mul: return lhs * rhs;
+        case VariableOp::Div: return lhs / rhs;
+        case VariableOp::Neg: return -lhs;
+        case VariableOp::Pow: return pow(lhs, rhs);
+        case VariableOp::Square: return square(lhs);
+        case VariableOp::AddScalar: return lhs + constant;
+        case VariableOp::MulScalar: return lhs * constant;
+        case VariableOp::DivScalar: return lhs / constant;
+        case VariableOp::PowScalar: return pow(lhs, constant);
+        case VariableOp::ScalarSub: return constant - lhs;
+        case VariableOp::ScalarDiv: return constant / lhs;
+        case VariableOp::ReLU: return ReLU(lhs);
+        case VariableOp::Tanh: return Tanh(lhs);
+        case VariableOp::Sigmoid: return Sigmoid(lhs);
+        case VariableOp::Exp: return exp(lhs);
+        case VariableOp::Log: return log(lhs);
+        case VariableOp::Sqrt: return sqrt(lhs);
+        default: throw std::invalid_argument("forward_rule: fused nodes have no rule");
+    }
+}
+
+template <typename T, typename S>
+void chain_rule(VariableOp op, T constant, const S &out, const S &lhs, const S &rhs, const S &grad, S &lhs_grad, S &rhs_grad) {
+    switch (op) {
+        case VariableOp::Add:
+            lhs_grad = grad;
+            rhs_grad = grad;
+            break;
+        case VariableOp::Sub:
+            lhs_grad = grad;
+            rhs_grad = -grad;
+            break;
+        case VariableOp::Mul:
+            lhs_grad = grad * rhs;
+            rhs_grad = grad * lhs;
+            break;
+        case VariableOp::Div:
+            lhs_grad = grad / rhs;
+            rhs_grad = -(grad * out) / rhs;
+            break;
+        case VariableOp::Neg:
+        case VariableOp::ScalarSub:
+            lhs_grad = -grad;
+            break;
+        case VariableOp::Pow:
+            // As in Variable::pow, the derivative in the exponent needs a positive base.
+            lhs_grad = grad * rhs * pow(lhs, rhs - T(1.0));
+            if (rule_value(lhs) > T(0.0)) rhs_grad = grad * out * log(lhs);
+            break;
+        case VariableOp::Square:
+            lhs_grad = grad * lhs * T(2.0);
+            break;
+        case VariableOp::AddScalar:
+            lhs_grad = grad;
+            break;
+        case VariableOp::MulScalar:
+            lhs_grad = grad * constant;
+            break;
+        case VariableOp::DivScalar:
+            lhs_grad = grad / constant;
+            break;
+        case VariableOp::PowScalar:
+            lhs_grad = grad * pow(lhs, constant - T(1.0)) * constant;
+            break;
+        case VariableOp::ScalarDiv:
+            lhs_grad = -(grad * out) / lhs;
+            break;
+        case VariableOp::ReLU:
+            if (rule_value(out) > T(0.0)) lhs_grad = grad;
+            break;
+        case VariableOp::Tanh:
+            lhs_grad = grad * (T(1.0) - square(out));
+            break;
+        case VariableOp::Sigmoid:
+            lhs_grad = grad * (out * (T(1.0) - out));
+            break;
+        case VariableOp::Exp:
+            lhs_grad = grad * out;
+            break;
+        case VariableOp::Log:
+            lhs_grad = grad / lhs;
+            break;
+        case VariableOp::Sqrt:
+            lhs_grad = grad / (out * T(2.0));
+            break;
+        default:
+            throw std::invalid_argument("chain_rule: fused nodes cannot be differentiated twice");
+    }
+}
@@ -1,13 +1,25 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
+#include <cstdint>
 #include <ostream>
 #include <memory>
 #include <functional>
 #include <set>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
 #include <cmath>
 #include <string>
 #include <iostream>
+#include <type_traits>
+#include <stdexcept>
+
+#include "dual.cpp"
+#include "profiler.hpp"
+#include "thread_pool.cpp"
+#include "work_stealing_queue.hpp"
 
 /*
  * The main object of autograd engine.
@@ -20,34 +32,186 @@
  * You can get inforamtion about Variable using get_info() method or 
  * using std::cout.
  * 
+ * A node owns its parents, and its backward closure refers to itself and
+ * to them by raw pointer, so a graph is freed as soon as the last pointer
+ * to its output is dropped. Neither backward() nor the destruction of a
+ * graph recurse, so graph depth is only limited by memory.
+ * 
+ * The value and the gradient are stored in the node itself unless
+ * bind_storage() moves them elsewhere, which is how a model keeps all its
+ * parameters in one flat buffer.
+ * 
+ * parallel_backward() runs the backward closures of independent branches
+ * concurrently: a node is scheduled as soon as all the nodes that use it
+ * are done. Gradients of shared inputs are then accumulated atomically, or,
+ * in deterministic mode, into one slot per edge that is summed in a fixed
+ * order, so the result does not depend on the number of threads.
+ * 
+ * grad() is the create_graph mode of backward(): the gradient is built
+ * out of Variables, so it can be differentiated again. hvp() computes
+ * Hessian-vector products without building any node.
+ * 
+ * Inside a NoGrad scope the operations build no graph at all (see NoGrad).
+ * 
+ * Built with -DAUTOGRAD_PROFILE, every op and backward closure is timed by
+ * the Profiler (see profiler.hpp).
+ * 
  * Implemented some of activations functions.
 */
 
+/*
+ * Operation that produced a node, used by GraphFusion to recognize
+ * patterns. The *Scalar ops take a plain number as the second operand
+ * (ScalarSub and ScalarDiv as the first one). Dot and DotActivation only
+ * appear in fused graphs, Expression marks a node made by
+ * from_expression(), Checkpoint the nodes of a checkpointed segment, and
+ * Softmax and Loss the nodes of the vector ops of losses.hpp.
+*/
+enum class VariableOp : uint8_t {
+    Leaf, Add, Sub, Mul, Div, Neg, Pow, Square,
+    AddScalar, MulScalar, DivScalar, PowScalar, ScalarSub, ScalarDiv,
+    ReLU, Tanh, Sigmoid, Exp, Log, Sqrt,
+    Dot, DotActivation, Expression, Checkpoint, Softmax, Loss
+};
+
+/*
+ * Inference mode: while a NoGrad object is alive, operations on Variables
+ * and Tensors on the same thread only compute values. The result is a
+ * leaf with no parents and no backward closure, so no graph is kept alive
+ * and backward() on it does nothing. Guards nest, each one restores the
+ * mode it found.
+*/
+class NoGrad {
+private:
+    bool previous_;
+    static inline thread_local bool grad_enabled_ = true;
+
+public:
+    NoGrad();
+    ~NoGrad();
+
+    NoGrad(const NoGrad &) = delete;
+    NoGrad &operator=(const NoGrad &) = delete;
+
+    static bool grad_enabled();
+};
+
+template <typename T>
+class GraphFusion;
+
+template <typename T>
+class Checkpoint;
+
+template <typename T>
+class VectorNode;
+
 template <typename T = double>
 class Variable : public std::enable_shared_from_this<Variable<T>> {
 private:
-    T data_;
-    T grad_;
+    T own_data_;
+    T own_grad_;
+    T *data_;
+    T *grad_;
     std::function<void()> backward_;
-    std::set<std::shared_ptr<Variable<T>>> parent_variables_;
+    std::vector<std::shared_ptr<Variable<T>>> parent_variables_;
     std::string additional_info_;
+    VariableOp op_;
+    T constant_;
+
+    uint64_t visit_epoch_;
+    size_t order_index_;
+    std::vector<Variable<T> *> topological_order_;
+    uint64_t order_generation_;
+    static inline std::atomic<uint64_t> epoch_counter_ = 0;
+    static inline std::atomic<uint64_t> release_generation_ = 0;
+
+    enum class Accumulation : uint8_t {Direct, Atomic, Slots, Deferred};
+    static inline thread_local Accumulation accumulation_ = Accumulation::Direct;
+    static inline thread_local Variable<T> *const *accumulating_parents_ = nullptr;
+    static inline thread_local T *accumulating_slots_ = nullptr;
+
+    // Leaf gradients of the checkpointed segments of a deterministic sweep (see Checkpoint::recompute).
+    struct DeferredGrad {
+        size_t node;
+        std::shared_ptr<Variable<T>> leaf;
+        T grad;
+    };
+    struct DeferredGrads {
+        std::mutex mutex;
+        std::vector<DeferredGrad> grads;
+    };
+    static inline thread_local DeferredGrads *deferred_grads_ = nullptr;
+    static inline thread_local std::unordered_map<Variable<T> *, T> *deferred_leaves_ = nullptr;
+
+    void build_topological_order(std::vector<Variable<T> *> &order, bool leaves = true);
+    std::vector<Variable<T> *> &cached_order();
+    std::vector<Variable<T> *> &prepare_backward(bool retain_graph);
+    void finish_backward(std::vector<Variable<T> *> &order, bool retain_graph);
+    void parallel_sweep(const std::vector<Variable<T> *> &order, bool deterministic, ThreadPool &pool);
+    void accumulate_grad(T grad);
+    static bool in_order(const std::vector<Variable<T> *> &order, Variable<T> *variable);
+    static size_t graph_depth(const std::vector<Variable<T> *> &order);
+
+    friend class GraphFusion<T>;
+    friend class Checkpoint<T>;
+    friend class VectorNode<T>;
 
 public:
     Variable(
         T data = 0.0,
-        std::set<std::shared_ptr<Variable<T>>> parents = {}
+        std::vector<std::shared_ptr<Variable<T>>> parents = {}
     );
+    ~Variable();
+
+    Variable(const Variable &) = delete;
+    Variable &operator=(const Variable &) = delete;
+
+    /*
+     * One node for a whole expression template (see expression.hpp): the
+     * parents are the leaves of the expression, and the backward closure
+     * is the expression's own inlined backward pass. The expression only
+     * points to its leaves: until this call they must be owned elsewhere.
+    */
+    template <typename Expression>
+    static std::shared_ptr<Variable<T>> from_expression(const Expression &expression);
 
     std::set<std::shared_ptr<Variable<T>>> get_node_parents();
     T get_data_value();
     T get_grad_value();
+    VariableOp get_op() const;
     void get_info();
 
     void set_grad(T grad);
     void set_data(T data);
+    void bind_storage(T *data, T *grad);
     void add_info(const std::string &info);
 
-    void backward();
+    void backward(bool retain_graph = false);
+
+    /*
+     * Gradients of this node with respect to the inputs as new Variables,
+     * built from the same graph by the rules of chain_rule(); backward()
+     * or grad() on them gives second derivatives. Unlike backward(), the
+     * gradients are returned rather than stored, since a gradient graph
+     * usually refers back to its input and would otherwise own it. Inputs
+     * that this node does not depend on get a constant 0.
+     *
+     * The gradient graphs share the nodes of this graph, so backward()
+     * without retain_graph on them releases this graph as well: call
+     * backward(true) on them while this node is still needed.
+    */
+    std::vector<std::shared_ptr<Variable<T>>> grad(const std::vector<std::shared_ptr<Variable<T>>> &inputs);
+
+    /*
+     * Hessian-vector product H * direction of this node with respect to
+     * the inputs, which must be leaves. Forward over reverse: the values
+     * are recomputed on Dual numbers whose tangent is the direction, and
+     * the reverse sweep runs on Duals too, so the tangents of the input
+     * gradients are the product. Costs a few backward passes and creates
+     * no nodes.
+    */
+    std::vector<T> hvp(const std::vector<std::shared_ptr<Variable<T>>> &inputs, const std::vector<T> &direction);
+    void parallel_backward(bool retain_graph = false, bool deterministic = false, ThreadPool &pool = ThreadPool::global());
 
     std::shared_ptr<Variable<T>> operator+(const std::shared_ptr<Variable<T>> &other);
     std::shared_ptr<Variable<T>> operator-();
@@ -55,11 +219,27 @@ public:
     std::shared_ptr<Variable<T>> pow(const std::shared_ptr<Variable<T>> &other);
     std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>> &other);
     std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>> &other);
+    std::shared_ptr<Variable<T>> square();
+
+    /*
+     * Operations with a plain number: the constant is stored in the
+     * backward closure instead of a Variable of its own. rsub(c) and
+     * rdiv(c) compute c - this and c / this.
+    */
+    std::shared_ptr<Variable<T>> operator+(T other);
+    std::shared_ptr<Variable<T>> operator-(T other);
+    std::shared_ptr<Variable<T>> operator*(T other);
+    std::shared_ptr<Variable<T>> operator/(T other);
+    std::shared_ptr<Variable<T>> pow(T exponent);
+    std::shared_ptr<Variable<T>> rsub(T other);
+    std::shared_ptr<Variable<T>> rdiv(T other);
 
     std::shared_ptr<Variable<T>> ReLU();
     std::shared_ptr<Variable<T>> Tanh();
     std::shared_ptr<Variable<T>> Sigmoid();
     std::shared_ptr<Variable<T>> exp();
+    std::shared_ptr<Variable<T>> log();
+    std::shared_ptr<Variable<T>> sqrt();
 };
 
 template <typename T = double>
@@ -71,8 +251,82 @@ std::shared_ptr<Variable<T>> operator+(const std::shared_ptr<Variable<T>>& lhs,
 template <typename T = double>
 std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs);
 
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& operand);
+
 template <typename T = double>
 std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs);
 
 template <typename T = double>
-std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs);
\ No newline at end of file
+std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>>& lhs, const std::shared_ptr<Variable<T>>& rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator+(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator+(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator-(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator-(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator*(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator*(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator/(const std::shared_ptr<Variable<T>>& lhs, std::type_identity_t<T> rhs);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> operator/(std::type_identity_t<T> lhs, const std::shared_ptr<Variable<T>>& rhs);
+
+/*
+ * Free-function spelling of the unary methods, so that a function can be
+ * written once for Variables and for the Dual numbers of forward mode.
+*/
+template <typename T = double>
+std::shared_ptr<Variable<T>> ReLU(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> Tanh(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> Sigmoid(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> exp(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> log(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> sqrt(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> square(const std::shared_ptr<Variable<T>>& x);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> pow(const std::shared_ptr<Variable<T>>& x, const std::shared_ptr<Variable<T>>& exponent);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> pow(const std::shared_ptr<Variable<T>>& x, std::type_identity_t<T> exponent);
+
+/*
+ * Local derivative rules of the Variable ops, written once for the two
+ * scalar types that run them: std::shared_ptr<Variable<T>>, where grad()
+ * uses them to build gradient nodes, and Dual<T>, where hvp() uses them
+ * to differentiate the backward pass itself. forward_rule() is the op,
+ * chain_rule() sets the gradients of the operands from the gradient of
+ * the result and leaves them untouched where they are zero. Fused nodes
+ * (Dot, DotActivation, Expression, Checkpoint, Softmax, Loss) have no rule
+ * and throw.
+*/
+template <typename T, typename S>
+S forward_rule(VariableOp op, T constant, const S &lhs, const S &rhs);
+
+template <typename T, typename S>
+void chain_rule(VariableOp op, T constant, const S &out, const S &lhs, const S &rhs, const S &grad, S &lhs_grad, S &rhs_grad);
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "checkpoint.hpp"
+
+template <typename T>
+std::vector<typename Checkpoint<T>::Pointer> Checkpoint<T>::detach(const std::vector<Pointer> &inputs) {
+    std::vector<Pointer> copies;
+    copies.reserve(inputs.size());
+    for (auto & input : inputs) {
+        copies.push_back(std::make_shared<Variable<T>>(*input->data_));
+    }
+    return copies;
+}
+
+template <typename T>
+std::vector<typename Checkpoint<T>::Pointer> Checkpoint<T>::run(Segment segment, const std::vector<Pointer> &inputs) {
+    if (!NoGrad::grad_enabled()) return segment(inputs);
+
+    std::vector<T> values;
+    {
+        std::vector<Pointer> outputs = segment(detach(inputs));
+        values.reserve(outputs.size());
+        for (auto & output : outputs) values.push_back(*output->data_);
+    }
+    if (values.empty()) {
+        throw std::invalid_argument("Checkpoint: the segment returned no outputs");
+    }
+
+    auto node = std::make_shared<Variable<T>>(0.0, inputs);
+    node->op_ = VariableOp::Checkpoint;
+
+    // The closure of each output stores its gradient, the node's closure runs after all of them
+    // and resets them for the next backward pass, which may not reach every output.
+    auto output_grads = std::make_shared<std::vector<T>>(values.size(), T(0.0));
+    node->backward_ = [segment = std::move(segment), output_grads, out = node.get()]() {
+        recompute(out, segment, *output_grads);
+    };
+
+    std::vector<Pointer> outputs;
+    outputs.reserve(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto output = std::make_shared<Variable<T>>(values[i], std::vector<Pointer>{node});
+        output->op_ = VariableOp::Checkpoint;
+        output->backward_ = [output_grads, i, out = output.get()]() {
+            (*output_grads)[i] = *out->grad_;
+        };
+        outputs.push_back(std::move(output));
+    }
+    return outputs;
+}
+
+/*
+ * The recomputed graph is differentiated by a sweep of its own, over an
+ * order without the leaves: the leaves the segment reads, such as model
+ * parameters, may be read by segments recomputed on other threads at the
+ * same time, and are left unmarked.
+ *
+ * The sweep accumulates directly or, inside parallel_backward(),
+ * atomically. In deterministic mode the interior nodes, which belong to
+ * this recompute only, accumulate directly, and the gradients of the
+ * leaves are collected per leaf and handed to the outer sweep, which adds
+ * them in a fixed order (see parallel_sweep); those of a segment nested in
+ * another segment go to the enclosing recompute.
+*/
+template <typename T>
+void Checkpoint<T>::recompute(Variable<T> *node, const Segment &segment, std::vector<T> &output_grads) {
+    typedef typename Variable<T>::Accumulation Accumulation;
+
+    std::vector<Pointer> copies = detach(node->parent_variables_);
+    std::unordered_map<Variable<T> *, T> leaves;
+    const Accumulation accumulation = Variable<T>::accumulation_;
+    const bool deferred = accumulation == Accumulation::Slots || accumulation == Accumulation::Deferred;
+    {
+        std::vector<Pointer> outputs = segment(copies);
+        if (outputs.size() != output_grads.size()) {
+            throw std::invalid_argument("Checkpoint: the segment returned a different number of outputs");
+        }
+
+        Pointer root = outputs[0] * output_grads[0];
+        for (size_t i = 1; i < outputs.size(); ++i) {
+            root = root + outputs[i] * output_grads[i];
+        }
+        std::fill(output_grads.begin(), output_grads.end(), T(0.0));
+
+        std::vector<Variable<T> *> order;
+        root->build_topological_order(order, false);
+        for (auto variable : order) {
+            if (variable->backward_) *variable->grad_ = T(0.0);
+        }
+        *root->grad_ = T(1.0);
+
+        auto *deferred_leaves = Variable<T>::deferred_leaves_;
+        if (deferred) {
+            Variable<T>::accumulation_ = Accumulation::Deferred;
+            Variable<T>::deferred_leaves_ = &leaves;
+        }
+        try {
+            for (size_t i = order.size(); i-- > 0;) {
+                if (order[i]->backward_) {
+                    AUTOGRAD_PROFILE_BACKWARD(order[i]->op_);
+                    order[i]->backward_();
+                }
+            }
+        } catch (...) {
+            Variable<T>::accumulation_ = accumulation;
+            Variable<T>::deferred_leaves_ = deferred_leaves;
+            throw;
+        }
+        Variable<T>::accumulation_ = accumulation;
+        Variable<T>::deferred_leaves_ = deferred_leaves;
+
+        for (auto & copy : copies) {
+            auto it = leaves.find(copy.get());
+            if (it == leaves.end()) continue;
+            *copy->grad_ += it->second;
+            leaves.erase(it);
+        }
+        if (accumulation == Accumulation::Deferred) {
+            for (auto & [leaf, grad] : leaves) leaf->accumulate_grad(grad);
+        } else if (!leaves.empty()) {
+            auto &pending = *Variable<T>::deferred_grads_;
+            std::lock_guard<std::mutex> lock(pending.mutex);
+            for (auto & [leaf, grad] : leaves) {
+                pending.grads.push_back({node->order_index_, leaf->shared_from_this(), grad});
+            }
+        }
+    }
+
+    for (size_t k = 0; k < copies.size(); ++k) {
+        node->parent_variables_[k]->accumulate_grad(*copies[k]->grad_);
+    }
+}
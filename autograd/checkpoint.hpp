@@ -0,0 +1,45 @@
+#pragma once
+
+#include "autograd_variable.cpp"
+#include <algorithm>
+#include <unordered_map>
+
+/*
+ * Activation checkpointing: a segment of a Variable graph whose interior
+ * nodes are not kept for the backward pass but recomputed by it.
+ *
+ * run(segment, inputs) evaluates segment(inputs) on detached copies of the
+ * inputs and keeps only the values of the outputs, so the nodes built by
+ * the segment are freed as soon as it returns. The returned outputs are
+ * children of one Checkpoint node whose parents are the inputs. When a
+ * backward pass reaches that node, every output gradient is known: it
+ * runs the segment again on fresh copies, backpropagates the output
+ * gradients through the recomputed graph, which is freed afterwards, and
+ * passes the gradients of the copies on to the inputs.
+ *
+ * Only the graph of one segment is alive at a time during backward, for
+ * the price of a second forward pass of every segment. Leaves that the
+ * segment uses directly, such as model parameters, get their gradients
+ * from the recomputed graph. The segment must compute the same function
+ * each time it is called and stay valid until the backward pass.
+ *
+ * In deterministic parallel_backward() the gradients that the segments
+ * of several Checkpoint nodes give to the same leaves are added in a
+ * fixed order, so checkpointing keeps the result independent of the
+ * number of threads.
+ *
+ * Checkpoint nodes have no rule for grad() and hvp().
+*/
+
+template <typename T = double>
+class Checkpoint {
+public:
+    typedef std::shared_ptr<Variable<T>> Pointer;
+    typedef std::function<std::vector<Pointer>(const std::vector<Pointer> &)> Segment;
+
+    static std::vector<Pointer> run(Segment segment, const std::vector<Pointer> &inputs);
+
+private:
+    static std::vector<Pointer> detach(const std::vector<Pointer> &inputs);
+    static void recompute(Variable<T> *node, const Segment &segment, std::vector<T> &output_grads);
+};
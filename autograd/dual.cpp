@@ -0,0 +1,286 @@
+#pragma once
+
+#include "dual.hpp"
+
+template <typename T, size_t K>
+Dual<T, K>::Dual(T value) {
+    value_ = value;
+    tangent_.fill(0.0);
+}
+
+template <typename T, size_t K>
+Dual<T, K>::Dual(T value, const std::array<T, K> &tangent) {
+    value_ = value;
+    tangent_ = tangent;
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::variable(T value, size_t lane) {
+    Dual<T, K> result(value);
+    result.tangent_[lane] = 1.0;
+    return result;
+}
+
+template <typename T, size_t K>
+T Dual<T, K>::get_data_value() const {
+    return value_;
+}
+
+template <typename T, size_t K>
+T Dual<T, K>::get_tangent(size_t lane) const {
+    return tangent_[lane];
+}
+
+template <typename T, size_t K>
+const std::array<T, K> &Dual<T, K>::get_tangents() const {
+    return tangent_;
+}
+
+/*
+ * Result with the given value whose tangents are derivative times the
+ * tangents of this operand (plus other_derivative times those of other).
+*/
+template <typename T, size_t K>
+inline Dual<T, K> Dual<T, K>::chain(T value, T derivative) const {
+    Dual<T, K> result;
+    result.value_ = value;
+    for (size_t k = 0; k < K; ++k) {
+        result.tangent_[k] = derivative * tangent_[k];
+    }
+    return result;
+}
+
+template <typename T, size_t K>
+inline Dual<T, K> Dual<T, K>::chain(T value, T derivative, const Dual<T, K> &other, T other_derivative) const {
+    Dual<T, K> result;
+    result.value_ = value;
+    for (size_t k = 0; k < K; ++k) {
+        result.tangent_[k] = derivative * tangent_[k] + other_derivative * other.tangent_[k];
+    }
+    return result;
+}
+
+template <typename T, size_t K>
+std::ostream &operator<<(std::ostream &os, const Dual<T, K> &dual) {
+    os << "Dual(data=" << dual.get_data_value() << ", tangent=";
+    for (size_t k = 0; k < K; ++k) {
+        os << (k ? " " : "") << dual.get_tangent(k);
+    }
+    return os << ")";
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::operator-() const {
+    return chain(-value_, -1.0);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::operator+(const Dual<T, K> &other) const {
+    return chain(value_ + other.value_, 1.0, other, 1.0);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::operator-(const Dual<T, K> &other) const {
+    return chain(value_ - other.value_, 1.0, other, -1.0);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::operator*(const Dual<T, K> &other) const {
+    return chain(value_ * other.value_, other.value_, other, value_);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::operator/(const Dual<T, K> &other) const {
+    T value = value_ / other.value_;
+    return chain(value, T(1.0) / other.value_, other, -value / other.value_);
+}
+
+// As in Variable::pow, the derivative in the exponent needs a positive base.
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::pow(const Dual<T, K> &exponent) const {
+    T value = std::pow(value_, exponent.value_);
+    T log_derivative = value_ > T(0.0) ? value * std::log(value_) : T(0.0);
+    return chain(value, exponent.value_ * std::pow(value_, exponent.value_ - T(1.0)), exponent, log_derivative);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::pow(T exponent) const {
+    return chain(std::pow(value_, exponent), exponent * std::pow(value_, exponent - T(1.0)));
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::square() const {
+    return chain(value_ * value_, T(2.0) * value_);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::ReLU() const {
+    return chain(value_ < T(0.0) ? T(0.0) : value_, T(value_ > T(0.0)));
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::Tanh() const {
+    T value = std::tanh(value_);
+    return chain(value, T(1.0) - value * value);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::Sigmoid() const {
+    T value = T(1.0) / (T(1.0) + std::exp(-value_));
+    return chain(value, value * (T(1.0) - value));
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::exp() const {
+    T value = std::exp(value_);
+    return chain(value, value);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::log() const {
+    return chain(std::log(value_), T(1.0) / value_);
+}
+
+template <typename T, size_t K>
+Dual<T, K> Dual<T, K>::sqrt() const {
+    T value = std::sqrt(value_);
+    return chain(value, T(0.5) / value);
+}
+
+template <typename T, size_t K>
+Dual<T, K> operator+(std::type_identity_t<T> lhs, const Dual<T, K> &rhs) {
+    return Dual<T, K>(lhs) + rhs;
+}
+
+template <typename T, size_t K>
+Dual<T, K> operator-(std::type_identity_t<T> lhs, const Dual<T, K> &rhs) {
+    return Dual<T, K>(lhs) - rhs;
+}
+
+template <typename T, size_t K>
+Dual<T, K> operator*(std::type_identity_t<T> lhs, const Dual<T, K> &rhs) {
+    return Dual<T, K>(lhs) * rhs;
+}
+
+template <typename T, size_t K>
+Dual<T, K> operator/(std::type_identity_t<T> lhs, const Dual<T, K> &rhs) {
+    return Dual<T, K>(lhs) / rhs;
+}
+
+template <typename T, size_t K>
+Dual<T, K> ReLU(const Dual<T, K> &x) {
+    return x.ReLU();
+}
+
+template <typename T, size_t K>
+Dual<T, K> Tanh(const Dual<T, K> &x) {
+    return x.Tanh();
+}
+
+template <typename T, size_t K>
+Dual<T, K> Sigmoid(const Dual<T, K> &x) {
+    return x.Sigmoid();
+}
+
+template <typename T, size_t K>
+Dual<T, K> exp(const Dual<T, K> &x) {
+    return x.exp();
+}
+
+template <typename T, size_t K>
+Dual<T, K> log(const Dual<T, K> &x) {
+    return x.log();
+}
+
+template <typename T, size_t K>
+Dual<T, K> sqrt(const Dual<T, K> &x) {
+    return x.sqrt();
+}
+
+template <typename T, size_t K>
+Dual<T, K> square(const Dual<T, K> &x) {
+    return x.square();
+}
+
+template <typename T, size_t K>
+Dual<T, K> pow(const Dual<T, K> &x, const Dual<T, K> &exponent) {
+    return x.pow(exponent);
+}
+
+template <typename T, size_t K>
+Dual<T, K> pow(const Dual<T, K> &x, std::type_identity_t<T> exponent) {
+    return x.pow(exponent);
+}
+
+template <typename T, typename Function>
+std::pair<std::vector<T>, std::vector<T>> jvp(Function &&function, const std::vector<T> &x, const std::vector<T> &v) {
+    if (x.size() != v.size()) {
+        throw std::invalid_argument("jvp: the direction must have the size of the input");
+    }
+
+    std::vector<Dual<T>> inputs;
+    inputs.reserve(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        inputs.emplace_back(x[i], std::array<T, 1>{v[i]});
+    }
+
+    std::vector<Dual<T>> outputs = function(inputs);
+    std::pair<std::vector<T>, std::vector<T>> result;
+    result.first.reserve(outputs.size());
+    result.second.reserve(outputs.size());
+    for (auto & output : outputs) {
+        result.first.push_back(output.get_data_value());
+        result.second.push_back(output.get_tangent());
+    }
+    return result;
+}
+
+template <typename T, typename Function>
+std::vector<std::vector<T>> jacobian(Function &&function, const std::vector<T> &x, JacobianMode mode) {
+    constexpr size_t LANES = Simd<T>::LANES;
+    const size_t n = x.size();
+
+    if (mode == JacobianMode::Auto) {
+        // The number of outputs is only known after one evaluation; without tangents it is cheap.
+        std::vector<Dual<T, 1>> constants(x.begin(), x.end());
+        size_t m = function(constants).size();
+        size_t forward_passes = (n + LANES - 1) / LANES;
+        mode = forward_passes <= JACOBIAN_REVERSE_PASS_COST * m ? JacobianMode::Forward : JacobianMode::Reverse;
+    }
+
+    std::vector<std::vector<T>> result;
+    if (mode == JacobianMode::Forward) {
+        std::vector<Dual<T, LANES>> inputs(x.begin(), x.end());
+        for (size_t j0 = 0; j0 < n; j0 += LANES) {
+            size_t lanes = std::min(LANES, n - j0);
+            for (size_t k = 0; k < lanes; ++k) {
+                inputs[j0 + k] = Dual<T, LANES>::variable(x[j0 + k], k);
+            }
+
+            std::vector<Dual<T, LANES>> outputs = function(inputs);
+            result.resize(outputs.size(), std::vector<T>(n));
+            for (size_t i = 0; i < outputs.size(); ++i) {
+                for (size_t k = 0; k < lanes; ++k) result[i][j0 + k] = outputs[i].get_tangent(k);
+            }
+
+            for (size_t k = 0; k < lanes; ++k) {
+                inputs[j0 + k] = Dual<T, LANES>(x[j0 + k]);
+            }
+        }
+        return result;
+    }
+
+    std::vector<std::shared_ptr<Variable<T>>> inputs;
+    inputs.reserve(n);
+    for (auto & value : x) {
+        inputs.push_back(std::make_shared<Variable<T>>(value));
+    }
+    std::vector<std::shared_ptr<Variable<T>>> outputs = function(inputs);
+    result.resize(outputs.size(), std::vector<T>(n));
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        for (auto & input : inputs) input->set_grad(0.0);
+        outputs[i]->backward(true);
+        for (size_t j = 0; j < n; ++j) result[i][j] = inputs[j]->get_grad_value();
+    }
+    return result;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "simd.hpp"
+#include <array>
+#include <cmath>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Forward-mode counterpart of Variable.
+ *
+ * A Dual holds a value and K tangents, the derivatives of the value along
+ * K input directions, and every operation updates both with the chain
+ * rule as it goes. No graph is built: evaluating a function on Duals whose
+ * tangents are seeded with a direction v gives the function and J * v in
+ * one pass, and with K lanes K columns of the Jacobian at once. The lane
+ * loops have a fixed length, so the compiler turns them into vector code.
+ *
+ * Duals are plain values. They support the operations of Variable, both
+ * as methods and as the free functions ReLU(x), Tanh(x), Sigmoid(x),
+ * exp(x), log(x), sqrt(x), square(x) and pow(x, y), which also exist for
+ * Variables, so a generic function can be evaluated in either mode (see
+ * jacobian()).
+ *
+ * This file is included by autograd_variable.hpp, whose hvp() runs the
+ * backward rules of a graph on Duals; include that one to use jacobian().
+*/
+
+template <typename T>
+class Variable;
+
+template <typename T = double, size_t K = 1>
+class Dual {
+private:
+    T value_;
+    std::array<T, K> tangent_;
+
+    Dual<T, K> chain(T value, T derivative) const;
+    Dual<T, K> chain(T value, T derivative, const Dual<T, K> &other, T other_derivative) const;
+
+public:
+    Dual(T value = 0.0);
+    Dual(T value, const std::array<T, K> &tangent);
+
+    // An input: tangent 1 in the given lane, 0 elsewhere.
+    static Dual<T, K> variable(T value, size_t lane = 0);
+
+    T get_data_value() const;
+    T get_tangent(size_t lane = 0) const;
+    const std::array<T, K> &get_tangents() const;
+
+    Dual<T, K> operator-() const;
+    Dual<T, K> operator+(const Dual<T, K> &other) const;
+    Dual<T, K> operator-(const Dual<T, K> &other) const;
+    Dual<T, K> operator*(const Dual<T, K> &other) const;
+    Dual<T, K> operator/(const Dual<T, K> &other) const;
+
+    Dual<T, K> pow(const Dual<T, K> &exponent) const;
+    Dual<T, K> pow(T exponent) const;
+    Dual<T, K> square() const;
+
+    Dual<T, K> ReLU() const;
+    Dual<T, K> Tanh() const;
+    Dual<T, K> Sigmoid() const;
+    Dual<T, K> exp() const;
+    Dual<T, K> log() const;
+    Dual<T, K> sqrt() const;
+};
+
+template <typename T, size_t K>
+std::ostream &operator<<(std::ostream &os, const Dual<T, K> &dual);
+
+template <typename T, size_t K>
+Dual<T, K> operator+(std::type_identity_t<T> lhs, const Dual<T, K> &rhs);
+
+template <typename T, size_t K>
+Dual<T, K> operator-(std::type_identity_t<T> lhs, const Dual<T, K> &rhs);
+
+template <typename T, size_t K>
+Dual<T, K> operator*(std::type_identity_t<T> lhs, const Dual<T, K> &rhs);
+
+template <typename T, size_t K>
+Dual<T, K> operator/(std::type_identity_t<T> lhs, const Dual<T, K> &rhs);
+
+template <typename T, size_t K>
+Dual<T, K> ReLU(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> Tanh(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> Sigmoid(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> exp(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> log(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> sqrt(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> square(const Dual<T, K> &x);
+
+template <typename T, size_t K>
+Dual<T, K> pow(const Dual<T, K> &x, const Dual<T, K> &exponent);
+
+template <typename T, size_t K>
+Dual<T, K> pow(const Dual<T, K> &x, std::type_identity_t<T> exponent);
+
+/*
+ * Value and directional derivative J * v of a function at x. The function
+ * takes and returns a std::vector<Dual<T>>.
+*/
+template <typename T, typename Function>
+std::pair<std::vector<T>, std::vector<T>> jvp(Function &&function, const std::vector<T> &x, const std::vector<T> &v);
+
+enum class JacobianMode : uint8_t {Auto, Forward, Reverse};
+
+/*
+ * Jacobian J[i][j] = d output_i / d input_j of a generic function at x:
+ * the function takes a const std::vector<Scalar> & and returns a
+ * std::vector<Scalar>, with Scalar either a Dual or a
+ * std::shared_ptr<Variable<T>>.
+ *
+ * Forward mode evaluates the function once per Simd<T>::LANES inputs,
+ * reverse mode builds the graph once and runs one backward pass per
+ * output. Building the graph dominates for small functions: one reverse
+ * pass costs about as much as JACOBIAN_REVERSE_PASS_COST forward passes
+ * (see autograd_dual_test), so Auto only picks reverse mode when forward
+ * mode would need more passes than that per output.
+*/
+constexpr size_t JACOBIAN_REVERSE_PASS_COST = 32;
+
+template <typename T, typename Function>
+std::vector<std::vector<T>> jacobian(Function &&function, const std::vector<T> &x, JacobianMode mode = JacobianMode::Auto);
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "autograd_tape.cpp"
+#include <type_traits>
+
+/*
+ * Expression templates over Variables.
+ *
+ * expr(x) wraps a Variable, and arithmetic on wrapped Variables, scalars
+ * and other expressions does not create nodes: it builds a value whose
+ * type is the expression tree, e.g. for expr(x) * expr(w) + 1.0
+ *
+ *     ExpressionBinary<T, Add, ExpressionBinary<T, Mul, Leaf, Leaf>, Constant>
+ *
+ * Every subexpression computes its value when it is built. Variable<T>::
+ * from_expression() then turns the whole tree into a single graph node
+ * whose parents are the leaves and whose backward closure is the tree's
+ * backward(), which the compiler inlines into straight-line code.
+ *
+ * The ops and their derivatives are the ones of the tape (tape_forward and
+ * tape_backward); the op code is a template argument, so the switch over
+ * it disappears.
+ *
+ * Leaves hold plain pointers: a shared_ptr would add a reference count
+ * update to every level of the tree, a large part of the time the single
+ * node saves (expression_benchmark). The Variables of an expression must
+ * therefore stay owned elsewhere until from_expression() has taken it: an
+ * expression kept in an auto variable must not be built from temporary
+ * shared_ptrs, and expr() and the operators refuse them.
+*/
+
+template <typename T>
+struct ExpressionLeaf;
+
+template <typename T>
+struct ExpressionConstant;
+
+template <typename T, TapeOp Op, typename Operand>
+struct ExpressionUnary;
+
+template <typename T, TapeOp Op, typename Lhs, typename Rhs>
+struct ExpressionBinary;
+
+template <typename E>
+concept ScalarExpression = requires(const E &expression) {
+    typename E::Value;
+    E::LEAVES;
+    expression.value;
+};
+
+// Operands of mixed arithmetic: expressions, Variables and plain numbers.
+template <typename T, typename E>
+    requires ScalarExpression<E>
+const E &to_expression(const E &expression);
+
+template <typename T>
+ExpressionLeaf<T> to_expression(const std::shared_ptr<Variable<T>> &variable);
+
+// As expr(): a temporary Variable would be freed before the expression is used.
+template <typename T>
+ExpressionLeaf<T> to_expression(const std::shared_ptr<Variable<T>> &&variable) = delete;
+
+template <typename T, typename U>
+    requires std::is_arithmetic_v<U>
+ExpressionConstant<T> to_expression(U value);
+
+/*
+ * Unary operations shared by every expression type, written like the
+ * methods of Variable.
+*/
+template <typename T, typename Derived>
+struct ExpressionOps {
+    ExpressionUnary<T, TapeOp::Neg, Derived> operator-() const {
+        return ExpressionUnary<T, TapeOp::Neg, Derived>(static_cast<const Derived &>(*this));
+    }
+    ExpressionUnary<T, TapeOp::ReLU, Derived> ReLU() const {
+        return ExpressionUnary<T, TapeOp::ReLU, Derived>(static_cast<const Derived &>(*this));
+    }
+    ExpressionUnary<T, TapeOp::Tanh, Derived> Tanh() const {
+        return ExpressionUnary<T, TapeOp::Tanh, Derived>(static_cast<const Derived &>(*this));
+    }
+    ExpressionUnary<T, TapeOp::Sigmoid, Derived> Sigmoid() const {
+        return ExpressionUnary<T, TapeOp::Sigmoid, Derived>(static_cast<const Derived &>(*this));
+    }
+    ExpressionUnary<T, TapeOp::Exp, Derived> exp() const {
+        return ExpressionUnary<T, TapeOp::Exp, Derived>(static_cast<const Derived &>(*this));
+    }
+    template <typename Exponent>
+    auto pow(Exponent &&exponent) const {
+        auto rhs = to_expression<T>(std::forward<Exponent>(exponent));
+        return ExpressionBinary<T, TapeOp::Pow, Derived, decltype(rhs)>(static_cast<const Derived &>(*this), rhs);
+    }
+};
+
+template <typename T>
+struct ExpressionLeaf : ExpressionOps<T, ExpressionLeaf<T>> {
+    typedef T Value;
+    static constexpr size_t LEAVES = 1;
+
+    Variable<T> *variable;
+    T value;
+
+    explicit ExpressionLeaf(const std::shared_ptr<Variable<T>> &variable)
+        : variable(variable.get()), value(variable->get_data_value()) {}
+
+    void collect_leaves(std::vector<std::shared_ptr<Variable<T>>> &leaves) const {
+        leaves.push_back(variable->shared_from_this());
+    }
+
+    template <typename Sink>
+    void backward(T grad, const Sink &sink) const {
+        sink(variable, grad);
+    }
+};
+
+template <typename T>
+struct ExpressionConstant : ExpressionOps<T, ExpressionConstant<T>> {
+    typedef T Value;
+    static constexpr size_t LEAVES = 0;
+
+    T value;
+
+    explicit ExpressionConstant(T value) : value(value) {}
+
+    void collect_leaves(std::vector<std::shared_ptr<Variable<T>>> &) const {}
+
+    template <typename Sink>
+    void backward(T, const Sink &) const {}
+};
+
+template <typename T, TapeOp Op, typename Operand>
+struct ExpressionUnary : ExpressionOps<T, ExpressionUnary<T, Op, Operand>> {
+    typedef T Value;
+    static constexpr size_t LEAVES = Operand::LEAVES;
+
+    Operand operand;
+    T value;
+
+    explicit ExpressionUnary(const Operand &operand)
+        : operand(operand), value(tape_forward(Op, operand.value, T(0.0))) {}
+
+    void collect_leaves(std::vector<std::shared_ptr<Variable<T>>> &leaves) const {
+        operand.collect_leaves(leaves);
+    }
+
+    template <typename Sink>
+    void backward(T grad, const Sink &sink) const {
+        T operand_grad = 0.0, unused = 0.0;
+        tape_backward(Op, value, grad, operand.value, T(0.0), operand_grad, unused);
+        operand.backward(operand_grad, sink);
+    }
+};
+
+template <typename T, TapeOp Op, typename Lhs, typename Rhs>
+struct ExpressionBinary : ExpressionOps<T, ExpressionBinary<T, Op, Lhs, Rhs>> {
+    typedef T Value;
+    static constexpr size_t LEAVES = Lhs::LEAVES + Rhs::LEAVES;
+
+    Lhs lhs;
+    Rhs rhs;
+    T value;
+
+    ExpressionBinary(const Lhs &lhs, const Rhs &rhs)
+        : lhs(lhs), rhs(rhs), value(tape_forward(Op, lhs.value, rhs.value)) {}
+
+    void collect_leaves(std::vector<std::shared_ptr<Variable<T>>> &leaves) const {
+        lhs.collect_leaves(leaves);
+        rhs.collect_leaves(leaves);
+    }
+
+    template <typename Sink>
+    void backward(T grad, const Sink &sink) const {
+        T lhs_grad = 0.0, rhs_grad = 0.0;
+        tape_backward(Op, value, grad, lhs.value, rhs.value, lhs_grad, rhs_grad);
+        lhs.backward(lhs_grad, sink);
+        rhs.backward(rhs_grad, sink);
+    }
+};
+
+template <typename T>
+ExpressionLeaf<T> expr(const std::shared_ptr<Variable<T>> &variable) {
+    return ExpressionLeaf<T>(variable);
+}
+
+// The leaf would outlive the only owner of its Variable.
+template <typename T>
+ExpressionLeaf<T> expr(const std::shared_ptr<Variable<T>> &&) = delete;
+
+template <typename T, typename E>
+    requires ScalarExpression<E>
+const E &to_expression(const E &expression) {
+    return expression;
+}
+
+template <typename T>
+ExpressionLeaf<T> to_expression(const std::shared_ptr<Variable<T>> &variable) {
+    return ExpressionLeaf<T>(variable);
+}
+
+template <typename T, typename U>
+    requires std::is_arithmetic_v<U>
+ExpressionConstant<T> to_expression(U value) {
+    return ExpressionConstant<T>(T(value));
+}
+
+/*
+ * The operands are forwarded, so that a temporary shared_ptr reaches the
+ * deleted overload of to_expression().
+*/
+template <TapeOp Op, typename Lhs, typename Rhs>
+auto expression_binary(Lhs &&lhs, Rhs &&rhs) {
+    typedef std::remove_cvref_t<Lhs> L;
+    typedef std::remove_cvref_t<Rhs> R;
+    typedef typename std::conditional_t<ScalarExpression<L>, L, R>::Value T;
+    auto lhs_expression = to_expression<T>(std::forward<Lhs>(lhs));
+    auto rhs_expression = to_expression<T>(std::forward<Rhs>(rhs));
+    return ExpressionBinary<T, Op, decltype(lhs_expression), decltype(rhs_expression)>(lhs_expression, rhs_expression);
+}
+
+template <typename Lhs, typename Rhs>
+concept ExpressionOperands = ScalarExpression<std::remove_cvref_t<Lhs>> || ScalarExpression<std::remove_cvref_t<Rhs>>;
+
+template <typename Lhs, typename Rhs>
+    requires ExpressionOperands<Lhs, Rhs>
+auto operator+(Lhs &&lhs, Rhs &&rhs) {
+    return expression_binary<TapeOp::Add>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+template <typename Lhs, typename Rhs>
+    requires ExpressionOperands<Lhs, Rhs>
+auto operator-(Lhs &&lhs, Rhs &&rhs) {
+    return expression_binary<TapeOp::Sub>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+template <typename Lhs, typename Rhs>
+    requires ExpressionOperands<Lhs, Rhs>
+auto operator*(Lhs &&lhs, Rhs &&rhs) {
+    return expression_binary<TapeOp::Mul>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+template <typename Lhs, typename Rhs>
+    requires ExpressionOperands<Lhs, Rhs>
+auto operator/(Lhs &&lhs, Rhs &&rhs) {
+    return expression_binary<TapeOp::Div>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "gemm.hpp"
+
+/*
+ * Copies the mc x kc block of op(A) starting at (i0, k0) into MR-row slivers:
+ * sliver s holds rows [s * MR, s * MR + MR) stored column by column, padded
+ * with zeros past the last row.
+*/
+template <typename T, typename TA>
+void gemm_pack_a(bool trans_a, const TA *A, size_t lda, size_t i0, size_t k0,
+                 size_t mc, size_t kc, T *__restrict packed) {
+    constexpr size_t MR = GemmBlocking<T>::MR;
+    for (size_t s = 0; s < mc; s += MR) {
+        size_t rows = std::min(MR, mc - s);
+        for (size_t k = 0; k < kc; ++k) {
+            for (size_t i = 0; i < MR; ++i) {
+                size_t row = i0 + s + i, col = k0 + k;
+                packed[i] = i < rows ? T(trans_a ? A[col * lda + row] : A[row * lda + col]) : T(0.0);
+            }
+            packed += MR;
+        }
+    }
+}
+
+/*
+ * Copies the kc x nc panel of op(B) starting at (k0, j0) into NR-column
+ * slivers stored row by row, padded with zeros past the last column.
+*/
+template <typename T, typename TB>
+void gemm_pack_b(bool trans_b, const TB *B, size_t ldb, size_t k0, size_t j0,
+                 size_t kc, size_t nc, T *__restrict packed) {
+    constexpr size_t NR = GemmBlocking<T>::NR;
+    for (size_t s = 0; s < nc; s += NR) {
+        size_t cols = std::min(NR, nc - s);
+        for (size_t k = 0; k < kc; ++k) {
+            const size_t row = k0 + k;
+            if (!trans_b && cols == NR) {
+                const TB *__restrict src = B + row * ldb + j0 + s;
+                convert_precision(src, packed, NR);
+            } else {
+                for (size_t j = 0; j < NR; ++j) {
+                    size_t col = j0 + s + j;
+                    packed[j] = j < cols ? T(trans_b ? B[col * ldb + row] : B[row * ldb + col]) : T(0.0);
+                }
+            }
+            packed += NR;
+        }
+    }
+}
+
+/*
+ * C[0:m, 0:n] += alpha * (packed A sliver) * (packed B sliver). The MR x NR
+ * accumulator is kept in 2 * MR vector registers; the packed buffers are
+ * aligned, so every B row is two aligned vector loads.
+*/
+template <typename T>
+inline void gemm_micro_kernel(size_t kc, const T *__restrict a, const T *__restrict b,
+                              T *__restrict c, size_t ldc, size_t m, size_t n, T alpha) {
+    constexpr size_t MR = GemmBlocking<T>::MR, NR = GemmBlocking<T>::NR, LANES = GemmBlocking<T>::LANES;
+    typedef T Vector __attribute__((vector_size(GEMM_VECTOR_BYTES)));
+
+    Vector acc[MR][2] = {};
+    for (size_t k = 0; k < kc; ++k) {
+        Vector b0, b1;
+        std::memcpy(&b0, b + k * NR, sizeof(Vector));
+        std::memcpy(&b1, b + k * NR + LANES, sizeof(Vector));
+        for (size_t i = 0; i < MR; ++i) {
+            const T a_ik = a[k * MR + i];
+            acc[i][0] += a_ik * b0;
+            acc[i][1] += a_ik * b1;
+        }
+    }
+
+    T result[MR][NR];
+    std::memcpy(result, acc, sizeof(result));
+    if (m == MR && n == NR) {
+        for (size_t i = 0; i < MR; ++i) {
+            for (size_t j = 0; j < NR; ++j) c[i * ldc + j] += alpha * result[i][j];
+        }
+    } else {
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < n; ++j) c[i * ldc + j] += alpha * result[i][j];
+        }
+    }
+}
+
+template <typename T, typename TA, typename TB>
+void gemm(bool trans_a, bool trans_b, size_t M, size_t N, size_t K,
+          T alpha, const TA *A, size_t lda, const TB *B, size_t ldb,
+          T beta, T *C, size_t ldc, ThreadPool &pool) {
+    constexpr size_t MR = GemmBlocking<T>::MR, NR = GemmBlocking<T>::NR;
+    constexpr size_t MC = GemmBlocking<T>::MC, KC = GemmBlocking<T>::KC, NC = GemmBlocking<T>::NC;
+
+    if (M == 0 || N == 0) return;
+    if (beta != T(1.0)) {
+        for (size_t i = 0; i < M; ++i) {
+            T *__restrict c_row = C + i * ldc;
+            if (beta == T(0.0)) std::fill(c_row, c_row + N, T(0.0));
+            else for (size_t j = 0; j < N; ++j) c_row[j] *= beta;
+        }
+    }
+    if (K == 0 || alpha == T(0.0)) return;
+
+    // Packing does not pay off for tiny products.
+    if (M * N * K <= 32 * 32 * 32) {
+        for (size_t i = 0; i < M; ++i) {
+            T *__restrict c_row = C + i * ldc;
+            for (size_t k = 0; k < K; ++k) {
+                const T a_ik = alpha * T(trans_a ? A[k * lda + i] : A[i * lda + k]);
+                if (!trans_b) {
+                    const TB *__restrict b_row = B + k * ldb;
+                    for (size_t j = 0; j < N; ++j) c_row[j] += a_ik * T(b_row[j]);
+                } else {
+                    for (size_t j = 0; j < N; ++j) c_row[j] += a_ik * T(B[j * ldb + k]);
+                }
+            }
+        }
+        return;
+    }
+
+    // Split N further when there are too few row blocks to keep all threads busy.
+    size_t m_blocks = (M + MC - 1) / MC;
+    size_t nc = std::min(NC, (N + NR - 1) / NR * NR);
+    size_t wanted_tasks = 2 * pool.get_size();
+    if (m_blocks * ((N + nc - 1) / nc) < wanted_tasks) {
+        size_t n_blocks = std::min((wanted_tasks + m_blocks - 1) / m_blocks, (N + NR - 1) / NR);
+        nc = ((N + n_blocks - 1) / n_blocks + NR - 1) / NR * NR;
+    }
+    size_t n_blocks = (N + nc - 1) / nc;
+
+    for (size_t k0 = 0; k0 < K; k0 += KC) {
+        size_t kc = std::min(KC, K - k0);
+
+        pool.parallel_for(m_blocks * n_blocks, [&](size_t task) {
+            thread_local AlignedVector<T> packed_a, packed_b;
+            size_t i0 = (task / n_blocks) * MC, j0 = (task % n_blocks) * nc;
+            size_t mc = std::min(MC, M - i0), ncur = std::min(nc, N - j0);
+
+            packed_a.resize((mc + MR - 1) / MR * MR * kc);
+            packed_b.resize((ncur + NR - 1) / NR * NR * kc);
+            gemm_pack_a<T>(trans_a, A, lda, i0, k0, mc, kc, packed_a.data());
+            gemm_pack_b<T>(trans_b, B, ldb, k0, j0, kc, ncur, packed_b.data());
+
+            for (size_t jr = 0; jr < ncur; jr += NR) {
+                const T *b_sliver = packed_b.data() + jr * kc;
+                for (size_t ir = 0; ir < mc; ir += MR) {
+                    gemm_micro_kernel(kc, packed_a.data() + ir * kc, b_sliver,
+                                      C + (i0 + ir) * ldc + j0 + jr, ldc,
+                                      std::min(MR, mc - ir), std::min(NR, ncur - jr), alpha);
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "aligned_allocator.hpp"
+#include "thread_pool.cpp"
+#include "half.hpp"
+#include <algorithm>
+#include <cstring>
+
+/*
+ * Width of the vectors used by the micro-kernel: 64 bytes when the target
+ * has AVX-512, 32 bytes (AVX2 or two SSE registers) otherwise.
+*/
+
+#if defined(__AVX512F__)
+#define GEMM_VECTOR_BYTES 64
+#else
+#define GEMM_VECTOR_BYTES 32
+#endif
+
+/*
+ * Blocking parameters of the GEMM for a value type.
+ *
+ * MR x NR is the register tile of the micro-kernel (NR spans two vectors),
+ * an MC x KC block of A is packed to stay in L2 and a KC x NC panel of B
+ * is packed to stay in L3.
+*/
+
+template <typename T>
+struct GemmBlocking {
+    static constexpr size_t LANES = GEMM_VECTOR_BYTES / sizeof(T);
+    static constexpr size_t MR = 6, NR = 2 * LANES, KC = 256;
+    static constexpr size_t MC = sizeof(T) == 4 ? 144 : 96;
+    static constexpr size_t NC = 4096;
+};
+
+/*
+ * C = alpha * op(A) * op(B) + beta * C, with op(X) = X or X^T,
+ * for row-major matrices: op(A) is M x K, op(B) is K x N, C is M x N,
+ * and lda, ldb, ldc are the row strides of A, B and C as stored.
+ *
+ * Small products use a direct loop; larger ones are blocked and packed
+ * into MR / NR slivers and the (MC x NC) tiles of C are distributed over
+ * the thread pool.
+ *
+ * A and B may be stored in another type than T, e.g. BFloat16 (see
+ * half.hpp): they are converted to T while they are packed, so the
+ * kernel always computes and accumulates in T and only the memory traffic
+ * for A and B shrinks.
+*/
+
+template <typename T, typename TA = T, typename TB = T>
+void gemm(bool trans_a, bool trans_b, size_t M, size_t N, size_t K,
+          T alpha, const TA *A, size_t lda, const TB *B, size_t ldb,
+          T beta, T *C, size_t ldc, ThreadPool &pool = ThreadPool::global());
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "graph_fusion.hpp"
+
+/*
+ * The use count of a node is the number of its owners: the parent lists
+ * that contain it plus the pointers held outside the graph.
+*/
+template <typename T>
+bool GraphFusion<T>::is_constant(const Pointer &variable) {
+    return variable->op_ == VariableOp::Leaf && variable->parent_variables_.empty() && variable.use_count() == 1;
+}
+
+template <typename T>
+bool GraphFusion<T>::is_constant(const Pointer &variable, T value) {
+    return is_constant(variable) && *variable->data_ == value;
+}
+
+/*
+ * A Checkpoint node is skipped: the segment it recomputes reads leaves,
+ * such as model parameters, that are not among its parents.
+*/
+template <typename T>
+bool GraphFusion<T>::fold_constant(Variable<T> *variable) {
+    if (variable->op_ == VariableOp::Checkpoint) return false;
+    for (auto & parent : variable->parent_variables_) {
+        if (!is_constant(parent)) return false;
+    }
+    variable->op_ = VariableOp::Leaf;
+    variable->backward_ = nullptr;
+    variable->parent_variables_.clear();
+    return true;
+}
+
+template <typename T>
+bool GraphFusion<T>::make_neg(Variable<T> *variable) {
+    if (variable->op_ != VariableOp::Mul) return false;
+
+    auto & parents = variable->parent_variables_;
+    size_t k = is_constant(parents[1], -1.0) ? 0 : is_constant(parents[0], -1.0) ? 1 : 2;
+    if (k == 2) return false;
+
+    Pointer operand = parents[k];
+    variable->op_ = VariableOp::Neg;
+    variable->backward_ = [operand = operand.get(), out = variable]() {
+        operand->accumulate_grad(-*out->grad_);
+    };
+    parents = {std::move(operand)};
+    return true;
+}
+
+template <typename T>
+bool GraphFusion<T>::make_sub(Variable<T> *variable) {
+    if (variable->op_ != VariableOp::Add) return false;
+
+    auto & parents = variable->parent_variables_;
+    auto negated = [](const Pointer &parent) {
+        return parent->op_ == VariableOp::Neg && parent.use_count() == 1;
+    };
+    size_t k = negated(parents[1]) ? 0 : negated(parents[0]) ? 1 : 2;
+    if (k == 2) return false;
+
+    Pointer lhs = parents[k], rhs = parents[1 - k]->parent_variables_[0];
+    variable->op_ = VariableOp::Sub;
+    variable->backward_ = [lhs = lhs.get(), rhs = rhs.get(), out = variable]() {
+        lhs->accumulate_grad(*out->grad_);
+        rhs->accumulate_grad(-*out->grad_);
+    };
+    parents = {std::move(lhs), std::move(rhs)};
+    return true;
+}
+
+template <typename T>
+bool GraphFusion<T>::make_div(Variable<T> *variable) {
+    if (variable->op_ != VariableOp::Mul) return false;
+
+    auto & parents = variable->parent_variables_;
+    auto reciprocal = [](const Pointer &parent) {
+        return parent->op_ == VariableOp::Pow && parent.use_count() == 1 &&
+               is_constant(parent->parent_variables_[1], -1.0);
+    };
+    size_t k = reciprocal(parents[1]) ? 0 : reciprocal(parents[0]) ? 1 : 2;
+    if (k == 2) return false;
+
+    Pointer lhs = parents[k], rhs = parents[1 - k]->parent_variables_[0];
+    variable->op_ = VariableOp::Div;
+    variable->backward_ = [lhs = lhs.get(), rhs = rhs.get(), out = variable]() {
+        lhs->accumulate_grad(*out->grad_ / *rhs->data_);
+        rhs->accumulate_grad(-*out->data_ * *out->grad_ / *rhs->data_);
+    };
+    parents = {std::move(lhs), std::move(rhs)};
+    return true;
+}
+
+/*
+ * Flattens the additions under an Add node, descending only into nodes
+ * that are used once, and returns the number of absorbed nodes. Terms come
+ * out in the order they were added.
+*/
+template <typename T>
+size_t GraphFusion<T>::collect_terms(Variable<T> *variable, Terms &terms) {
+    thread_local std::vector<const Pointer *> stack;
+
+    size_t absorbed = 0;
+    stack.clear();
+    for (size_t k = variable->parent_variables_.size(); k-- > 0;) {
+        stack.push_back(&variable->parent_variables_[k]);
+    }
+
+    while (!stack.empty()) {
+        const Pointer &term = *stack.back();
+        stack.pop_back();
+
+        if (term->op_ == VariableOp::Add && term.use_count() == 1) {
+            auto & parents = term->parent_variables_;
+            stack.push_back(&parents[1]);
+            stack.push_back(&parents[0]);
+            ++absorbed;
+        } else if (term->op_ == VariableOp::Mul && term.use_count() == 1) {
+            auto & parents = term->parent_variables_;
+            if (!is_constant(parents[0]) || !is_constant(parents[1])) {
+                terms.products.push_back(parents[0]);
+                terms.products.push_back(parents[1]);
+            }
+            ++absorbed;
+        } else if (is_constant(term)) {
+            ++absorbed;
+        } else {
+            terms.addends.push_back(term);
+        }
+    }
+    return absorbed;
+}
+
+/*
+ * Turns a node into out = activation(sum of products + sum of addends +
+ * constants). The value of the node is already computed and does not change.
+*/
+template <typename T>
+void GraphFusion<T>::make_dot(Variable<T> *variable, Terms terms, VariableOp activation) {
+    std::vector<Variable<T> *> products, addends;
+    products.reserve(terms.products.size());
+    addends.reserve(terms.addends.size());
+    for (auto & term : terms.products) products.push_back(term.get());
+    for (auto & term : terms.addends) addends.push_back(term.get());
+
+    variable->op_ = activation == VariableOp::Dot ? VariableOp::Dot : VariableOp::DotActivation;
+    variable->backward_ = [products = std::move(products), addends = std::move(addends), activation, out = variable]() {
+        T grad = *out->grad_;
+        switch (activation) {
+            case VariableOp::ReLU:
+                grad *= T(*out->data_ > T(0.0));
+                break;
+            case VariableOp::Tanh:
+                grad *= T(1.0) - *out->data_ * *out->data_;
+                break;
+            case VariableOp::Sigmoid:
+                grad *= *out->data_ * (T(1.0) - *out->data_);
+                break;
+            default:
+                break;
+        }
+        for (size_t k = 0; k < products.size(); k += 2) {
+            products[k]->accumulate_grad(*products[k + 1]->data_ * grad);
+            products[k + 1]->accumulate_grad(*products[k]->data_ * grad);
+        }
+        for (auto addend : addends) {
+            addend->accumulate_grad(grad);
+        }
+    };
+
+    // Releases the absorbed nodes.
+    terms.products.insert(terms.products.end(), terms.addends.begin(), terms.addends.end());
+    variable->parent_variables_ = std::move(terms.products);
+}
+
+/*
+ * Nodes are visited parents first, so the operands of a node are already
+ * rewritten when the node is. A sum feeding another addition is left for
+ * the outermost one, and a sum feeding an activation is handed over to it,
+ * so every chain is collected exactly once.
+*/
+template <typename T>
+typename GraphFusion<T>::Stats GraphFusion<T>::run(const std::shared_ptr<Variable<T>> &root) {
+    std::vector<Variable<T> *> order;
+    root->build_topological_order(order);
+    const size_t n = order.size();
+    Stats stats{n, 0};
+
+    for (size_t i = 0; i < n; ++i) {
+        order[i]->order_index_ = i;
+    }
+    // The root has no consumer and counts as used more than once.
+    std::vector<VariableOp> consumer_op(n, VariableOp::Leaf);
+    std::vector<size_t> uses(n, 2);
+    for (size_t i = 0; i < n; ++i) {
+        for (auto & parent : order[i]->parent_variables_) {
+            consumer_op[parent->order_index_] = order[i]->op_;
+            uses[parent->order_index_] = parent.use_count();
+        }
+    }
+    auto is_activation = [](VariableOp op) {
+        return op == VariableOp::ReLU || op == VariableOp::Tanh || op == VariableOp::Sigmoid;
+    };
+
+    std::unordered_map<Variable<T> *, Terms> handed_over;
+    for (size_t i = 0; i < n; ++i) {
+        Variable<T> *variable = order[i];
+        if (variable->op_ == VariableOp::Leaf) continue;
+        if (uses[i] == 1 && fold_constant(variable)) continue;
+        if (make_neg(variable) || make_sub(variable) || make_div(variable)) continue;
+
+        bool single_use = uses[i] == 1;
+        if (variable->op_ == VariableOp::Add) {
+            if (single_use && consumer_op[i] == VariableOp::Add) continue;
+
+            Terms terms;
+            size_t absorbed = collect_terms(variable, terms);
+            if (single_use && is_activation(consumer_op[i])) {
+                handed_over.emplace(variable, std::move(terms));
+            } else if (absorbed > 0) {
+                make_dot(variable, std::move(terms), VariableOp::Dot);
+            }
+        } else if (is_activation(variable->op_)) {
+            auto it = handed_over.find(variable->parent_variables_[0].get());
+            if (it == handed_over.end()) continue;
+            Terms terms = std::move(it->second);
+            handed_over.erase(it);
+            make_dot(variable, std::move(terms), variable->op_);
+        }
+    }
+
+    // Fused nodes may be shared with other retained graphs, whose cached orders are now stale.
+    Variable<T>::release_generation_.fetch_add(1, std::memory_order_acq_rel);
+    root->topological_order_.clear();
+    root->build_topological_order(order);
+    stats.nodes_after = order.size();
+    return stats;
+}
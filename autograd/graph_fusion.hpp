@@ -0,0 +1,55 @@
+#pragma once
+
+#include "autograd_variable.cpp"
+#include <unordered_map>
+
+/*
+ * Optimization pass over a Variable graph that has been built but not yet
+ * differentiated.
+ *
+ * run(root) rewrites the graph rooted at root in place:
+ *  - a node whose parents are all constants becomes a constant leaf,
+ *    unless it is a Checkpoint node;
+ *  - x * (-1) becomes Neg(x), a + Neg(b) becomes Sub(a, b) and
+ *    a * b^(-1) becomes Div(a, b);
+ *  - a tree of additions over products, constants and other terms becomes
+ *    a single Dot node, e.g. the sum = sum + x[i] * w[i] chain of a neuron;
+ *  - ReLU, Tanh or Sigmoid of such a sum is folded into it (DotActivation).
+ * Every fused node gets a hand-written backward closure.
+ *
+ * A constant is a leaf that only the graph refers to: no one else can read
+ * its gradient. For the same reason an intermediate node is only absorbed
+ * into its consumer when that consumer holds the only reference to it, so
+ * every node the caller still points to keeps its value and gradient.
+*/
+
+template <typename T = double>
+class GraphFusion {
+public:
+    struct Stats {
+        size_t nodes_before;
+        size_t nodes_after;
+    };
+
+    static Stats run(const std::shared_ptr<Variable<T>> &root);
+
+private:
+    typedef std::shared_ptr<Variable<T>> Pointer;
+
+    // Operands of a fused sum: products are stored as consecutive pairs.
+    // Constant terms only contribute to the value, which is already known.
+    struct Terms {
+        std::vector<Pointer> products;
+        std::vector<Pointer> addends;
+    };
+
+    static bool is_constant(const Pointer &variable);
+    static bool is_constant(const Pointer &variable, T value);
+
+    static bool fold_constant(Variable<T> *variable);
+    static bool make_neg(Variable<T> *variable);
+    static bool make_sub(Variable<T> *variable);
+    static bool make_div(Variable<T> *variable);
+    static size_t collect_terms(Variable<T> *variable, Terms &terms);
+    static void make_dot(Variable<T> *variable, Terms terms, VariableOp activation);
+};
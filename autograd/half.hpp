@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/*
+ * 16-bit floating point storage formats, emulated in software: arithmetic
+ * is done in float, and a value is rounded to nearest even when it is
+ * stored.
+ *
+ * BFloat16 is the upper half of a float: the same 8-bit exponent and range,
+ * 7 mantissa bits (about 3 significant digits). Float16 is IEEE half
+ * precision: 10 mantissa bits, but normal values only from 6.1e-5 to
+ * 65504, so small gradients flush to zero and large ones overflow unless
+ * the loss is scaled. The conversions use F16C instructions when the
+ * target has them.
+*/
+
+struct BFloat16 {
+    uint16_t bits;
+
+    BFloat16() = default;
+    BFloat16(float value) {
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        if ((f & 0x7FFFFFFF) > 0x7F800000) {
+            bits = static_cast<uint16_t>((f >> 16) | 0x40);  // quiet NaN
+        } else {
+            bits = static_cast<uint16_t>((f + 0x7FFF + ((f >> 16) & 1)) >> 16);
+        }
+    }
+
+    operator float() const {
+        uint32_t f = static_cast<uint32_t>(bits) << 16;
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+    }
+};
+
+struct Float16 {
+    uint16_t bits;
+
+    Float16() = default;
+    Float16(float value) {
+#if defined(__F16C__)
+        bits = static_cast<uint16_t>(_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT));
+#else
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        uint32_t sign = (f >> 16) & 0x8000;
+        f &= 0x7FFFFFFF;
+        if (f >= 0x7F800000) {
+            bits = static_cast<uint16_t>(sign | 0x7C00 | (f > 0x7F800000 ? 0x200 : 0));
+        } else if (f >= 0x477FF000) {
+            bits = static_cast<uint16_t>(sign | 0x7C00);  // rounds past 65504
+        } else if (f < 0x38800000) {
+            // Subnormal: adding 0.5, whose ulp is 2^-24, rounds to a multiple of the half ulp.
+            float magnitude;
+            std::memcpy(&magnitude, &f, sizeof(magnitude));
+            magnitude += 0.5f;
+            std::memcpy(&f, &magnitude, sizeof(f));
+            bits = static_cast<uint16_t>(sign | (f - 0x3F000000));
+        } else {
+            // Rebias the exponent from 127 to 15 and round the 13 dropped bits.
+            f += 0xC8000FFF + ((f >> 13) & 1);
+            bits = static_cast<uint16_t>(sign | (f >> 13));
+        }
+#endif
+    }
+
+    operator float() const {
+#if defined(__F16C__)
+        return _cvtsh_ss(bits);
+#else
+        uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+        uint32_t exponent = (bits >> 10) & 0x1F, mantissa = bits & 0x3FF;
+        if (exponent == 0) {
+            float value = static_cast<float>(mantissa) * 5.9604645e-8f;  // 2^-24
+            return sign ? -value : value;
+        }
+        uint32_t f = sign | (exponent == 31 ? 0x7F800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+#endif
+    }
+};
+
+/*
+ * dst[i] = src[i] for i in [0, n), between any two of double, float,
+ * BFloat16 and Float16, through float.
+*/
+template <typename From, typename To>
+inline void convert_precision(const From *__restrict src, To *__restrict dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = static_cast<To>(static_cast<float>(src[i]));
+    }
+}
+
+#if defined(__F16C__)
+// Eight values per instruction; the scalar _cvtsh_ss costs as much per value.
+inline void convert_precision(const Float16 *__restrict src, float *__restrict dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(half));
+    }
+    for (; i < n; ++i) {
+        dst[i] = static_cast<float>(src[i]);
+    }
+}
+#endif
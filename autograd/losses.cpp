@@ -0,0 +1,190 @@
+#pragma once
+
+#include "losses.hpp"
+#include <algorithm>
+
+template <typename T>
+typename VectorNode<T>::Pointer VectorNode<T>::reduce(T value, const std::vector<Pointer> &inputs, std::vector<T> local_grads) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Loss);
+    if (!NoGrad::grad_enabled()) return std::make_shared<Variable<T>>(value);
+
+    auto result = std::make_shared<Variable<T>>(value, inputs);
+    result->op_ = VariableOp::Loss;
+    result->backward_ = [local_grads = std::move(local_grads), out = result.get()]() {
+        const T grad = *out->grad_;
+        for (size_t i = 0; i < local_grads.size(); ++i) {
+            out->parent_variables_[i]->accumulate_grad(grad * local_grads[i]);
+        }
+    };
+
+    return result;
+}
+
+template <typename T>
+std::vector<typename VectorNode<T>::Pointer> VectorNode<T>::softmax(const std::vector<Pointer> &inputs) {
+    AUTOGRAD_PROFILE_OP(VariableOp::Softmax);
+    if (inputs.empty()) {
+        throw std::invalid_argument("softmax: no inputs");
+    }
+
+    const size_t n = inputs.size();
+    auto values = std::make_shared<std::vector<T>>(n);
+    T max = *inputs[0]->data_, sum = T(0.0);
+    for (auto & input : inputs) max = std::max(max, *input->data_);
+    for (size_t i = 0; i < n; ++i) {
+        (*values)[i] = std::exp(*inputs[i]->data_ - max);
+        sum += (*values)[i];
+    }
+    for (auto & value : *values) value /= sum;
+
+    std::vector<Pointer> outputs;
+    outputs.reserve(n);
+    if (!NoGrad::grad_enabled()) {
+        for (auto & value : *values) outputs.push_back(std::make_shared<Variable<T>>(value));
+        return outputs;
+    }
+
+    // As in Checkpoint, the outputs store their gradients and the node, their parent, runs after all of them
+    // and resets them for the next backward pass, which may not reach every output.
+    auto node = std::make_shared<Variable<T>>(0.0, inputs);
+    node->op_ = VariableOp::Softmax;
+    auto output_grads = std::make_shared<std::vector<T>>(n, T(0.0));
+    node->backward_ = [values, output_grads, out = node.get()]() {
+        const std::vector<T> &y = *values;
+        std::vector<T> &g = *output_grads;
+        T dot = T(0.0);
+        for (size_t i = 0; i < y.size(); ++i) dot += g[i] * y[i];
+        for (size_t i = 0; i < y.size(); ++i) {
+            out->parent_variables_[i]->accumulate_grad(y[i] * (g[i] - dot));
+        }
+        std::fill(g.begin(), g.end(), T(0.0));
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        auto output = std::make_shared<Variable<T>>((*values)[i], std::vector<Pointer>{node});
+        output->op_ = VariableOp::Softmax;
+        output->backward_ = [output_grads, i, out = output.get()]() {
+            (*output_grads)[i] = *out->grad_;
+        };
+        outputs.push_back(std::move(output));
+    }
+    return outputs;
+}
+
+template <typename T>
+std::vector<std::shared_ptr<Variable<T>>> softmax(const std::vector<std::shared_ptr<Variable<T>>> &logits) {
+    return VectorNode<T>::softmax(logits);
+}
+
+/*
+ * Values of the outputs, after checking them against the targets.
+*/
+template <typename T>
+std::vector<T> loss_inputs(const char *loss, const std::vector<std::shared_ptr<Variable<T>>> &outputs, size_t n_targets) {
+    if (outputs.empty() || outputs.size() != n_targets) {
+        throw std::invalid_argument(std::string(loss) + ": expected as many targets as outputs, and at least one");
+    }
+    std::vector<T> values(outputs.size());
+    for (size_t i = 0; i < outputs.size(); ++i) values[i] = outputs[i]->get_data_value();
+    return values;
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> mse_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets) {
+    std::vector<T> grads = loss_inputs("mse_loss", outputs, targets.size());
+    const T scale = T(1.0) / T(grads.size());
+    T loss = T(0.0);
+    for (size_t i = 0; i < grads.size(); ++i) {
+        T error = grads[i] - targets[i];
+        loss += error * error;
+        grads[i] = T(2.0) * scale * error;
+    }
+    return VectorNode<T>::reduce(loss * scale, outputs, std::move(grads));
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> l1_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets) {
+    std::vector<T> grads = loss_inputs("l1_loss", outputs, targets.size());
+    const T scale = T(1.0) / T(grads.size());
+    T loss = T(0.0);
+    for (size_t i = 0; i < grads.size(); ++i) {
+        T error = grads[i] - targets[i];
+        loss += std::abs(error);
+        grads[i] = scale * T((error > T(0.0)) - (error < T(0.0)));
+    }
+    return VectorNode<T>::reduce(loss * scale, outputs, std::move(grads));
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> huber_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets,
+                                        std::type_identity_t<T> delta) {
+    if (!(delta > T(0.0))) {
+        throw std::invalid_argument("huber_loss: delta must be positive");
+    }
+    std::vector<T> grads = loss_inputs("huber_loss", outputs, targets.size());
+    const T scale = T(1.0) / T(grads.size());
+    T loss = T(0.0);
+    for (size_t i = 0; i < grads.size(); ++i) {
+        T error = grads[i] - targets[i];
+        bool quadratic = std::abs(error) <= delta;
+        loss += quadratic ? T(0.5) * error * error : delta * (std::abs(error) - T(0.5) * delta);
+        grads[i] = scale * std::clamp(error, -delta, delta);
+    }
+    return VectorNode<T>::reduce(loss * scale, outputs, std::move(grads));
+}
+
+/*
+ * Turns the logits into softmax(logits) in place and returns logsumexp(logits).
+*/
+template <typename T>
+T softmax_in_place(std::vector<T> &logits) {
+    T max = *std::max_element(logits.begin(), logits.end()), sum = T(0.0);
+    for (auto & value : logits) {
+        value = std::exp(value - max);
+        sum += value;
+    }
+    for (auto & value : logits) value /= sum;
+    return max + std::log(sum);
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> cross_entropy_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits, size_t target) {
+    if (target >= logits.size()) {
+        throw std::invalid_argument("cross_entropy_loss: target class out of range");
+    }
+    std::vector<T> grads = loss_inputs("cross_entropy_loss", logits, logits.size());
+    T loss = -grads[target];
+    loss += softmax_in_place(grads);
+    grads[target] -= T(1.0);
+    return VectorNode<T>::reduce(loss, logits, std::move(grads));
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> cross_entropy_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits,
+                                                const std::vector<T> &probabilities) {
+    std::vector<T> grads = loss_inputs("cross_entropy_loss", logits, probabilities.size());
+    T loss = T(0.0), total = T(0.0);
+    for (size_t i = 0; i < grads.size(); ++i) {
+        loss -= probabilities[i] * grads[i];
+        total += probabilities[i];
+    }
+    loss += total * softmax_in_place(grads);
+    for (size_t i = 0; i < grads.size(); ++i) grads[i] = total * grads[i] - probabilities[i];
+    return VectorNode<T>::reduce(loss, logits, std::move(grads));
+}
+
+template <typename T>
+std::shared_ptr<Variable<T>> bce_with_logits_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits,
+                                                  const std::vector<T> &targets) {
+    std::vector<T> grads = loss_inputs("bce_with_logits_loss", logits, targets.size());
+    const T scale = T(1.0) / T(grads.size());
+    T loss = T(0.0);
+    for (size_t i = 0; i < grads.size(); ++i) {
+        T x = grads[i], e = std::exp(-std::abs(x));
+        loss += std::max(x, T(0.0)) - x * targets[i] + std::log1p(e);
+        // sigmoid(x) from exp(-|x|), which cannot overflow.
+        T sigmoid = x >= T(0.0) ? T(1.0) / (T(1.0) + e) : e / (T(1.0) + e);
+        grads[i] = scale * (sigmoid - targets[i]);
+    }
+    return VectorNode<T>::reduce(loss * scale, logits, std::move(grads));
+}
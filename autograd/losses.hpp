@@ -0,0 +1,73 @@
+#pragma once
+
+#include "autograd_variable.cpp"
+
+/*
+ * Nodes over a whole vector of Variables, and the losses built from them.
+ *
+ * A loss is a single node whose parents are the outputs it reads. Its
+ * gradient with respect to every output has a closed form, which is
+ * computed with the value in one pass over plain arrays; the backward
+ * closure only scales it by the incoming gradient. Composing the same
+ * loss from scalar ops takes several nodes per output, and the
+ * exponentials of a softmax or a sigmoid overflow for large logits,
+ * where the fused forms below use log-sum-exp and log1p(exp(-|x|)).
+ *
+ * softmax() returns one Variable per input, the children of a single
+ * Softmax node like the outputs of a Checkpoint: the node gets the
+ * gradients of all of them and applies the softmax Jacobian in one pass.
+ *
+ * Softmax and Loss nodes have no rule for grad() and hvp(). The vectors
+ * must not be empty and the targets must match the outputs in size, or
+ * std::invalid_argument is thrown.
+*/
+
+template <typename T = double>
+class VectorNode {
+public:
+    typedef std::shared_ptr<Variable<T>> Pointer;
+
+    // A node of the given value whose gradient with respect to inputs[i] is local_grads[i].
+    static Pointer reduce(T value, const std::vector<Pointer> &inputs, std::vector<T> local_grads);
+
+    // exp(x[i] - max) / sum_j exp(x[j] - max).
+    static std::vector<Pointer> softmax(const std::vector<Pointer> &inputs);
+};
+
+template <typename T = double>
+std::vector<std::shared_ptr<Variable<T>>> softmax(const std::vector<std::shared_ptr<Variable<T>>> &logits);
+
+// mean((output - target)^2).
+template <typename T = double>
+std::shared_ptr<Variable<T>> mse_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets);
+
+// mean(|output - target|).
+template <typename T = double>
+std::shared_ptr<Variable<T>> l1_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets);
+
+// Quadratic below delta, linear above: mean of r^2 / 2 or delta * (|r| - delta / 2), r = output - target.
+template <typename T = double>
+std::shared_ptr<Variable<T>> huber_loss(const std::vector<std::shared_ptr<Variable<T>>> &outputs, const std::vector<T> &targets,
+                                        std::type_identity_t<T> delta = 1.0);
+
+/*
+ * -log(softmax(logits)[target]) for one sample of a class, computed as
+ * logsumexp(logits) - logits[target]; the gradient is softmax(logits)
+ * minus the one-hot target. The second form takes a probability for
+ * every class instead.
+*/
+template <typename T = double>
+std::shared_ptr<Variable<T>> cross_entropy_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits, size_t target);
+
+template <typename T = double>
+std::shared_ptr<Variable<T>> cross_entropy_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits,
+                                                const std::vector<T> &probabilities);
+
+/*
+ * Binary cross-entropy of sigmoid(logits) and targets in [0, 1], as
+ * mean(max(x, 0) - x * t + log1p(exp(-|x|))); the gradient is
+ * (sigmoid(x) - t) / n.
+*/
+template <typename T = double>
+std::shared_ptr<Variable<T>> bce_with_logits_loss(const std::vector<std::shared_ptr<Variable<T>>> &logits,
+                                                  const std::vector<T> &targets);
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+
+static_assert(Profiler::OP_COUNT == static_cast<size_t>(VariableOp::Loss) + 1,
+              "Profiler::OP_COUNT must cover every VariableOp");
+
+#ifdef AUTOGRAD_PROFILE
+// Out of line, as in the allocation tests, so that the compiler does not pair it with a free().
+__attribute__((noinline)) void *operator new(size_t size) {
+    Profiler::allocated_bytes_ += size;
+    void *pointer = std::malloc(size ? size : 1);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+__attribute__((noinline)) void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+// Over-aligned types and AlignedAllocator, so Tensor storage too.
+__attribute__((noinline)) void *operator new(size_t size, std::align_val_t alignment) {
+    Profiler::allocated_bytes_ += size;
+    size_t align = static_cast<size_t>(alignment);
+    void *pointer = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+#endif
+
+inline Profiler::Profiler() {
+    origin_ = std::chrono::steady_clock::now();
+}
+
+inline Profiler &Profiler::global() {
+    static Profiler profiler;
+    return profiler;
+}
+
+inline uint32_t Profiler::thread_index() {
+    thread_local uint32_t index = thread_counter_.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+inline const char *Profiler::op_name(VariableOp op) {
+    switch (op) {
+        case VariableOp::Leaf: return "leaf";
+        case VariableOp::Add: return "+";
+        case VariableOp::Sub: return "-";
+        case VariableOp::Mul: return "*";
+        case VariableOp::Div: return "/";
+        case VariableOp::Neg: return "neg";
+        case VariableOp::Pow: return "pow";
+        case VariableOp::Square: return "square";
+        case VariableOp::AddScalar: return "+ scalar";
+        case VariableOp::MulScalar: return "* scalar";
+        case VariableOp::DivScalar: return "/ scalar";
+        case VariableOp::PowScalar: return "pow scalar";
+        case VariableOp::ScalarSub: return "scalar -";
+        case VariableOp::ScalarDiv: return "scalar /";
+        case VariableOp::ReLU: return "ReLU";
+        case VariableOp::Tanh: return "Tanh";
+        case VariableOp::Sigmoid: return "Sigmoid";
+        case VariableOp::Exp: return "exp";
+        case VariableOp::Log: return "log";
+        case VariableOp::Sqrt: return "sqrt";
+        case VariableOp::Dot: return "dot";
+        case VariableOp::DotActivation: return "dot + activation";
+        case VariableOp::Expression: return "expression";
+        case VariableOp::Checkpoint: return "checkpoint";
+        case VariableOp::Softmax: return "softmax";
+        case VariableOp::Loss: return "loss";
+    }
+    return "?";
+}
+
+inline uint64_t Profiler::now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin_).count());
+}
+
+inline uint64_t Profiler::allocated_bytes() {
+    return allocated_bytes_;
+}
+
+inline void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto & counters : ops_) {
+        counters.nodes = 0;
+        counters.forward_ns = 0;
+        counters.bytes = 0;
+        counters.backward_calls = 0;
+        counters.backward_ns = 0;
+    }
+    graphs_.clear();
+    events_.clear();
+    origin_ = std::chrono::steady_clock::now();
+}
+
+inline void Profiler::record_op(VariableOp op, uint64_t nanoseconds, uint64_t bytes) {
+    Counters &counters = ops_[static_cast<size_t>(op)];
+    counters.nodes.fetch_add(1, std::memory_order_relaxed);
+    counters.forward_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void Profiler::record_backward(VariableOp op, uint64_t nanoseconds) {
+    Counters &counters = ops_[static_cast<size_t>(op)];
+    counters.backward_calls.fetch_add(1, std::memory_order_relaxed);
+    counters.backward_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+inline void Profiler::record_graph(size_t nodes, size_t depth) {
+    if (ProfileScope *scope = ProfileScope::current_) {
+        scope->args_.emplace_back("nodes", static_cast<double>(nodes));
+        scope->args_.emplace_back("depth", static_cast<double>(depth));
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    graphs_.push_back({nodes, depth});
+}
+
+inline OpProfile Profiler::get_op(VariableOp op) const {
+    const Counters &counters = ops_[static_cast<size_t>(op)];
+    return {counters.nodes.load(std::memory_order_relaxed), counters.forward_ns.load(std::memory_order_relaxed),
+            counters.bytes.load(std::memory_order_relaxed), counters.backward_calls.load(std::memory_order_relaxed),
+            counters.backward_ns.load(std::memory_order_relaxed)};
+}
+
+inline std::vector<GraphProfile> Profiler::get_graphs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return graphs_;
+}
+
+inline void Profiler::report(std::ostream &os) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-16s %10s %12s %12s %12s %12s\n", "op", "nodes", "forward ns",
+                  "bytes/node", "backward", "backward ns");
+    os << line;
+    for (size_t k = 0; k < OP_COUNT; ++k) {
+        OpProfile op = get_op(static_cast<VariableOp>(k));
+        if (!op.nodes && !op.backward_calls) continue;
+        auto per = [](uint64_t total, uint64_t count) { return count ? double(total) / double(count) : 0.0; };
+        std::snprintf(line, sizeof(line), "%-16s %10llu %12.1f %12.1f %12llu %12.1f\n",
+                      op_name(static_cast<VariableOp>(k)), static_cast<unsigned long long>(op.nodes),
+                      per(op.forward_ns, op.nodes), per(op.bytes, op.nodes),
+                      static_cast<unsigned long long>(op.backward_calls), per(op.backward_ns, op.backward_calls));
+        os << line;
+    }
+
+    std::vector<GraphProfile> graphs = get_graphs();
+    if (graphs.empty()) return;
+    size_t nodes = 0, depth = 0;
+    for (auto & graph : graphs) {
+        nodes = std::max(nodes, graph.nodes);
+        depth = std::max(depth, graph.depth);
+    }
+    std::snprintf(line, sizeof(line), "%zu backward passes, up to %zu nodes and %zu deep\n", graphs.size(), nodes, depth);
+    os << line;
+}
+
+inline void Profiler::write_chrome_trace(const std::string &path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Profiler: cannot open " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    char number[64];
+    auto microseconds = [&](uint64_t nanoseconds) {
+        std::snprintf(number, sizeof(number), "%.3f", double(nanoseconds) / 1000.0);
+        return std::string(number);
+    };
+
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const Event &event = events_[i];
+        file << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+             << event.thread << ",\"ts\":" << microseconds(event.start_ns) << ",\"dur\":"
+             << microseconds(event.duration_ns) << ",\"args\":{";
+        for (size_t k = 0; k < event.args.size(); ++k) {
+            std::snprintf(number, sizeof(number), "%.17g", event.args[k].second);
+            file << (k ? "," : "") << "\"" << event.args[k].first << "\":" << number;
+        }
+        file << "}}";
+    }
+    file << "\n]}\n";
+
+    if (!file.flush()) {
+        throw std::runtime_error("Profiler: cannot write " + path);
+    }
+}
+
+inline ProfileScope::ProfileScope(const char *name) {
+    name_ = name;
+    outer_ = current_;
+    current_ = this;
+    start_bytes_ = Profiler::allocated_bytes_;
+    start_ns_ = Profiler::global().now();
+}
+
+inline ProfileScope::~ProfileScope() {
+    Profiler &profiler = Profiler::global();
+    uint64_t end_ns = profiler.now();
+    current_ = outer_;
+    args_.emplace_back("bytes", static_cast<double>(Profiler::allocated_bytes_ - start_bytes_));
+
+    uint32_t thread = Profiler::thread_index();
+    std::lock_guard<std::mutex> lock(profiler.mutex_);
+    profiler.events_.push_back({name_, start_ns_, end_ns - start_ns_, thread, std::move(args_)});
+}
+
+inline ProfileOpScope::ProfileOpScope(VariableOp op, bool backward) {
+    op_ = op;
+    backward_ = backward;
+    start_bytes_ = Profiler::allocated_bytes_;
+    start_ns_ = Profiler::global().now();
+}
+
+inline ProfileOpScope::~ProfileOpScope() {
+    Profiler &profiler = Profiler::global();
+    uint64_t nanoseconds = profiler.now() - start_ns_;
+    if (backward_) profiler.record_backward(op_, nanoseconds);
+    else profiler.record_op(op_, nanoseconds, Profiler::allocated_bytes_ - start_bytes_);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Opt-in instrumentation of the engine, compiled in with -DAUTOGRAD_PROFILE.
+ * Without it the AUTOGRAD_PROFILE_* macros expand to nothing and the
+ * engine is the same code as before; the Profiler then has nothing to
+ * report.
+ *
+ * With it, Profiler::global() collects:
+ *   - for every VariableOp, the number of nodes built, the time spent
+ *     building them, the bytes allocated meanwhile, and the number and
+ *     time of their backward closures;
+ *   - the size and depth of every graph that Variable::backward() sweeps;
+ *   - a timeline of named scopes (NN forward passes, backward passes,
+ *     optimizer steps, and any ProfileScope of the caller, such as one
+ *     per training step), each with its duration and the bytes allocated
+ *     inside it, which write_chrome_trace() exports for chrome://tracing
+ *     or Perfetto.
+ *
+ * Allocations are counted by a replacement of the global operator new,
+ * the aligned one included, so a profiled program must not replace them
+ * itself. Every op is timed individually, which about doubles the cost
+ * of building a node: the figures are for comparing ops and steps with
+ * each other, not with unprofiled runs.
+*/
+
+enum class VariableOp : uint8_t;
+
+struct OpProfile {
+    uint64_t nodes;
+    uint64_t forward_ns;
+    uint64_t bytes;
+    uint64_t backward_calls;
+    uint64_t backward_ns;
+};
+
+struct GraphProfile {
+    size_t nodes;
+    size_t depth;
+};
+
+class ProfileScope;
+
+class Profiler {
+public:
+    static constexpr size_t OP_COUNT = 26;
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> nodes{0};
+        std::atomic<uint64_t> forward_ns{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> backward_calls{0};
+        std::atomic<uint64_t> backward_ns{0};
+    };
+    struct Event {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        uint32_t thread;
+        std::vector<std::pair<const char *, double>> args;
+    };
+
+    std::chrono::steady_clock::time_point origin_;
+    std::array<Counters, OP_COUNT> ops_;
+    std::mutex mutex_;
+    std::vector<GraphProfile> graphs_;
+    std::vector<Event> events_;
+
+    static inline thread_local uint64_t allocated_bytes_ = 0;
+    static inline std::atomic<uint32_t> thread_counter_ = 0;
+
+    Profiler();
+    static uint32_t thread_index();
+
+    friend class ProfileScope;
+    friend class ProfileOpScope;
+    friend void *operator new(size_t size);
+    friend void *operator new(size_t size, std::align_val_t alignment);
+
+public:
+    static Profiler &global();
+    static const char *op_name(VariableOp op);
+
+    // Nanoseconds since the last reset().
+    uint64_t now() const;
+
+    // Bytes allocated so far on this thread.
+    static uint64_t allocated_bytes();
+
+    void reset();
+    void record_op(VariableOp op, uint64_t nanoseconds, uint64_t bytes);
+    void record_backward(VariableOp op, uint64_t nanoseconds);
+
+    // Also annotates the innermost ProfileScope of the thread.
+    void record_graph(size_t nodes, size_t depth);
+
+    OpProfile get_op(VariableOp op) const;
+    std::vector<GraphProfile> get_graphs();
+
+    // One line per op that was used, then the graph sizes.
+    void report(std::ostream &os);
+
+    /*
+     * Trace Event Format: one complete event per scope, on one track per
+     * thread, with the allocated bytes and graph sizes as arguments.
+    */
+    void write_chrome_trace(const std::string &path);
+};
+
+/*
+ * A named span of the timeline, from construction to destruction. The
+ * name must outlive the Profiler, e.g. a string literal.
+*/
+class ProfileScope {
+private:
+    const char *name_;
+    uint64_t start_ns_;
+    uint64_t start_bytes_;
+    ProfileScope *outer_;
+    std::vector<std::pair<const char *, double>> args_;
+
+    static inline thread_local ProfileScope *current_ = nullptr;
+
+    friend class Profiler;
+
+public:
+    explicit ProfileScope(const char *name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+// Times the construction of one node, or with backward set, its closure.
+class ProfileOpScope {
+private:
+    VariableOp op_;
+    bool backward_;
+    uint64_t start_ns_;
+    uint64_t start_bytes_;
+
+public:
+    explicit ProfileOpScope(VariableOp op, bool backward = false);
+    ~ProfileOpScope();
+
+    ProfileOpScope(const ProfileOpScope &) = delete;
+    ProfileOpScope &operator=(const ProfileOpScope &) = delete;
+};
+
+#ifdef AUTOGRAD_PROFILE
+#define AUTOGRAD_PROFILE_SCOPE(name) ProfileScope autograd_profile_scope_(name)
+#define AUTOGRAD_PROFILE_OP(op) ProfileOpScope autograd_profile_op_(op)
+#define AUTOGRAD_PROFILE_BACKWARD(op) ProfileOpScope autograd_profile_backward_(op, true)
+#else
+#define AUTOGRAD_PROFILE_SCOPE(name)
+#define AUTOGRAD_PROFILE_OP(op)
+#define AUTOGRAD_PROFILE_BACKWARD(op)
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Vectors of the widest width the target supports, for the elementwise
+ * kernels (optimizer updates, activations). They are GCC vector extensions,
+ * so the usual arithmetic operators work on them and mix with scalars.
+*/
+
+#if defined(__AVX512F__)
+#define SIMD_VECTOR_BYTES 64
+#elif defined(__AVX__)
+#define SIMD_VECTOR_BYTES 32
+#else
+#define SIMD_VECTOR_BYTES 16
+#endif
+
+template <typename T>
+struct Simd {
+    typedef T Vector __attribute__((vector_size(SIMD_VECTOR_BYTES)));
+    static constexpr size_t LANES = SIMD_VECTOR_BYTES / sizeof(T);
+};
+
+/*
+ * Unaligned loads and stores of either a vector V or a single value V = T,
+ * so one kernel body can serve the vector loop and the scalar tail.
+*/
+template <typename V, typename T>
+inline V simd_load(const T *ptr) {
+    V value;
+    std::memcpy(&value, ptr, sizeof(V));
+    return value;
+}
+
+template <typename V, typename T>
+inline void simd_store(T *ptr, V value) {
+    std::memcpy(ptr, &value, sizeof(V));
+}
+
+inline float simd_sqrt(float x) { return std::sqrt(x); }
+inline double simd_sqrt(double x) { return std::sqrt(x); }
+
+// The masked AVX-512 forms avoid a spurious -Wmaybe-uninitialized in GCC 12.
+inline Simd<float>::Vector simd_sqrt(Simd<float>::Vector x) {
+#if defined(__AVX512F__)
+    return (Simd<float>::Vector)_mm512_maskz_sqrt_ps(0xFFFF, (__m512)x);
+#elif defined(__AVX__)
+    return (Simd<float>::Vector)_mm256_sqrt_ps((__m256)x);
+#elif defined(__SSE2__)
+    return (Simd<float>::Vector)_mm_sqrt_ps((__m128)x);
+#else
+    for (size_t i = 0; i < Simd<float>::LANES; ++i) x[i] = std::sqrt(x[i]);
+    return x;
+#endif
+}
+
+inline Simd<double>::Vector simd_sqrt(Simd<double>::Vector x) {
+#if defined(__AVX512F__)
+    return (Simd<double>::Vector)_mm512_maskz_sqrt_pd(0xFF, (__m512d)x);
+#elif defined(__AVX__)
+    return (Simd<double>::Vector)_mm256_sqrt_pd((__m256d)x);
+#elif defined(__SSE2__)
+    return (Simd<double>::Vector)_mm_sqrt_pd((__m128d)x);
+#else
+    for (size_t i = 0; i < Simd<double>::LANES; ++i) x[i] = std::sqrt(x[i]);
+    return x;
+#endif
+}
+
+/*
+ * Calls kernel(i, V{}) for i in [0, n): with V = Simd<T>::Vector on whole
+ * vectors of LANES elements, then with V = T on the remaining ones.
+*/
+template <typename T, typename Kernel>
+inline void simd_for(size_t n, Kernel &&kernel) {
+    constexpr size_t LANES = Simd<T>::LANES;
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) kernel(i, typename Simd<T>::Vector{});
+    for (; i < n; ++i) kernel(i, T{});
+}
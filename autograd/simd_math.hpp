@@ -0,0 +1,238 @@
+#pragma once
+
+#include "simd.hpp"
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Vectorized exp, expm1 and the activations built on them. Every function
+ * takes V = Simd<T>::Vector or V = T, like the kernels of simd_for, and
+ * evaluates all the lanes with the same instructions: no libm call and no
+ * branch.
+ *
+ * exp(x) = 2^n * exp(r), with n = round(x / ln 2) and |r| <= ln 2 / 2. r is
+ * computed with ln 2 split in two parts (Cody-Waite), so it is exact up to
+ * rounding. exp(r) - 1 is a Taylor polynomial in r, evaluated with Horner's
+ * rule. Its degree is the smallest one whose truncation error stays below
+ * Ulp / 2 units in the last place, which leaves the other Ulp / 2 to the
+ * rounding of the evaluation. 2^n is applied as two exact powers of two,
+ * so large results overflow to inf and tiny ones underflow through the
+ * subnormals to 0.
+ *
+ * The activations only evaluate exp and expm1 at arguments <= 0, so they
+ * cannot overflow:
+ *   tanh(x)    = -expm1(-2|x|) / (expm1(-2|x|) + 2), with the sign of x;
+ *   sigmoid(x) = 1 / (1 + exp(-|x|)) for x >= 0,
+ *                exp(-|x|) / (1 + exp(-|x|)) for x < 0;
+ *   SiLU(x)    = x * sigmoid(x);
+ *   GELU(x)    = x * sigmoid(2 sqrt(2 / pi) (x + 0.044715 x^3)), the tanh
+ *                approximation with 1 + tanh(u) written as 2 sigmoid(2u),
+ *                which does not cancel for negative x.
+ * exp stays within Ulp. expm1 and the activations add a scaling or a
+ * division to it and stay within Ulp + 3, except that GELU, like any
+ * evaluation of it in T, also amplifies the rounding of its gate by up to
+ * |gate| for negative x. simd_math_test measures every function against
+ * libm.
+ *
+ * Tensor::Tanh(), Sigmoid(), exp(), SiLU() and GELU() run these kernels
+ * with the bound SIMD_MATH_ULP.
+*/
+
+// The default bound, in units in the last place of T; -DSIMD_MATH_ULP=n changes it.
+#ifndef SIMD_MATH_ULP
+#define SIMD_MATH_ULP 2
+#endif
+
+template <typename V>
+struct SimdElement {
+    typedef std::remove_cvref_t<decltype(std::declval<V &>()[0])> Type;
+};
+
+template <>
+struct SimdElement<float> {
+    typedef float Type;
+};
+
+template <>
+struct SimdElement<double> {
+    typedef double Type;
+};
+
+/*
+ * The signed integers of the same width as the lanes of V, for the
+ * exponent arithmetic.
+*/
+template <typename V>
+struct SimdBits {
+    typedef typename SimdElement<V>::Type Element;
+    typedef typename SimdBits<Element>::Integer Integer;
+    typedef Integer Type __attribute__((vector_size(sizeof(V))));
+
+    static constexpr int MANTISSA = SimdBits<Element>::MANTISSA;
+    static constexpr int BIAS = SimdBits<Element>::BIAS;
+};
+
+template <>
+struct SimdBits<float> {
+    typedef int32_t Integer;
+    typedef int32_t Type;
+
+    static constexpr int MANTISSA = 23;
+    static constexpr int BIAS = 127;
+};
+
+template <>
+struct SimdBits<double> {
+    typedef int64_t Integer;
+    typedef int64_t Type;
+
+    static constexpr int MANTISSA = 52;
+    static constexpr int BIAS = 1023;
+};
+
+template <typename V, typename T>
+inline V simd_splat(T value) {
+    return V{} + typename SimdElement<V>::Type(value);
+}
+
+template <typename V>
+inline V simd_abs(V x) {
+    return x < V{} ? -x : x;
+}
+
+/*
+ * The degree of the Taylor polynomial of exp(r) - 1, |r| <= ln 2 / 2, whose
+ * truncation error, relative to exp(r), is at most ulp / 2 units in the
+ * last place of T.
+*/
+template <typename T>
+constexpr size_t simd_exp_degree(size_t ulp) {
+    constexpr double HALF_LN2 = 0.34657359027997264;
+    const double budget = 0.5 * double(ulp) * double(std::numeric_limits<T>::epsilon()) / 2.0;
+    // The remainder is at most r^(d+1) / (d+1)! * exp(|r|), and exp(r) >= exp(-|r|).
+    double term = HALF_LN2;
+    for (size_t degree = 1; degree < 20; ++degree) {
+        term *= HALF_LN2 / double(degree + 1);
+        if (2.0 * term <= budget) return degree;
+    }
+    return 20;
+}
+
+template <typename T, size_t Degree>
+constexpr std::array<T, Degree + 1> simd_exp_coefficients() {
+    std::array<T, Degree + 1> coefficients{};
+    double factorial = 1.0;
+    for (size_t k = 1; k <= Degree; ++k) {
+        factorial *= double(k);
+        coefficients[k] = T(1.0 / factorial);
+    }
+    return coefficients;
+}
+
+/*
+ * Splits exp(x) into (1 + q) * scale * scale2, where q = exp(r) - 1 and the
+ * scales are powers of two.
+*/
+template <size_t Ulp, typename V>
+inline void simd_exp_reduce(V x, V &q, V &scale, V &scale2) {
+    typedef typename SimdElement<V>::Type T;
+    typedef SimdBits<V> Bits;
+    typedef typename Bits::Type Integer;
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "simd_exp: T must be float or double");
+    static_assert(Ulp >= 1, "simd_exp: the bound must be at least 1 ulp");
+
+    constexpr bool DOUBLE = std::is_same_v<T, double>;
+    // Past these, the result is inf or 0 whatever n is; clamping keeps n in range of the exponent.
+    constexpr T MAX = DOUBLE ? T(710.0) : T(89.0);
+    constexpr T MIN = DOUBLE ? T(-746.0) : T(-104.0);
+    constexpr T LOG2E = T(1.4426950408889634);
+    // ln 2 = LN2_HI + LN2_LO, with few enough bits in LN2_HI that n * LN2_HI is exact.
+    constexpr T LN2_HI = DOUBLE ? T(0.693145751953125) : T(0.693359375);
+    constexpr T LN2_LO = DOUBLE ? T(1.4286068203094172321e-06) : T(-2.12194440e-4);
+    // Adding 1.5 * 2^MANTISSA rounds to an integer, which lands in the low bits of the sum.
+    constexpr T SHIFTER = T(1.5) * T(typename Bits::Integer(1) << Bits::MANTISSA);
+
+    x = x > simd_splat<V>(MAX) ? simd_splat<V>(MAX) : x;
+    x = x < simd_splat<V>(MIN) ? simd_splat<V>(MIN) : x;
+
+    V shifted = x * LOG2E + SHIFTER;
+    V n = shifted - SHIFTER;
+    V r = (x - n * LN2_HI) - n * LN2_LO;
+
+    constexpr size_t DEGREE = simd_exp_degree<T>(Ulp);
+    constexpr auto COEFFICIENTS = simd_exp_coefficients<T, DEGREE>();
+    V p = simd_splat<V>(COEFFICIENTS[DEGREE]);
+    for (size_t k = DEGREE - 1; k >= 1; --k) p = p * r + COEFFICIENTS[k];
+    q = p * r;
+
+    Integer exponent = std::bit_cast<Integer>(shifted) - std::bit_cast<typename Bits::Integer>(SHIFTER);
+    Integer half = exponent >> 1;
+    scale = std::bit_cast<V>((half + Bits::BIAS) << Bits::MANTISSA);
+    scale2 = std::bit_cast<V>((exponent - half + Bits::BIAS) << Bits::MANTISSA);
+}
+
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_exp(V x) {
+    V q, scale, scale2;
+    simd_exp_reduce<Ulp>(x, q, scale, scale2);
+    return ((q + 1) * scale) * scale2;
+}
+
+// exp(x) - 1, without the cancellation near 0.
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_expm1(V x) {
+    V q, scale, scale2;
+    simd_exp_reduce<Ulp>(x, q, scale, scale2);
+    scale = scale * scale2;
+    return q * scale + (scale - 1);
+}
+
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_tanh(V x) {
+    V e = simd_expm1<Ulp>(-2 * simd_abs(x));
+    V t = -e / (e + 2);
+    return x < V{} ? -t : t;
+}
+
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_sigmoid(V x) {
+    V e = simd_exp<Ulp>(-simd_abs(x));
+    return (x < V{} ? e : simd_splat<V>(1)) / (e + 1);
+}
+
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_silu(V x) {
+    return x * simd_sigmoid<Ulp>(x);
+}
+
+/*
+ * The argument of the sigmoid in GELU, and its derivative with respect
+ * to x.
+*/
+template <typename V>
+inline V simd_gelu_gate(V x) {
+    typedef typename SimdElement<V>::Type T;
+    constexpr T SCALE = T(1.5957691216057308);  // 2 sqrt(2 / pi)
+    return SCALE * (x + T(0.044715) * x * x * x);
+}
+
+template <typename V>
+inline V simd_gelu_gate_derivative(V x) {
+    typedef typename SimdElement<V>::Type T;
+    constexpr T SCALE = T(1.5957691216057308);
+    return SCALE * (1 + T(3.0 * 0.044715) * x * x);
+}
+
+template <size_t Ulp = SIMD_MATH_ULP, typename V>
+inline V simd_gelu(V x) {
+    return x * simd_sigmoid<Ulp>(simd_gelu_gate(x));
+}
+
+template <typename V, typename T>
+inline V simd_leaky_relu(V x, T slope) {
+    return x > V{} ? x : slope * x;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "static_graph.hpp"
+
+/*
+ * Only the nodes reachable from the outputs are compiled. Slots keep the
+ * node indices of the tape, so the instruction list stays in tape order.
+*/
+template <typename T>
+StaticGraph<T>::StaticGraph(Tape<T> &tape, const std::vector<TapeVariable<T>> &inputs,
+                            const std::vector<TapeVariable<T>> &outputs) {
+    size_t n = tape.size();
+    std::vector<bool> needed(n, false);
+    for (auto & output : outputs) {
+        needed[output.get_index()] = true;
+        output_slots_.push_back(output.get_index());
+    }
+
+    for (size_t i = n; i-- > 0;) {
+        const TapeNode<T> &node = tape.node(i);
+        if (!needed[i] || node.op == TapeOp::Leaf) continue;
+        needed[node.parents[0]] = true;
+        bool binary = node.op == TapeOp::Add || node.op == TapeOp::Sub || node.op == TapeOp::Mul ||
+                      node.op == TapeOp::Div || node.op == TapeOp::Pow;
+        if (binary) needed[node.parents[1]] = true;
+    }
+
+    values_.resize(n);
+    grads_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const TapeNode<T> &node = tape.node(i);
+        values_[i] = node.data;
+        if (needed[i] && node.op != TapeOp::Leaf) {
+            instructions_.push_back({node.op, static_cast<uint32_t>(i), node.parents[0], node.parents[1]});
+        }
+    }
+
+    for (auto & input : inputs) {
+        input_slots_.push_back(input.get_index());
+    }
+    for (auto & [index, variable] : tape.bindings()) {
+        if (needed[index]) parameter_slots_.emplace_back(index, variable);
+    }
+}
+
+template <typename T>
+template <typename Function>
+StaticGraph<T> StaticGraph<T>::capture(const std::vector<T> &example_inputs, Function &&forward) {
+    Tape<T> tape;
+    std::vector<TapeVariable<T>> inputs;
+    for (T value : example_inputs) {
+        inputs.push_back(tape.variable(value));
+    }
+    std::vector<TapeVariable<T>> outputs = forward(tape, inputs);
+    return StaticGraph<T>(tape, inputs, outputs);
+}
+
+template <typename T>
+size_t StaticGraph<T>::get_instruction_count() const {
+    return instructions_.size();
+}
+
+template <typename T>
+T StaticGraph<T>::get_output_value(size_t output) const {
+    return values_[output_slots_[output]];
+}
+
+template <typename T>
+T StaticGraph<T>::get_input_grad(size_t input) const {
+    return grads_[input_slots_[input]];
+}
+
+template <typename T>
+void StaticGraph<T>::forward(const std::vector<T> &inputs) {
+    if (inputs.size() != input_slots_.size()) {
+        throw std::invalid_argument("StaticGraph::forward: wrong number of inputs");
+    }
+
+    T *__restrict values = values_.data();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        values[input_slots_[i]] = inputs[i];
+    }
+    for (auto & [index, variable] : parameter_slots_) {
+        values[index] = variable->get_data_value();
+    }
+    for (const Instruction & instruction : instructions_) {
+        values[instruction.out] = tape_forward(instruction.op, values[instruction.lhs], values[instruction.rhs]);
+    }
+}
+
+template <typename T>
+void StaticGraph<T>::backward(size_t output) {
+    const T *__restrict values = values_.data();
+    T *__restrict grads = grads_.data();
+    std::fill(grads_.begin(), grads_.end(), T(0.0));
+    grads[output_slots_[output]] = 1.0;
+
+    for (size_t i = instructions_.size(); i-- > 0;) {
+        const Instruction &instruction = instructions_[i];
+        tape_backward(instruction.op, values[instruction.out], grads[instruction.out],
+                      values[instruction.lhs], values[instruction.rhs],
+                      grads[instruction.lhs], grads[instruction.rhs]);
+    }
+
+    for (auto & [index, variable] : parameter_slots_) {
+        variable->set_grad(variable->get_grad_value() + grads[index]);
+    }
+}
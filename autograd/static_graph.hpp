@@ -0,0 +1,55 @@
+#pragma once
+
+#include "autograd_tape.cpp"
+#include "aligned_allocator.hpp"
+#include <stdexcept>
+
+/*
+ * Captured computation that is replayed without building a graph.
+ *
+ * capture() records one call of a function on a Tape and compiles the
+ * nodes that the outputs depend on into a flat list of instructions (op
+ * code and three value slots) over preallocated value and gradient arrays.
+ * forward() then writes new inputs into their slots, reloads the bound
+ * parameters and re-evaluates the instructions in order; backward() is a
+ * reverse sweep over the same list that adds the parameter gradients to
+ * the bound Variables, as Tape::backward() does.
+ *
+ * The captured function must not branch on values: every replay runs the
+ * ops recorded during capture.
+*/
+
+template <typename T = double>
+class StaticGraph {
+private:
+    struct Instruction {
+        TapeOp op;
+        uint32_t out;
+        uint32_t lhs;
+        uint32_t rhs;
+    };
+
+    std::vector<Instruction> instructions_;
+    AlignedVector<T> values_;
+    AlignedVector<T> grads_;
+    std::vector<uint32_t> input_slots_;
+    std::vector<uint32_t> output_slots_;
+    std::vector<std::pair<uint32_t, Variable<T> *>> parameter_slots_;
+
+public:
+    StaticGraph(Tape<T> &tape, const std::vector<TapeVariable<T>> &inputs, const std::vector<TapeVariable<T>> &outputs);
+
+    /*
+     * forward(tape, inputs) must return the outputs as a vector of
+     * TapeVariables; example_inputs are the input values used for capture.
+    */
+    template <typename Function>
+    static StaticGraph<T> capture(const std::vector<T> &example_inputs, Function &&forward);
+
+    size_t get_instruction_count() const;
+    T get_output_value(size_t output = 0) const;
+    T get_input_grad(size_t input) const;
+
+    void forward(const std::vector<T> &inputs);
+    void backward(size_t output = 0);
+};
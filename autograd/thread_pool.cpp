@@ -0,0 +1,87 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+inline ThreadPool::ThreadPool(size_t n_threads) {
+    task_ = nullptr;
+    n_tasks_ = 0;
+    next_task_ = 0;
+    active_workers_ = 0;
+    generation_ = 0;
+    stop_ = false;
+
+    // The calling thread takes part in every parallel_for.
+    for (size_t i = 1; i < n_threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+inline size_t ThreadPool::get_size() const {
+    return workers_.size() + 1;
+}
+
+inline void ThreadPool::run_tasks() {
+    inside_task_ = true;
+    for (size_t i = next_task_.fetch_add(1); i < n_tasks_; i = next_task_.fetch_add(1)) {
+        (*task_)(i);
+    }
+    inside_task_ = false;
+}
+
+inline void ThreadPool::worker_loop() {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+            if (stop_) return;
+            seen_generation = generation_;
+        }
+
+        run_tasks();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_workers_ == 0) done_.notify_one();
+    }
+}
+
+inline void ThreadPool::parallel_for(size_t n_tasks, const std::function<void(size_t)> &task) {
+    if (n_tasks == 0) return;
+    if (n_tasks == 1 || workers_.empty() || inside_task_) {
+        for (size_t i = 0; i < n_tasks; ++i) task(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(call_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        n_tasks_ = n_tasks;
+        next_task_ = 0;
+        active_workers_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&]() { return active_workers_ == 0; });
+    task_ = nullptr;
+}
+
+inline ThreadPool &ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fork-join pool used by the tensor kernels.
+ *
+ * parallel_for(n, task) calls task(i) for every i in [0, n) on the workers
+ * and on the calling thread, and returns when all of them are done. Calls
+ * made from inside a task run serially on the current thread, so kernels
+ * can be nested without deadlocking.
+ *
+ * ThreadPool::global() is shared by the library and has one thread per
+ * hardware core.
+*/
+
+class ThreadPool {
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::mutex call_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    const std::function<void(size_t)> *task_;
+    size_t n_tasks_;
+    std::atomic<size_t> next_task_;
+    size_t active_workers_;
+    uint64_t generation_;
+    bool stop_;
+
+    static inline thread_local bool inside_task_ = false;
+
+    void worker_loop();
+    void run_tasks();
+
+public:
+    explicit ThreadPool(size_t n_threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t get_size() const;
+    void parallel_for(size_t n_tasks, const std::function<void(size_t)> &task);
+
+    static ThreadPool &global();
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+/*
+ * Task queue of one worker of a work-stealing scheduler.
+ *
+ * The owner pushes and pops at the back, so it keeps working on the most
+ * recent (and cache-hot) task; idle workers steal the oldest task from the
+ * front. Each queue has its own lock, so workers only contend when one of
+ * them runs out of work.
+*/
+
+template <typename Task>
+class WorkStealingQueue {
+private:
+    std::deque<Task> tasks_;
+    std::mutex mutex_;
+
+public:
+    void push(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+
+    bool pop(Task &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.back());
+        tasks_.pop_back();
+        return true;
+    }
+
+    bool steal(Task &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return true;
+    }
+};
@@ -0,0 +1,73 @@
+#include "../autograd/autograd_variable.cpp"
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * Builds a chain of n nodes (y = y + x, n times) and a wide sum like the one
+ * in SingleNeuron, then runs backward() and drops them. Neither backward()
+ * nor the destruction of the graph may recurse, so this must not overflow
+ * the stack for any depth that fits into memory.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    std::shared_ptr<Variable<double>> x = std::make_shared<Variable<double>>(1.0);
+    x->add_info("x");
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Variable<double>> y = x;
+    for (size_t i = 1; i < n; ++i) {
+        y = y + x;
+    }
+    std::cout << "Chain of " << n << " nodes built in " << seconds_since(start) << " s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    y->backward(true);
+    std::cout << "backward() with retain_graph in " << seconds_since(start) << " s" << std::endl;
+
+    x->set_grad(0.0);
+    start = std::chrono::steady_clock::now();
+    y->backward(true);
+    std::cout << "backward() on the cached order in " << seconds_since(start) << " s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    y.reset();
+    std::cout << "Graph destroyed in " << seconds_since(start) << " s" << std::endl;
+    x->get_info();
+
+    // Releasing a subgraph shared with a retained graph: the cached order of
+    // the latter is rebuilt, without the nodes freed meanwhile.
+    auto a = std::make_shared<Variable<double>>(1.0), b = std::make_shared<Variable<double>>(2.0);
+    auto shared = (a + b) * b;
+    auto r1 = shared * 2.0, r2 = shared * 3.0;
+    r1->backward(true);
+    r2->backward();
+    r1->backward(true);
+    std::cout << "After releasing a shared subgraph: a grad " << a->get_grad_value() << ", b grad "
+              << b->get_grad_value() << std::endl;
+
+    std::vector<std::shared_ptr<Variable<double>>> weights, inputs;
+    for (size_t i = 0; i < 1000; ++i) {
+        weights.emplace_back(std::make_shared<Variable<double>>(0.001 * i));
+        inputs.emplace_back(std::make_shared<Variable<double>>(1.0));
+    }
+
+    start = std::chrono::steady_clock::now();
+    size_t steps = n / 3000;
+    for (size_t step = 0; step < steps; ++step) {
+        std::shared_ptr<Variable<double>> sum = std::make_shared<Variable<double>>(0.0);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            sum = sum + (inputs[i] * weights[i]);
+        }
+        sum->ReLU()->backward();
+    }
+    std::cout << std::endl;
+    std::cout << steps << " steps of a 1000-input neuron in " << seconds_since(start) << " s" << std::endl;
+    weights.back()->get_info();
+    return 0;
+}
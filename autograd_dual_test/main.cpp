@@ -0,0 +1,98 @@
+#include "../autograd/autograd_variable.cpp"
+#include <chrono>
+
+/*
+ * Forward mode against reverse mode on generic functions: one with few
+ * inputs and more outputs, a square 4 -> 4 map, and reductions to one
+ * output of growing width, where reverse mode eventually wins. Checks
+ * that jvp() and both Jacobians agree and reports the time per Jacobian
+ * in each mode.
+*/
+
+template <typename Function>
+double us_per_call(size_t n, Function &&function) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) function();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+// R^2 -> R^16: features of a point.
+auto features = [](const auto &x) {
+    typedef std::decay_t<decltype(x[0])> Scalar;
+    std::vector<Scalar> y;
+    for (int k = 1; k <= 4; ++k) {
+        y.push_back(Tanh(x[0] * (0.5 * k) - x[1]));
+        y.push_back(Sigmoid(x[0] + x[1] * (0.25 * k)));
+        y.push_back(exp(x[1] * (-0.1 * k)) * x[0]);
+        y.push_back(ReLU(x[0] - x[1] * k) + pow(square(x[1]) + 1.0, 0.5 * k));
+    }
+    return y;
+};
+
+// R^32 -> R: a smooth loss.
+auto reduction = [](const auto &x) {
+    typedef std::decay_t<decltype(x[0])> Scalar;
+    Scalar sum = square(x[0]);
+    for (size_t i = 1; i < x.size(); ++i) {
+        sum = sum + Sigmoid(x[i] * x[i - 1]) + square(x[i] - 0.5);
+    }
+    return std::vector<Scalar>{sum};
+};
+
+// R^4 -> R^4, with a Variable exponent.
+auto square_map = [](const auto &x) {
+    typedef std::decay_t<decltype(x[0])> Scalar;
+    return std::vector<Scalar>{
+        x[0] * x[1] - x[2] / x[3],
+        Tanh(x[0] + x[3]),
+        pow(x[1], x[0]),
+        exp(-x[2]) * x[1]
+    };
+};
+
+template <typename Function>
+void compare(const char *name, Function &&function, const std::vector<double> &x, size_t repeats) {
+    std::vector<std::vector<double>> forward = jacobian(function, x, JacobianMode::Forward);
+    std::vector<std::vector<double>> reverse = jacobian(function, x, JacobianMode::Reverse);
+
+    std::vector<double> v(x.size());
+    for (size_t j = 0; j < v.size(); ++j) v[j] = 1.0 / (j + 1);
+    std::vector<double> directional = jvp(function, x, v).second;
+
+    double max_diff = 0.0;
+    for (size_t i = 0; i < forward.size(); ++i) {
+        double jv = 0.0;
+        for (size_t j = 0; j < x.size(); ++j) {
+            max_diff = std::max(max_diff, std::abs(forward[i][j] - reverse[i][j]));
+            jv += reverse[i][j] * v[j];
+        }
+        max_diff = std::max(max_diff, std::abs(directional[i] - jv));
+    }
+
+    double forward_us = us_per_call(repeats, [&]() { jacobian(function, x, JacobianMode::Forward); });
+    double reverse_us = us_per_call(repeats, [&]() { jacobian(function, x, JacobianMode::Reverse); });
+    double auto_us = us_per_call(repeats, [&]() { jacobian(function, x); });
+    double jvp_us = us_per_call(repeats, [&]() { jvp(function, x, v); });
+
+    std::cout << name << ": " << forward.size() << " x " << x.size() << " Jacobian, max difference: " << max_diff << std::endl;
+    std::cout << "  forward: " << forward_us << " us, reverse: " << reverse_us << " us, auto: " << auto_us
+              << " us, jvp: " << jvp_us << " us" << std::endl;
+}
+
+int main() {
+    std::vector<double> x = {0.3, 1.2, 0.8, 1.5};
+    std::vector<Dual<double>> inputs = {Dual<double>::variable(x[0]), Dual<double>(x[1]), Dual<double>(x[2]), Dual<double>(x[3])};
+    std::cout << "d/dx0 of the 4 -> 4 map:" << std::endl;
+    for (auto & output : square_map(inputs)) std::cout << "  " << output << std::endl;
+    std::cout << std::endl;
+
+    compare("features 2 -> 16", features, {0.4, 0.9}, 20000);
+    compare("map 4 -> 4", square_map, x, 20000);
+    for (size_t n : {32, 256, 2048}) {
+        std::vector<double> wide(n);
+        for (size_t i = 0; i < wide.size(); ++i) wide[i] = std::sin(0.7 * i);
+        std::string name = "reduction " + std::to_string(n) + " -> 1";
+        compare(name.c_str(), reduction, wide, 100000 / n);
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+
+/*
+ * Backward of a scalar MLP loss, whose neurons are independent branches of
+ * the graph, with backward() and with parallel_backward() on 1, 2 and 4
+ * threads. The atomic mode must match the sequential gradients up to
+ * rounding; the deterministic mode must give bit-identical gradients for
+ * every thread count and every run, with checkpointed layers too.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    size_t batch = 8, in_size = 16, hidden = 64;
+
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    std::vector<std::shared_ptr<Variable<double>>> params = nn.parameters();
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<std::vector<std::shared_ptr<Variable<double>>>> inputs(batch);
+    std::vector<std::shared_ptr<Variable<double>>> targets;
+    for (auto & x : inputs) {
+        for (size_t i = 0; i < in_size; ++i) x.emplace_back(std::make_shared<Variable<double>>(dis(gen)));
+        targets.emplace_back(std::make_shared<Variable<double>>(dis(gen)));
+    }
+
+    auto build_loss = [&]() {
+        std::shared_ptr<Variable<double>> loss = std::make_shared<Variable<double>>(0.0);
+        for (size_t b = 0; b < batch; ++b) {
+            std::shared_ptr<Variable<double>> error = nn(inputs[b])[0] - targets[b];
+            loss = loss + error * error;
+        }
+        return loss;
+    };
+
+    auto gradients = [&](auto run_backward) {
+        for (auto & param : params) param->set_grad(0.0);
+        std::shared_ptr<Variable<double>> loss = build_loss();
+        auto start = std::chrono::steady_clock::now();
+        run_backward(loss);
+        double elapsed = seconds_since(start);
+
+        std::vector<double> grad;
+        for (auto & param : params) grad.push_back(param->get_grad_value());
+        return std::make_pair(grad, elapsed);
+    };
+
+    auto max_difference = [](const std::vector<double> &lhs, const std::vector<double> &rhs) {
+        double difference = 0.0;
+        for (size_t i = 0; i < lhs.size(); ++i) difference = std::max(difference, std::abs(lhs[i] - rhs[i]));
+        return difference;
+    };
+
+    auto [reference, sequential_time] = gradients([](auto &loss) { loss->backward(); });
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, batch " << batch
+              << ", " << params.size() << " parameters" << std::endl;
+    std::cout << "backward(): " << sequential_time * 1e3 << " ms" << std::endl << std::endl;
+
+    bool ok = true;
+    std::vector<double> deterministic_reference;
+    for (size_t threads : {1, 2, 4}) {
+        ThreadPool pool(threads);
+
+        auto [atomic, atomic_time] = gradients([&](auto &loss) { loss->parallel_backward(false, false, pool); });
+        auto [deterministic, deterministic_time] = gradients([&](auto &loss) { loss->parallel_backward(false, true, pool); });
+        auto [repeated, repeated_time] = gradients([&](auto &loss) { loss->parallel_backward(false, true, pool); });
+        if (deterministic_reference.empty()) deterministic_reference = deterministic;
+
+        double atomic_difference = max_difference(reference, atomic);
+        bool identical = deterministic == deterministic_reference && repeated == deterministic_reference;
+        ok &= atomic_difference < 1e-9 && max_difference(reference, deterministic) < 1e-9 && identical;
+
+        std::cout << threads << " threads: atomic " << atomic_time * 1e3 << " ms (max difference "
+                  << atomic_difference << "), deterministic " << deterministic_time * 1e3 << " ms ("
+                  << (identical ? "bit-identical" : "NOT identical") << ")" << std::endl;
+    }
+
+    // A retained graph can be swept again; leaves accumulate.
+    ThreadPool pool(2);
+    for (auto & param : params) param->set_grad(0.0);
+    std::shared_ptr<Variable<double>> loss = build_loss();
+    loss->parallel_backward(true, true, pool);
+    loss->parallel_backward(true, true, pool);
+    std::vector<double> twice;
+    for (size_t i = 0; i < params.size(); ++i) twice.push_back(params[i]->get_grad_value() - 2.0 * deterministic_reference[i]);
+    double retained_difference = max_difference(twice, std::vector<double>(params.size(), 0.0));
+    ok &= retained_difference < 1e-9;
+    std::cout << std::endl << "Two sweeps of a retained graph, difference to twice the gradient: "
+              << retained_difference << std::endl;
+
+    // Checkpointed segments of different samples add to the same parameters from several threads.
+    nn.set_checkpointing(CheckpointPolicy::Fixed, 1);
+    batch = 16;
+    inputs.resize(batch);
+    for (size_t b = 8; b < batch; ++b) {
+        for (size_t i = 0; i < in_size; ++i) inputs[b].emplace_back(std::make_shared<Variable<double>>(dis(gen)));
+        targets.emplace_back(std::make_shared<Variable<double>>(dis(gen)));
+    }
+    auto [checkpointed_reference, checkpointed_time] = gradients([](auto &loss) { loss->backward(); });
+    std::vector<double> checkpointed_deterministic;
+    bool checkpointed_identical = true;
+    double checkpointed_difference = 0.0;
+    for (size_t threads : {1, 4}) {
+        ThreadPool threads_pool(threads);
+        for (size_t run = 0; run < 10; ++run) {
+            auto [grad, time] = gradients([&](auto &loss) { loss->parallel_backward(false, true, threads_pool); });
+            if (checkpointed_deterministic.empty()) checkpointed_deterministic = grad;
+            checkpointed_identical &= grad == checkpointed_deterministic;
+            checkpointed_difference = std::max(checkpointed_difference, max_difference(checkpointed_reference, grad));
+        }
+    }
+    ok &= checkpointed_identical && checkpointed_difference < 1e-9;
+    std::cout << "Checkpointed layers, batch " << batch << ", deterministic on 1 and 4 threads: "
+              << (checkpointed_identical ? "bit-identical" : "NOT identical") << ", max difference to backward() "
+              << checkpointed_difference << std::endl;
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
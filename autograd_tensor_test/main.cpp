@@ -0,0 +1,78 @@
+#include "../autograd/autograd_tensor.cpp"
+
+/*
+ * Compares the gradient of every tensor operation with central finite
+ * differences of the same expression.
+*/
+template <typename Function>
+double max_gradient_error(std::vector<std::shared_ptr<Tensor<double>>> inputs, Function function) {
+    for (auto & input : inputs) input->zero_grad();
+    function(inputs)->sum()->backward();
+
+    double error = 0.0, eps = 1e-6;
+    for (auto & input : inputs) {
+        for (size_t i = 0; i < input->get_size(); ++i) {
+            double value = input->get_data()[i];
+            input->get_data()[i] = value + eps;
+            double plus = function(inputs)->sum()->get_data_value();
+            input->get_data()[i] = value - eps;
+            double minus = function(inputs)->sum()->get_data_value();
+            input->get_data()[i] = value;
+            error = std::max(error, std::abs((plus - minus) / (2 * eps) - input->get_grad_value(i)));
+        }
+    }
+    return error;
+}
+
+std::shared_ptr<Tensor<double>> tensor(std::vector<size_t> shape, double start, double step) {
+    auto result = std::make_shared<Tensor<double>>(shape);
+    for (size_t i = 0; i < result->get_size(); ++i) result->get_data()[i] = start + step * i;
+    return result;
+}
+
+int main() {
+    auto a = tensor({2, 3}, -1.0, 0.4);
+    auto b = tensor({3}, 0.5, -0.3);
+    auto c = tensor({3, 4}, -0.7, 0.15);
+    auto col = tensor({2, 1}, 0.25, 0.5);
+
+    std::cout << "a: " << a << std::endl;
+    std::cout << "b: " << b << std::endl;
+    std::cout << "a + b: " << a + b << std::endl;
+    std::cout << "a * col: " << a * col << std::endl;
+    std::cout << "a matmul c: " << a->matmul(c) << std::endl;
+    std::cout << "sum(a, axis=0): " << a->sum(0) << std::endl;
+    std::cout << "sum(a, axis=1): " << a->sum(1) << std::endl;
+    std::cout << "mean(a): " << a->mean() << std::endl;
+    std::cout << "transpose(a): " << a->transpose() << std::endl;
+
+    std::cout << std::endl;
+    std::cout << "Max gradient errors against finite differences:" << std::endl;
+
+    using Inputs = std::vector<std::shared_ptr<Tensor<double>>>;
+    std::cout << "add (broadcast row): " << max_gradient_error({a, b}, [](Inputs &x) { return x[0] + x[1]; }) << std::endl;
+    std::cout << "sub (broadcast column): " << max_gradient_error({a, col}, [](Inputs &x) { return x[0] - x[1]; }) << std::endl;
+    std::cout << "mul (broadcast row): " << max_gradient_error({a, b}, [](Inputs &x) { return x[0] * x[1]; }) << std::endl;
+    std::cout << "mul (same tensor): " << max_gradient_error({a}, [](Inputs &x) { return x[0] * x[0]; }) << std::endl;
+    std::cout << "matmul: " << max_gradient_error({a, c}, [](Inputs &x) { return x[0]->matmul(x[1]); }) << std::endl;
+    std::cout << "transpose: " << max_gradient_error({a, b}, [](Inputs &x) { return x[0]->transpose()->Tanh() * x[1]->reshape({3, 1}); }) << std::endl;
+    std::cout << "sum(axis=0): " << max_gradient_error({a, b}, [](Inputs &x) { return (x[0] * x[0])->sum(0) * x[1]; }) << std::endl;
+    std::cout << "sum(axis=1): " << max_gradient_error({a}, [](Inputs &x) { return (x[0] * x[0])->sum(1)->exp(); }) << std::endl;
+    std::cout << "mean: " << max_gradient_error({a}, [](Inputs &x) { return (x[0] * x[0])->mean(); }) << std::endl;
+    std::cout << "ReLU: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->ReLU(); }) << std::endl;
+    std::cout << "LeakyReLU: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->LeakyReLU(0.1); }) << std::endl;
+    std::cout << "Tanh: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->Tanh(); }) << std::endl;
+    std::cout << "Sigmoid: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->Sigmoid(); }) << std::endl;
+    std::cout << "SiLU: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->SiLU(); }) << std::endl;
+    std::cout << "GELU: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->GELU(); }) << std::endl;
+    std::cout << "exp: " << max_gradient_error({a}, [](Inputs &x) { return x[0]->exp(); }) << std::endl;
+
+    auto s = std::make_shared<Tensor<double>>(std::vector<size_t>{}, std::vector<double>{1.5});
+    auto t = std::make_shared<Tensor<double>>(std::vector<size_t>{}, std::vector<double>{-0.25});
+    std::cout << std::endl;
+    std::cout << "Rank-0 tensors:" << std::endl;
+    std::cout << "s + t: " << s + t << std::endl;
+    std::cout << "s * a: " << s * a << std::endl;
+    std::cout << "mul (rank 0): " << max_gradient_error({s, t}, [](Inputs &x) { return x[0] * x[1] + x[0]; }) << std::endl;
+    return 0;
+}
@@ -47,7 +47,7 @@ int main() {
     act->add_info("x1*x2-x3");
     std::shared_ptr<Variable<double>> result = act->Sigmoid();
     result->add_info("sigmoid(act)");
-    result->backward();
+    result->backward(true); // retain the graph to inspect the parents below;
 
     
     std::cout << "After backward:" << std::endl;
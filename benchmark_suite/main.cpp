@@ -0,0 +1,271 @@
+#include "../mlp/mlp.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+/*
+ * Regression benchmarks of the engine, the layers and a training loop:
+ *
+ *     ./main [results.json [baseline.json [threshold]]]
+ *
+ * Every benchmark is timed in 9 repetitions of at least 20 ms each, and
+ * the time per item of the fastest one is reported (ns per op, per graph
+ * node, per sample or per step): other processes can only slow a
+ * repetition down, so the fastest is the most repeatable figure.
+ *
+ * The results are written as JSON in the layout of Google Benchmark, so
+ * its compare.py tools read them too. Given the results of an earlier
+ * commit as a baseline, the benchmarks are compared one by one, and the
+ * program fails if one is slower by more than the threshold, 0.1 (10%)
+ * by default. On a shared machine the fastest repetition still varies by
+ * up to 30% between runs, so compare runs from an idle machine or raise
+ * the threshold.
+*/
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double ns_per_item;
+};
+
+/*
+ * time(n) runs n iterations of the benchmark and returns the nanoseconds
+ * to count, so that it can leave the setup of every iteration out.
+*/
+template <typename Function>
+Result measure(const std::string &name, size_t items_per_iteration, Function time) {
+    constexpr double MIN_NS = 20e6;
+    constexpr size_t REPETITIONS = 9;
+    size_t n = 1;
+    double ns = time(n);
+    while (ns < MIN_NS) {
+        n = static_cast<size_t>(double(n) * std::min(100.0, 1.5 * MIN_NS / std::max(ns, 1.0))) + 1;
+        ns = time(n);
+    }
+
+    double fastest = ns;
+    for (size_t k = 1; k < REPETITIONS; ++k) fastest = std::min(fastest, time(n));
+
+    Result result{name, n * items_per_iteration, fastest / double(n) / double(items_per_iteration)};
+    std::printf("%-32s %12.1f ns/item %14.4g items/s\n", name.c_str(), result.ns_per_item, 1e9 / result.ns_per_item);
+    std::fflush(stdout);
+    return result;
+}
+
+double nanoseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Times the whole loop.
+template <typename Body>
+auto loop(Body body) {
+    return [body](size_t n) mutable {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) body();
+        return nanoseconds_since(start);
+    };
+}
+
+// Times only backward() on graphs built by build().
+template <typename Build>
+auto backward_of(Build build) {
+    return [build](size_t n) mutable {
+        double ns = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            Pointer output = build();
+            auto start = std::chrono::steady_clock::now();
+            output->backward();
+            ns += nanoseconds_since(start);
+        }
+        return ns;
+    };
+}
+
+void scalar_ops(std::vector<Result> &results) {
+    Pointer x = std::make_shared<Variable<double>>(0.7), y = std::make_shared<Variable<double>>(1.3);
+    Pointer sink;
+    results.push_back(measure("op/add", 1, loop([&]() { sink = x + y; })));
+    results.push_back(measure("op/mul", 1, loop([&]() { sink = x * y; })));
+    results.push_back(measure("op/pow", 1, loop([&]() { sink = x->pow(y); })));
+    results.push_back(measure("op/mul_scalar", 1, loop([&]() { sink = x * 2.0; })));
+    results.push_back(measure("op/relu", 1, loop([&]() { sink = x->ReLU(); })));
+    results.push_back(measure("op/tanh", 1, loop([&]() { sink = x->Tanh(); })));
+    results.push_back(measure("op/sigmoid", 1, loop([&]() { sink = x->Sigmoid(); })));
+    results.push_back(measure("op/exp", 1, loop([&]() { sink = x->exp(); })));
+}
+
+/*
+ * Graphs of about N nodes: a chain of dependent ops, a wide sum of
+ * independent products of leaves, and a chain of diamonds in which every
+ * node is used by two others.
+*/
+void graph_shapes(std::vector<Result> &results) {
+    for (size_t n : {1000, 100000}) {
+        std::vector<Pointer> leaves;
+        for (size_t i = 0; i < n; ++i) leaves.push_back(std::make_shared<Variable<double>>(1e-3 * double(i)));
+        Pointer x = leaves[0];
+        std::string size = "/" + std::to_string(n);
+
+        results.push_back(measure("backward/chain" + size, n, backward_of([&]() {
+            Pointer y = x;
+            for (size_t i = 1; i < n; ++i) y = y * 0.999;
+            return y;
+        })));
+        results.push_back(measure("backward/wide" + size, n, backward_of([&]() {
+            Pointer sum = leaves[0] * leaves[0];
+            for (size_t i = 1; i < n / 2; ++i) sum = sum + leaves[i] * leaves[i];
+            return sum;
+        })));
+        results.push_back(measure("backward/diamond" + size, n, backward_of([&]() {
+            Pointer y = x;
+            for (size_t i = 1; i < n / 3; ++i) y = y * 0.5 + y * 0.499;
+            return y;
+        })));
+    }
+}
+
+/*
+ * A single Linear layer of width by width with ReLU: per sample through
+ * Variables, per batch of 32 through Tensors, forward only and with the
+ * backward pass.
+*/
+void linear_layers(std::vector<Result> &results) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+
+    for (size_t width : {16, 64}) {
+        NN<double> nn;
+        nn.add_linear_layer(width, width, true);
+        std::vector<Pointer> x;
+        for (size_t i = 0; i < width; ++i) x.push_back(std::make_shared<Variable<double>>(dis(gen)));
+        std::string name = "linear/variable/" + std::to_string(width);
+
+        std::vector<Pointer> sink;
+        results.push_back(measure(name + "/forward", 1, loop([&]() { sink = nn(x); })));
+        results.push_back(measure(name + "/backward", 1, loop([&]() {
+            std::vector<Pointer> output = nn(x);
+            Pointer sum = output[0];
+            for (size_t i = 1; i < width; ++i) sum = sum + output[i];
+            sum->backward();
+        })));
+    }
+
+    const size_t batch = 32;
+    for (size_t width : {64, 256, 1024}) {
+        NN<double> nn;
+        nn.add_linear_layer(width, width, true);
+        std::vector<double> inputs(batch * width);
+        for (auto & value : inputs) value = dis(gen);
+        auto x = std::make_shared<Tensor<double>>(std::vector<size_t>{batch, width}, inputs);
+        std::string name = "linear/tensor/" + std::to_string(width);
+
+        std::shared_ptr<Tensor<double>> sink;
+        results.push_back(measure(name + "/forward", batch, loop([&]() { sink = nn(x); })));
+        results.push_back(measure(name + "/backward", batch, loop([&]() { nn(x)->sum()->backward(); })));
+    }
+}
+
+// One training step of mlp_test: forward, squared error, backward, SGD.
+void mlp_training(std::vector<Result> &results) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dis(-5.0, 5.0);
+    std::vector<std::vector<Pointer>> X;
+    std::vector<Pointer> Y;
+    for (int i = 0; i < 100; ++i) {
+        double x1 = dis(gen), x2 = dis(gen), x3 = dis(gen), x4 = dis(gen);
+        X.push_back({std::make_shared<Variable<double>>(x1), std::make_shared<Variable<double>>(x2),
+                     std::make_shared<Variable<double>>(x3), std::make_shared<Variable<double>>(x4)});
+        Y.push_back(std::make_shared<Variable<double>>(x1 * x2 - x3 + x4 * x4));
+    }
+
+    NN<double> nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+    optimizer<double> optim(nn, 0.0001);
+
+    size_t j = 0;
+    results.push_back(measure("mlp_test/step", 1, loop([&]() {
+        Pointer loss = (Y[j] - nn(X[j])[0])->square();
+        optim.zero_grad();
+        loss->backward();
+        optim.step();
+        j = (j + 1) % X.size();
+    })));
+}
+
+void write_json(const std::string &path, const std::vector<Result> &results) {
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\n  \"context\": {\n"
+         << "    \"executable\": \"benchmark_suite\",\n"
+         << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+         << "    \"compiler\": \"" << __VERSION__ << "\"\n  },\n  \"benchmarks\": [";
+    char line[256];
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::snprintf(line, sizeof(line),
+                      "%s\n    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", "
+                      "\"iterations\": %zu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\", "
+                      "\"items_per_second\": %.6g}",
+                      i ? "," : "", results[i].name.c_str(), results[i].name.c_str(), results[i].iterations,
+                      results[i].ns_per_item, results[i].ns_per_item, 1e9 / results[i].ns_per_item);
+        file << line;
+    }
+    file << "\n  ]\n}\n";
+    if (!file.flush()) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+// The name and real_time of every benchmark of a file written by write_json().
+std::vector<Result> read_json(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string json = text.str();
+
+    std::vector<Result> results;
+    const std::string name_key = "\"name\": \"", time_key = "\"real_time\": ";
+    for (size_t at = json.find(name_key); at != std::string::npos; at = json.find(name_key, at)) {
+        at += name_key.size();
+        size_t end = json.find('"', at), time = json.find(time_key, at);
+        if (end == std::string::npos || time == std::string::npos) break;
+        results.push_back({json.substr(at, end - at), 0, std::stod(json.substr(time + time_key.size()))});
+    }
+    return results;
+}
+
+int main(int argc, char **argv) {
+    std::vector<Result> results;
+    scalar_ops(results);
+    graph_shapes(results);
+    linear_layers(results);
+    mlp_training(results);
+
+    std::string output = argc > 1 ? argv[1] : "benchmark_suite.json";
+    write_json(output, results);
+    std::printf("\nresults written to %s\n", output.c_str());
+    if (argc < 3) return 0;
+
+    std::vector<Result> baseline = read_json(argv[2]);
+    double threshold = argc > 3 ? std::stod(argv[3]) : 0.1;
+    size_t regressions = 0;
+    std::printf("\n%-32s %12s %12s %8s\n", "compared with the baseline", "before ns", "after ns", "ratio");
+    for (auto & result : results) {
+        auto before = std::find_if(baseline.begin(), baseline.end(), [&](const Result &r) { return r.name == result.name; });
+        if (before == baseline.end()) continue;
+        double ratio = result.ns_per_item / before->ns_per_item;
+        bool slower = ratio > 1.0 + threshold;
+        regressions += slower;
+        std::printf("%-32s %12.1f %12.1f %8.2f%s\n", result.name.c_str(), before->ns_per_item, result.ns_per_item,
+                    ratio, slower ? "  slower" : "");
+    }
+    std::printf("%zu of %zu benchmarks more than %.0f%% slower\n", regressions, results.size(), 100.0 * threshold);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+/*
+ * Activation checkpointing on a 50-layer MLP: the peak heap usage of one
+ * training step (forward and backward) against its time, without
+ * checkpointing, with one segment per layer, with the sqrt(N) policy and
+ * with a few long segments. Checks that every policy gives the gradients
+ * of the plain step, and that a segment gives the right gradients to a
+ * backward pass that reaches only some of its outputs.
+*/
+
+static size_t live_bytes = 0;
+static size_t peak_bytes = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    void *ptr = std::malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    live_bytes += malloc_usable_size(ptr);
+    peak_bytes = std::max(peak_bytes, live_bytes);
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    if (ptr) live_bytes -= malloc_usable_size(ptr);
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept {
+    if (ptr) live_bytes -= malloc_usable_size(ptr);
+    std::free(ptr);
+}
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+// A second backward pass that reaches only some outputs of a segment, and a segment without outputs.
+void check_segment() {
+    Pointer a = std::make_shared<Variable<double>>(2.0);
+    std::vector<Pointer> outs = Checkpoint<double>::run([](const std::vector<Pointer> &in) {
+        return std::vector<Pointer>{in[0] * 3.0, in[0] * 5.0};
+    }, {a});
+    (outs[0] + outs[1])->backward(true);
+    double both = a->get_grad_value();
+    a->set_grad(0.0);
+    (outs[0] * 1.0)->backward();
+    std::cout << "d(3a + 5a)/da " << both << ", then d(3a)/da " << a->get_grad_value() << std::endl;
+
+    try {
+        Checkpoint<double>::run([](const std::vector<Pointer> &) { return std::vector<Pointer>{}; }, {a});
+        std::cout << "A segment without outputs was accepted" << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cout << "A segment without outputs throws: " << e.what() << std::endl;
+    }
+}
+
+int main() {
+    check_segment();
+
+    const size_t in_size = 8, width = 16, n_layers = 50, steps = 50;
+
+    NN nn;
+    nn.add_linear_layer(in_size, width, true);
+    for (size_t i = 2; i < n_layers; ++i) nn.add_linear_layer(width, width, true);
+    nn.add_linear_layer(width, 1, false);
+    optimizer<double> optim(nn, 0.0);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> sample(in_size + 1);
+    for (auto & value : sample) value = dis(gen);
+
+    auto step = [&]() {
+        std::vector<Pointer> x(in_size);
+        for (size_t i = 0; i < in_size; ++i) x[i] = std::make_shared<Variable<double>>(sample[i]);
+        Pointer loss = (sample[in_size] - nn(x)[0])->square();
+        optim.zero_grad();
+        loss->backward();
+    };
+
+    std::cout << "MLP with " << n_layers << " layers of width " << width << ", "
+              << nn.get_parameter_count() << " parameters" << std::endl;
+
+    std::vector<double> expected;
+    double plain_time = 0.0;
+    struct Run {
+        const char *name;
+        CheckpointPolicy policy;
+        size_t segment_layers;
+    };
+    for (const Run &run : {
+        Run{"no checkpointing", CheckpointPolicy::None, 1},
+        Run{"every layer", CheckpointPolicy::Fixed, 1},
+        Run{"sqrt(N) = 8 layers", CheckpointPolicy::Sqrt, 1},
+        Run{"25 layers", CheckpointPolicy::Fixed, 25},
+    }) {
+        nn.set_checkpointing(run.policy, run.segment_layers);
+
+        size_t baseline = live_bytes;
+        peak_bytes = live_bytes;
+        step();
+        size_t peak = peak_bytes - baseline;
+
+        std::vector<double> grad(nn.get_parameter_grad(), nn.get_parameter_grad() + nn.get_parameter_count());
+        if (expected.empty()) expected = grad;
+        double max_diff = 0.0;
+        for (size_t i = 0; i < grad.size(); ++i) max_diff = std::max(max_diff, std::abs(grad[i] - expected[i]));
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < steps; ++i) step();
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+        if (run.policy == CheckpointPolicy::None) plain_time = time;
+
+        std::cout << "  " << run.name << ": peak " << peak / 1024 << " kB, step " << time << " ms ("
+                  << time / plain_time << "x), max gradient difference " << max_diff << std::endl;
+    }
+    return 0;
+}
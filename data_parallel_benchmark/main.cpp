@@ -0,0 +1,79 @@
+#include "../mlp/data_parallel.cpp"
+#include <chrono>
+
+/*
+ * Data-parallel training of an MLP on one batch with 1, 2, 4, ... workers.
+ *
+ * First checks that the all-reduced gradient of N workers equals the
+ * single-worker gradient, then reports the steps per second and the
+ * speedup of every worker count. The learning rate is 0 so that every run
+ * measures the same step and must report the same loss.
+ *
+ * Usage: ./main [max_workers], the default is the number of hardware
+ * threads.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    size_t max_workers = argc > 1 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    size_t batch = 512, in_size = 64, hidden = 256, steps = 20;
+
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    std::vector<std::shared_ptr<Variable<double>>> params = nn.parameters();
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    auto inputs = std::make_shared<Tensor<double>>(std::vector<size_t>{batch, in_size});
+    auto targets = std::make_shared<Tensor<double>>(std::vector<size_t>{batch, 1});
+    for (size_t i = 0; i < inputs->get_size(); ++i) inputs->get_data()[i] = dis(gen);
+    for (size_t i = 0; i < targets->get_size(); ++i) targets->get_data()[i] = dis(gen);
+
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, batch " << batch
+              << ", " << params.size() << " parameters" << std::endl;
+
+    // With two accumulation steps the first step only leaves the gradient in the parameters.
+    auto gradient = [&](size_t workers) {
+        ThreadPool pool(workers);
+        optimizer<double> optim(nn, 0.0, 2);
+        DataParallelTrainer<double> trainer(nn, optim, workers, pool);
+        trainer.step(inputs, targets);
+        std::vector<double> grad;
+        for (auto & param : params) grad.push_back(param->get_grad_value());
+        optim.zero_grad();
+        return grad;
+    };
+
+    std::vector<double> reference = gradient(1);
+    std::vector<double> parallel = gradient(std::max<size_t>(max_workers, 4));
+    double max_difference = 0.0;
+    for (size_t i = 0; i < reference.size(); ++i) {
+        max_difference = std::max(max_difference, std::abs(reference[i] - parallel[i]) / (1.0 + std::abs(reference[i])));
+    }
+    std::cout << "Max relative gradient difference 1 vs " << std::max<size_t>(max_workers, 4)
+              << " workers: " << max_difference << std::endl << std::endl;
+    if (max_difference > 1e-10) return 1;
+
+    double base = 0.0;
+    for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+        ThreadPool pool(workers);
+        optimizer<double> optim(nn, 0.0);
+        DataParallelTrainer<double> trainer(nn, optim, workers, pool);
+        trainer.step(inputs, targets);
+
+        double loss = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < steps; ++s) loss = trainer.step(inputs, targets);
+        double rate = steps / seconds_since(start);
+        if (workers == 1) base = rate;
+
+        std::cout << workers << " workers: " << rate << " steps/s, speedup " << rate / base
+                  << "x, loss " << loss << std::endl;
+    }
+    return 0;
+}
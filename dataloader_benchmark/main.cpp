@@ -0,0 +1,182 @@
+#include "../mlp/dataloader.cpp"
+#include "../mlp/optimizers.cpp"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Datasets and the DataLoader: a CSV file must load like the binary file
+ * with the same samples, every epoch must visit each sample exactly once,
+ * damaged files must be rejected and failed writes reported. Then a 2 GB
+ * binary file is streamed through the loader, sequentially and shuffled,
+ * with and without the prefetching thread, alone and feeding a training
+ * loop.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void check_files(const std::string &directory) {
+    const size_t n_samples = 1000, n_features = 3;
+    std::string binary = directory + "/small.bin", csv = directory + "/small.csv";
+    {
+        DatasetWriter<double> writer(binary, n_features);
+        std::ofstream text(csv);
+        text << "a,b,c,y\n";
+        for (size_t i = 0; i < n_samples; ++i) {
+            double features[n_features] = {double(i), 0.25 * double(i), -1.5}, target = 0.5 * double(i);
+            writer.write(features, &target);
+            text << features[0] << ", " << features[1] << "," << features[2] << "," << target << "\r\n";
+        }
+    }
+
+    auto mapped = Dataset<double>::map(binary), parsed = Dataset<double>::read_csv(csv);
+    bool same = mapped->get_size() == n_samples && parsed->get_size() == n_samples &&
+                parsed->get_feature_count() == n_features && parsed->get_target_count() == 1;
+    for (size_t i = 0; same && i < n_samples; ++i) {
+        same = std::equal(mapped->get_row(i), mapped->get_row(i) + n_features + 1, parsed->get_row(i));
+    }
+    std::printf("CSV and binary file hold the same samples: %s\n", same ? "yes" : "no");
+
+    for (size_t prefetch : {0, 2}) {
+        DataLoader<double> loader(mapped, 64, true, prefetch);
+        bool exact = true;
+        std::vector<size_t> first_order;
+        for (size_t epoch = 0; epoch < 3; ++epoch) {
+            std::vector<size_t> seen(n_samples, 0), order;
+            Batch<double> batch;
+            size_t batches = 0;
+            while (loader.next(batch)) {
+                ++batches;
+                for (size_t r = 0; r < batch.inputs->get_size(); r += n_features) {
+                    size_t index = static_cast<size_t>(batch.inputs->get_data()[r]);
+                    ++seen[index];
+                    order.push_back(index);
+                    exact = exact && batch.targets->get_data()[r / n_features] == 0.5 * double(index);
+                }
+            }
+            exact = exact && batches == loader.get_batch_count();
+            for (size_t count : seen) exact = exact && count == 1;
+            if (epoch == 0) first_order = order;
+            else exact = exact && order != first_order;
+        }
+        std::printf("prefetch %zu: 3 shuffled epochs visit every sample once, in new orders: %s\n",
+                    prefetch, exact ? "yes" : "no");
+    }
+
+    {
+        std::ofstream text(csv);
+        text << "1,2,3\n4,5\n";
+    }
+    try {
+        Dataset<double>::read_csv(csv, 1, false);
+        std::printf("ragged CSV accepted\n");
+    } catch (const std::invalid_argument &error) {
+        std::printf("ragged CSV rejected: %s\n", error.what());
+    }
+    ::truncate(binary.c_str(), 64 + 999 * 4 * sizeof(double));
+    try {
+        Dataset<double>::map(binary);
+        std::printf("truncated dataset accepted\n");
+    } catch (const std::invalid_argument &error) {
+        std::printf("truncated dataset rejected: %s\n", error.what());
+    }
+    try {
+        Dataset<float>::map(binary);
+        std::printf("double dataset accepted as float\n");
+    } catch (const std::invalid_argument &error) {
+        std::printf("double dataset rejected as float: %s\n", error.what());
+    }
+
+    // Writes to /dev/full fail once the buffer is flushed.
+    double row[n_features + 1] = {};
+    try {
+        DatasetWriter<double> writer("/dev/full", n_features);
+        writer.write(row, row + n_features);
+        writer.close();
+        std::printf("failed write not reported\n");
+    } catch (const std::runtime_error &error) {
+        std::printf("failed write reported by close(): %s\n", error.what());
+    }
+    {
+        DatasetWriter<double> writer("/dev/full", n_features);
+        writer.write(row, row + n_features);
+    }
+    std::printf("failed write in the destructor does not terminate\n");
+    std::remove(binary.c_str());
+    std::remove(csv.c_str());
+}
+
+int main() {
+    const std::string directory = "/tmp";
+    check_files(directory);
+
+    const size_t n_features = 16, batch_size = 256;
+    const size_t n_samples = (size_t(2) << 30) / ((n_features + 1) * sizeof(float));
+    const std::string path = directory + "/dataloader_benchmark.bin";
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+        DatasetWriter<float> writer(path, n_features);
+        float features[n_features];
+        for (size_t i = 0; i < n_samples; ++i) {
+            float target = 0.0f;
+            for (size_t k = 0; k < n_features; ++k) {
+                features[k] = dis(gen);
+                target += (k % 2 ? -0.5f : 0.5f) * features[k];
+            }
+            writer.write(features, &target);
+        }
+    }
+    std::printf("\nwrote %zu samples of %zu floats (%.2f GB) in %.1f s\n", n_samples, n_features + 1,
+                double(n_samples * (n_features + 1) * sizeof(float)) / double(1 << 30), seconds_since(start));
+
+    start = std::chrono::steady_clock::now();
+    auto dataset = Dataset<float>::map(path);
+    std::printf("mapped in %.0f us\n\n", seconds_since(start) * 1e6);
+
+    std::printf("%-10s %-9s %12s %14s\n", "order", "prefetch", "epoch (s)", "samples/s");
+    for (bool shuffle : {false, true}) {
+        for (size_t prefetch : {0, 2}) {
+            DataLoader<float> loader(dataset, batch_size, shuffle, prefetch);
+            Batch<float> batch;
+            size_t samples = 0;
+            start = std::chrono::steady_clock::now();
+            while (loader.next(batch)) samples += batch.targets->get_size();
+            double seconds = seconds_since(start);
+            std::printf("%-10s %-9zu %12.2f %14.3g\n", shuffle ? "shuffled" : "sequential", prefetch,
+                        seconds, double(samples) / seconds);
+        }
+    }
+
+    const size_t train_batches = 20000;
+    std::printf("\ntraining NN<float> 16-32-1 with Adam on %zu shuffled batches of %zu\n",
+                train_batches, batch_size);
+    std::printf("%-9s %12s %14s %12s\n", "prefetch", "time (s)", "samples/s", "last loss");
+    for (size_t prefetch : {0, 2}) {
+        NN<float> nn;
+        nn.add_linear_layer(n_features, 32, true);
+        nn.add_linear_layer(32, 1, false);
+        Adam<float> optim(nn, 1e-3f);
+        DataLoader<float> loader(dataset, batch_size, true, prefetch);
+        Batch<float> batch;
+        float loss = 0.0f;
+        start = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < train_batches && loader.next(batch); ++b) {
+            optim.zero_grad();
+            auto value = mse_loss(nn(batch.inputs), batch.targets);
+            value->backward();
+            optim.step();
+            loss = value->get_data_value();
+        }
+        double seconds = seconds_since(start);
+        std::printf("%-9zu %12.2f %14.3g %12.3g\n", prefetch, seconds,
+                    double(train_batches * batch_size) / seconds, double(loss));
+    }
+
+    dataset.reset();
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "../autograd/expression.hpp"
+#include <chrono>
+
+/*
+ * The neuron of autograd_forward, sigmoid(x1 * w1 + x2 * w2 + b), built
+ * with the Variable operators (five nodes) and as an expression template
+ * (one node). Checks that both give the same value and gradients and
+ * reports the time per expression, with and without the backward pass.
+*/
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+template <typename Function>
+double ns_per_call(size_t n, Function &&function) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) function();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+int main() {
+    Pointer x1 = std::make_shared<Variable<double>>(2.0);
+    Pointer x2 = std::make_shared<Variable<double>>(1.25);
+    Pointer w1 = std::make_shared<Variable<double>>(0.5);
+    Pointer w2 = std::make_shared<Variable<double>>(0.75);
+    Pointer b = std::make_shared<Variable<double>>(-0.5);
+    std::vector<Pointer> leaves = {x1, x2, w1, w2, b};
+
+    auto operators = [&]() {
+        return ((x1 * w1 + x2 * w2) + b)->Sigmoid();
+    };
+    auto expression = [&]() {
+        return Variable<double>::from_expression((expr(x1) * expr(w1) + expr(x2) * expr(w2) + expr(b)).Sigmoid());
+    };
+
+    Pointer L = operators();
+    L->backward();
+    std::vector<double> expected;
+    for (auto & leaf : leaves) {
+        expected.push_back(leaf->get_grad_value());
+        leaf->set_grad(0.0);
+    }
+    Pointer E = expression();
+    E->backward();
+    double max_diff = std::abs(E->get_data_value() - L->get_data_value());
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(leaves[i]->get_grad_value() - expected[i]));
+    }
+    std::cout << "sigmoid(x1 * w1 + x2 * w2 + b) = " << E->get_data_value()
+              << ", max difference to the Variable operators: " << max_diff << std::endl;
+
+    const size_t n = 2000000;
+    double operators_forward = ns_per_call(n, [&]() { operators(); });
+    double expression_forward = ns_per_call(n, [&]() { expression(); });
+    double operators_step = ns_per_call(n, [&]() { operators()->backward(); });
+    double expression_step = ns_per_call(n, [&]() { expression()->backward(); });
+
+    std::cout << "forward:            " << operators_forward << " ns -> " << expression_forward
+              << " ns (" << operators_forward / expression_forward << "x)" << std::endl;
+    std::cout << "forward + backward: " << operators_step << " ns -> " << expression_step
+              << " ns (" << operators_step / expression_step << "x)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "../autograd/gemm.cpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+/*
+ * GFLOP/s of gemm() for square matrices from 16 up to max_size (4096 by
+ * default, first argument) with 1, 2, 4, ... threads up to the number of
+ * cores, for float and double. Every size is first checked against a
+ * naive product.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename T>
+double max_error_against_naive(size_t M, size_t N, size_t K, bool trans_a, bool trans_b) {
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<T> dis(-1.0, 1.0);
+    std::vector<T> A(M * K), B(K * N), C(M * N), reference(M * N);
+    for (auto & x : A) x = dis(gen);
+    for (auto & x : B) x = dis(gen);
+    for (auto & x : C) x = dis(gen);
+    reference = C;
+
+    size_t lda = trans_a ? M : K, ldb = trans_b ? K : N;
+    for (size_t i = 0; i < M; ++i) {
+        for (size_t j = 0; j < N; ++j) {
+            double sum = 0.0;
+            for (size_t k = 0; k < K; ++k) {
+                sum += (trans_a ? A[k * lda + i] : A[i * lda + k]) * (trans_b ? B[j * ldb + k] : B[k * ldb + j]);
+            }
+            reference[i * N + j] = 0.5 * reference[i * N + j] + 2.0 * sum;
+        }
+    }
+
+    gemm<T>(trans_a, trans_b, M, N, K, 2.0, A.data(), lda, B.data(), ldb, 0.5, C.data(), N);
+
+    double error = 0.0;
+    for (size_t i = 0; i < M * N; ++i) {
+        error = std::max(error, std::abs(double(C[i]) - double(reference[i])) / (1.0 + std::abs(double(reference[i]))));
+    }
+    return error;
+}
+
+template <typename T>
+void benchmark(const std::string &name, size_t max_size) {
+    std::cout << name << ":" << std::endl;
+
+    double error = 0.0;
+    for (size_t size : {7, 33, 100, 257}) {
+        for (int trans = 0; trans < 4; ++trans) {
+            error = std::max(error, max_error_against_naive<T>(size, size + 3, size + 5, trans & 1, trans & 2));
+        }
+    }
+    std::cout << "  max relative error against naive product: " << error << std::endl;
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < std::thread::hardware_concurrency(); threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(std::thread::hardware_concurrency());
+
+    for (size_t threads : thread_counts) {
+        ThreadPool pool(threads);
+        std::cout << "  " << threads << " thread(s):" << std::endl;
+
+        for (size_t n = 16; n <= max_size; n *= 2) {
+            AlignedVector<T> A(n * n, T(0.5)), B(n * n, T(0.25)), C(n * n, T(0.0));
+
+            size_t repeats = 1;
+            double time = 0.0;
+            while (true) {
+                auto start = std::chrono::steady_clock::now();
+                for (size_t r = 0; r < repeats; ++r) {
+                    gemm<T>(false, false, n, n, n, 1.0, A.data(), n, B.data(), n, 0.0, C.data(), n, pool);
+                }
+                time = seconds_since(start);
+                if (time > 0.2) break;
+                repeats *= 2;
+            }
+            double gflops = 2.0 * n * n * n * repeats / time * 1e-9;
+            std::cout << "    n=" << n << ": " << gflops << " GFLOP/s" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+    benchmark<float>("float", max_size);
+    benchmark<double>("double", max_size);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "../mlp/mlp.cpp"
+#include "../autograd/graph_fusion.cpp"
+#include <chrono>
+
+/*
+ * Runs GraphFusion on the per-sample loss graph of the mlp_test MLP and of
+ * a wider one. Reports the node counts before and after the pass, checks
+ * that the gradients of the fused graph match the original ones, and
+ * times the backward pass alone (on a retained graph) and a whole step
+ * (build, fuse, backward) against the unfused graph. Also checks the
+ * gradients of a fused graph with a checkpointed segment.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+void check_expression() {
+    Pointer a = std::make_shared<Variable<double>>(1.5);
+    Pointer b = std::make_shared<Variable<double>>(-0.5);
+    Pointer c = std::make_shared<Variable<double>>(2.0);
+
+    // Subtraction and division spelled as * (-1) and ^ (-1), as graphs built by hand may do.
+    auto build = [&]() {
+        Pointer scaled = std::make_shared<Variable<double>>(3.0) * std::make_shared<Variable<double>>(0.5);
+        Pointer sum = a * b + scaled * c + b;
+        Pointer difference = sum->Tanh() + a * std::make_shared<Variable<double>>(-1.0);
+        return difference * (c * b)->pow(std::make_shared<Variable<double>>(-1.0));
+    };
+    std::vector<Pointer> inputs = {a, b, c};
+
+    Pointer plain = build();
+    plain->backward();
+    std::vector<double> expected;
+    for (auto & input : inputs) {
+        expected.push_back(input->get_grad_value());
+        input->set_grad(0.0);
+    }
+
+    Pointer fused = build();
+    GraphFusion<double>::Stats stats = GraphFusion<double>::run(fused);
+    fused->backward();
+    double max_diff = std::abs(fused->get_data_value() - plain->get_data_value());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(inputs[i]->get_grad_value() - expected[i]));
+    }
+    std::cout << "(tanh(a * b + 3 * 0.5 * c + b) + a * (-1)) * (c * b) ^ (-1): " << stats.nodes_before << " -> "
+              << stats.nodes_after << " nodes, max difference: " << max_diff << std::endl;
+}
+
+// The inputs of a checkpointed segment are constants, but the parameters it reads are not.
+void check_checkpoint() {
+    NN nn;
+    nn.add_linear_layer(2, 3, true);
+    nn.add_linear_layer(3, 1, false);
+    nn.set_checkpointing(CheckpointPolicy::Fixed, 2);
+    optimizer<double> optim(nn, 0.0);
+
+    auto build = [&]() {
+        std::vector<Pointer> x = {std::make_shared<Variable<double>>(0.5), std::make_shared<Variable<double>>(-1.0)};
+        return (1.0 - nn(x)[0])->square();
+    };
+
+    optim.zero_grad();
+    build()->backward();
+    std::vector<double> expected(nn.get_parameter_grad(), nn.get_parameter_grad() + nn.get_parameter_count());
+
+    optim.zero_grad();
+    Pointer fused = build();
+    GraphFusion<double>::run(fused);
+    fused->backward();
+    double max_diff = 0.0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(nn.get_parameter_grad()[i] - expected[i]));
+    }
+    std::cout << "MLP 2-3-1 checkpointed in one segment: max gradient difference: " << max_diff << std::endl;
+}
+
+void run(size_t in_size, size_t hidden, size_t steps) {
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    optimizer<double> optim(nn, 0.0);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> sample(in_size + 1);
+    for (auto & value : sample) value = dis(gen);
+
+    auto build = [&]() {
+        std::vector<Pointer> x(in_size);
+        for (size_t i = 0; i < in_size; ++i) x[i] = std::make_shared<Variable<double>>(sample[i]);
+        return (sample[in_size] - nn(x)[0])->square();
+    };
+
+    optim.zero_grad();
+    build()->backward();
+    std::vector<double> expected(nn.get_parameter_grad(), nn.get_parameter_grad() + nn.get_parameter_count());
+
+    optim.zero_grad();
+    Pointer fused = build();
+    GraphFusion<double>::Stats stats = GraphFusion<double>::run(fused);
+    fused->backward();
+    double max_diff = 0.0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(nn.get_parameter_grad()[i] - expected[i]));
+    }
+
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, "
+              << nn.get_parameter_count() << " parameters" << std::endl;
+    std::cout << "  nodes: " << stats.nodes_before << " -> " << stats.nodes_after
+              << " (" << (double)stats.nodes_before / stats.nodes_after << "x fewer)" << std::endl;
+    std::cout << "  max gradient difference: " << max_diff << std::endl;
+
+    // Backward alone, on graphs that are kept between calls.
+    Pointer plain = build();
+    fused = build();
+    GraphFusion<double>::run(fused);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) plain->backward(true);
+    double plain_backward = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) fused->backward(true);
+    double fused_backward = seconds_since(start);
+    std::cout << "  backward: " << steps / plain_backward << " -> " << steps / fused_backward
+              << " per second (" << plain_backward / fused_backward << "x)" << std::endl;
+
+    // Whole step: the pass has to pay for itself within one backward.
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) build()->backward();
+    double plain_step = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) {
+        Pointer loss = build();
+        GraphFusion<double>::run(loss);
+        loss->backward();
+    }
+    double fused_step = seconds_since(start);
+    std::cout << "  build + backward: " << steps / plain_step << " -> " << steps / fused_step
+              << " steps per second (" << plain_step / fused_step << "x)" << std::endl;
+}
+
+int main() {
+    check_expression();
+    check_checkpoint();
+    run(4, 10, 20000);
+    run(16, 64, 500);
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+
+/*
+ * Second derivatives. Checks grad() twice, hvp() and finite differences
+ * of the gradient against each other, on a small function with every
+ * kind of op and on the per-sample loss of an MLP with respect to its
+ * parameters, and times a Hessian-vector product against a gradient:
+ * forward over reverse with hvp(), and reverse over reverse, which
+ * builds the gradient graph with grad() and runs backward() on
+ * gradient . v. The sweeps alone are also timed on a kept graph.
+*/
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+double us_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// H * v as d/dt grad(x + t v) at t = 0, by central differences.
+template <typename Build>
+std::vector<double> finite_difference_hvp(Build &&build, const std::vector<Pointer> &inputs, const std::vector<double> &v) {
+    const double h = 1e-5;
+    std::vector<double> x, result(inputs.size());
+    for (auto & input : inputs) x.push_back(input->get_data_value());
+
+    for (double sign : {1.0, -1.0}) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            inputs[i]->set_data(x[i] + sign * h * v[i]);
+            inputs[i]->set_grad(0.0);
+        }
+        build()->backward();
+        for (size_t i = 0; i < inputs.size(); ++i) result[i] += sign * inputs[i]->get_grad_value() / (2.0 * h);
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        inputs[i]->set_data(x[i]);
+        inputs[i]->set_grad(0.0);
+    }
+    return result;
+}
+
+// Reverse over reverse: backward() through gradient . v.
+std::vector<double> reverse_hvp(const Pointer &output, const std::vector<Pointer> &inputs, const std::vector<double> &v) {
+    std::vector<Pointer> grads = output->grad(inputs);
+    Pointer product = grads[0] * v[0];
+    for (size_t i = 1; i < grads.size(); ++i) product = product + grads[i] * v[i];
+
+    // Retained, since the gradient graph shares the nodes of the graph of output.
+    for (auto & input : inputs) input->set_grad(0.0);
+    product->backward(true);
+    std::vector<double> result;
+    for (auto & input : inputs) {
+        result.push_back(input->get_grad_value());
+        input->set_grad(0.0);
+    }
+    return result;
+}
+
+double max_difference(const std::vector<double> &a, const std::vector<double> &b) {
+    double result = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) result = std::max(result, std::abs(a[i] - b[i]));
+    return result;
+}
+
+void check_function() {
+    std::vector<Pointer> inputs = {
+        std::make_shared<Variable<double>>(0.7),
+        std::make_shared<Variable<double>>(1.3),
+        std::make_shared<Variable<double>>(-0.4)
+    };
+    std::vector<double> v = {0.5, -1.0, 2.0};
+    auto build = [&]() {
+        Pointer &x = inputs[0], &y = inputs[1], &z = inputs[2];
+        Pointer u = x * y - z->square() / y + pow(y, x) + 2.0 / (x + 3.0);
+        return Tanh(u) * exp(z * 0.5) + log(Sigmoid(x - z) + ReLU(y)) - (-z)->pow(2.0) * 1.5;
+    };
+
+    Pointer output = build();
+    std::vector<double> forward = output->hvp(inputs, v);
+    std::vector<double> reverse = reverse_hvp(output, inputs, v);
+    std::vector<double> finite = finite_difference_hvp(build, inputs, v);
+
+    // d^2/dx^2 of x^3 y is 6 x y: the second derivative of a gradient graph.
+    Pointer cube = inputs[0]->pow(3.0) * inputs[1];
+    Pointer dx = cube->grad({inputs[0]})[0];
+    Pointer dxx = dx->grad({inputs[0]})[0];
+
+    std::cout << "Function of 3 inputs" << std::endl;
+    std::cout << "  H v:";
+    for (double value : forward) std::cout << " " << value;
+    std::cout << std::endl;
+    std::cout << "  hvp vs grad twice: " << max_difference(forward, reverse)
+              << ", vs finite differences: " << max_difference(forward, finite) << std::endl;
+    std::cout << "  d2(x^3 y)/dx2 = " << dxx->get_data_value() << " (6 x y = "
+              << 6.0 * inputs[0]->get_data_value() * inputs[1]->get_data_value() << ")" << std::endl;
+}
+
+void run(size_t in_size, size_t hidden, size_t steps) {
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    const std::vector<Pointer> &parameters = nn.parameters();
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> sample(in_size + 1), v(parameters.size());
+    for (auto & value : sample) value = dis(gen);
+    for (auto & value : v) value = dis(gen);
+
+    auto build = [&]() {
+        std::vector<Pointer> x(in_size);
+        for (size_t i = 0; i < in_size; ++i) x[i] = std::make_shared<Variable<double>>(sample[i]);
+        return (sample[in_size] - nn(x)[0])->square();
+    };
+
+    Pointer loss = build();
+    std::vector<double> forward = loss->hvp(parameters, v);
+    std::vector<double> reverse = reverse_hvp(loss, parameters, v);
+    std::vector<double> finite = finite_difference_hvp(build, parameters, v);
+
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, "
+              << parameters.size() << " parameters" << std::endl;
+    std::cout << "  hvp vs grad twice: " << max_difference(forward, reverse)
+              << ", vs finite differences: " << max_difference(forward, finite) << std::endl;
+
+    // Each step builds the graph, as in training.
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) build()->backward();
+    double gradient = us_since(start) / steps;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) build()->hvp(parameters, v);
+    double forward_over_reverse = us_since(start) / steps;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) reverse_hvp(build(), parameters, v);
+    double reverse_over_reverse = us_since(start) / steps;
+
+    std::cout << "  gradient: " << gradient << " us" << std::endl;
+    std::cout << "  hvp, forward over reverse: " << forward_over_reverse << " us ("
+              << forward_over_reverse / gradient << "x gradient)" << std::endl;
+    std::cout << "  hvp, reverse over reverse: " << reverse_over_reverse << " us ("
+              << reverse_over_reverse / gradient << "x gradient)" << std::endl;
+
+    // The sweeps alone, on a graph that is kept between calls.
+    loss = build();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) loss->backward(true);
+    double backward = us_since(start) / steps;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) loss->hvp(parameters, v);
+    double sweeps = us_since(start) / steps;
+    std::cout << "  on a kept graph: backward " << backward << " us, hvp " << sweeps << " us ("
+              << sweeps / backward << "x)" << std::endl;
+}
+
+int main() {
+    check_function();
+    run(4, 10, 5000);
+    run(16, 64, 200);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "../mlp/inference.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+/*
+ * Single-sample prediction latency of the mlp_test model (4-10-10-1):
+ * the Variable forward pass building its graph, the same pass and the
+ * tensor pass inside a NoGrad scope, and an InferenceNN. Every path is
+ * timed call by call, and global operator new counts the heap
+ * allocations per call.
+*/
+
+static size_t allocations = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    ++allocations;
+    if (void *ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+template <typename Predict>
+void measure(const char *name, size_t calls, Predict predict) {
+    for (size_t i = 0; i < calls / 10; ++i) predict(i);
+
+    std::vector<double> latencies(calls);
+    size_t before = allocations;
+    for (size_t i = 0; i < calls; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        predict(i);
+        latencies[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    double per_call = static_cast<double>(allocations - before) / static_cast<double>(calls);
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": p50 " << static_cast<long long>(latencies[calls / 2]) << " ns, p99 "
+              << static_cast<long long>(latencies[calls * 99 / 100])
+              << " ns, " << per_call << " allocations per call" << std::endl;
+}
+
+int main() {
+    NN<double> nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+    InferenceNN<double> frozen(nn);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dis(-5.0, 5.0);
+    const size_t n_samples = 1024, calls = 100000;
+    std::vector<double> samples(n_samples * 4);
+    for (auto & value : samples) value = dis(gen);
+
+    std::vector<std::vector<std::shared_ptr<Variable<double>>>> variables(n_samples);
+    std::vector<std::shared_ptr<Tensor<double>>> tensors(n_samples);
+    for (size_t s = 0; s < n_samples; ++s) {
+        for (size_t k = 0; k < 4; ++k) variables[s].push_back(std::make_shared<Variable<double>>(samples[s * 4 + k]));
+        std::vector<double> row(samples.begin() + s * 4, samples.begin() + s * 4 + 4);
+        tensors[s] = std::make_shared<Tensor<double>>(std::vector<size_t>{1, 4}, row);
+    }
+
+    double max_difference = 0.0;
+    for (size_t s = 0; s < n_samples; ++s) {
+        double expected = nn(variables[s])[0]->get_data_value(), output;
+        frozen(&samples[s * 4], &output);
+        max_difference = std::max(max_difference, std::abs(output - expected));
+        {
+            NoGrad no_grad;
+            max_difference = std::max(max_difference, std::abs(nn(variables[s])[0]->get_data_value() - expected));
+            max_difference = std::max(max_difference, std::abs(nn(tensors[s])->get_data_value() - expected));
+        }
+    }
+    std::cout << "Max difference to the Variable forward pass: " << max_difference << std::endl << std::endl;
+
+    double sink = 0.0;
+    measure("Variable graph   ", calls, [&](size_t i) {
+        sink += nn(variables[i % n_samples])[0]->get_data_value();
+    });
+    {
+        NoGrad no_grad;
+        measure("Variable, NoGrad ", calls, [&](size_t i) {
+            sink += nn(variables[i % n_samples])[0]->get_data_value();
+        });
+        measure("Tensor, NoGrad   ", calls, [&](size_t i) {
+            sink += nn(tensors[i % n_samples])->get_data_value();
+        });
+    }
+    measure("InferenceNN      ", calls, [&](size_t i) {
+        double output;
+        frozen(&samples[(i % n_samples) * 4], &output);
+        sink += output;
+    });
+    std::cout << std::endl << "(checksum " << sink << ")" << std::endl;
+    return 0;
+}
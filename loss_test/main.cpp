@@ -0,0 +1,227 @@
+#include "../mlp/mlp.cpp"
+#include "../mlp/optimizers.cpp"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Fused losses against the same losses composed of scalar ops: equal
+ * values and gradients where the composition is finite, finite results
+ * where it overflows, and one node instead of several per output. Then
+ * sqrt and softmax are checked against finite differences, softmax also
+ * through a second pass that reaches only one output, and a small
+ * classifier is trained with cross_entropy_loss.
+*/
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+std::vector<Pointer> leaves(const std::vector<double> &values) {
+    std::vector<Pointer> result;
+    for (double value : values) result.push_back(std::make_shared<Variable<double>>(value));
+    return result;
+}
+
+size_t count_nodes(const Pointer &root) {
+    std::set<Pointer> seen{root};
+    std::vector<Pointer> stack{root};
+    while (!stack.empty()) {
+        Pointer node = stack.back();
+        stack.pop_back();
+        for (auto & parent : node->get_node_parents()) {
+            if (seen.insert(parent).second) stack.push_back(parent);
+        }
+    }
+    return seen.size();
+}
+
+// The loss and gradient of a fused and a composed version, side by side.
+template <typename Fused, typename Composed>
+void compare(const char *name, const std::vector<double> &values, Fused fused, Composed composed) {
+    std::vector<Pointer> x = leaves(values), y = leaves(values);
+    Pointer a = fused(x), b = composed(y);
+    size_t a_nodes = count_nodes(a) - x.size(), b_nodes = count_nodes(b) - y.size();
+    a->backward();
+    b->backward();
+
+    double difference = std::abs(a->get_data_value() - b->get_data_value());
+    for (size_t i = 0; i < x.size(); ++i) {
+        difference = std::max(difference, std::abs(x[i]->get_grad_value() - y[i]->get_grad_value()));
+    }
+    std::printf("%-22s fused %-12.6g composed %-12.6g max difference %-10.3g nodes %zu vs %zu\n", name,
+                a->get_data_value(), b->get_data_value(), difference, a_nodes, b_nodes);
+}
+
+Pointer composed_cross_entropy(const std::vector<Pointer> &z, size_t target) {
+    Pointer sum = z[0]->exp();
+    for (size_t i = 1; i < z.size(); ++i) sum = sum + z[i]->exp();
+    return -(z[target]->exp() / sum)->log();
+}
+
+Pointer composed_bce(const std::vector<Pointer> &z, const std::vector<double> &t) {
+    Pointer sum;
+    for (size_t i = 0; i < z.size(); ++i) {
+        Pointer p = z[i]->Sigmoid();
+        Pointer term = -(t[i] * p->log() + (1.0 - t[i]) * (1.0 - p)->log());
+        sum = sum ? sum + term : term;
+    }
+    return sum / double(z.size());
+}
+
+void check_losses() {
+    std::vector<double> outputs = {0.5, -1.25, 2.0, 0.1, -0.3}, targets = {0.0, -1.0, 3.5, 0.1, 0.4};
+    std::vector<double> probabilities = {0.1, 0.2, 0.3, 0.4, 0.0};
+
+    compare("mse", outputs, [&](auto &x) { return mse_loss(x, targets); }, [&](auto &x) {
+        Pointer sum = (x[0] - targets[0])->pow(2.0);
+        for (size_t i = 1; i < x.size(); ++i) sum = sum + (x[i] - targets[i])->pow(2.0);
+        return sum / double(x.size());
+    });
+    compare("l1", outputs, [&](auto &x) { return l1_loss(x, targets); }, [&](auto &x) {
+        Pointer sum = (x[0] - targets[0])->square()->sqrt();
+        for (size_t i = 1; i < x.size(); ++i) sum = sum + (x[i] - targets[i])->square()->sqrt();
+        return sum / double(x.size());
+    });
+    compare("huber (all quadratic)", outputs, [&](auto &x) { return huber_loss(x, targets, 10.0); }, [&](auto &x) {
+        Pointer sum = 0.5 * (x[0] - targets[0])->square();
+        for (size_t i = 1; i < x.size(); ++i) sum = sum + 0.5 * (x[i] - targets[i])->square();
+        return sum / double(x.size());
+    });
+    compare("huber (mixed)", outputs, [&](auto &x) { return huber_loss(x, targets, 0.5); }, [&](auto &x) {
+        Pointer sum;
+        for (size_t i = 0; i < x.size(); ++i) {
+            Pointer error = x[i] - targets[i];
+            Pointer term = std::abs(outputs[i] - targets[i]) <= 0.5 ? 0.5 * error->square()
+                                                                    : 0.5 * (error->square()->sqrt() - 0.25);
+            sum = sum ? sum + term : term;
+        }
+        return sum / double(x.size());
+    });
+    compare("cross entropy", outputs, [&](auto &x) { return cross_entropy_loss(x, 2); },
+            [&](auto &x) { return composed_cross_entropy(x, 2); });
+    compare("soft cross entropy", outputs, [&](auto &x) { return cross_entropy_loss(x, probabilities); }, [&](auto &x) {
+        Pointer sum;
+        for (size_t k = 0; k < x.size(); ++k) {
+            Pointer term = probabilities[k] * composed_cross_entropy(x, k);
+            sum = sum ? sum + term : term;
+        }
+        return sum;
+    });
+    std::vector<double> bits = {1.0, 0.0, 1.0, 0.5, 0.0};
+    compare("bce with logits", outputs, [&](auto &x) { return bce_with_logits_loss(x, bits); },
+            [&](auto &x) { return composed_bce(x, bits); });
+
+    std::printf("\nlarge logits:\n");
+    std::vector<double> large = {1000.0, -1000.0, 500.0, 0.0, 20.0};
+    compare("cross entropy", large, [&](auto &x) { return cross_entropy_loss(x, 2); },
+            [&](auto &x) { return composed_cross_entropy(x, 2); });
+    compare("bce with logits", large, [&](auto &x) { return bce_with_logits_loss(x, bits); },
+            [&](auto &x) { return composed_bce(x, bits); });
+}
+
+// Central differences of f at the values, against the gradient of f by backward().
+template <typename Function>
+double gradient_error(const std::vector<double> &values, Function f) {
+    std::vector<Pointer> x = leaves(values);
+    f(x)->backward();
+    double error = 0.0, h = 1e-6;
+    for (size_t i = 0; i < values.size(); ++i) {
+        std::vector<double> plus = values, minus = values;
+        plus[i] += h;
+        minus[i] -= h;
+        double numeric = (f(leaves(plus))->get_data_value() - f(leaves(minus))->get_data_value()) / (2.0 * h);
+        error = std::max(error, std::abs(numeric - x[i]->get_grad_value()));
+    }
+    return error;
+}
+
+void check_primitives() {
+    std::vector<double> values = {0.3, 1.7, -0.4, 2.2};
+    std::vector<double> weights = {1.0, -2.0, 0.5, 3.0};
+    auto weighted_softmax = [&](const std::vector<Pointer> &x) {
+        std::vector<Pointer> y = softmax(x);
+        Pointer sum = y[0] * weights[0];
+        for (size_t i = 1; i < y.size(); ++i) sum = sum + y[i] * weights[i];
+        return sum;
+    };
+    std::printf("\nsoftmax gradient vs finite differences: %.3g\n", gradient_error(values, weighted_softmax));
+
+    // The second pass only reaches s[0]: the gradient s[1] got from the first must not be used again.
+    std::vector<Pointer> ab = leaves({1.0, 0.5});
+    std::vector<Pointer> s = softmax(ab);
+    (s[0] + s[1])->backward(true);
+    (s[0] * 1.0)->backward(true);
+    std::printf("softmax gradient of s[0] after a pass through both outputs: %.6g %.6g\n",
+                ab[0]->get_grad_value(), ab[1]->get_grad_value());
+
+    double total = 0.0;
+    for (auto & y : softmax(leaves({1000.0, 999.0, -1000.0}))) total += y->get_data_value();
+    std::printf("softmax of large logits sums to %.17g\n", total);
+
+    auto roots = [](const std::vector<Pointer> &x) { return x[0]->sqrt() * x[1]->sqrt() + sqrt(x[2] * x[3]); };
+    std::printf("sqrt gradient vs finite differences: %.3g\n", gradient_error({0.3, 1.7, 0.4, 2.2}, roots));
+
+    Pointer x = std::make_shared<Variable<double>>(2.0);
+    Pointer dx = x->sqrt()->grad({x})[0];
+    Pointer d2x = dx->grad({x})[0];
+    double hvp = x->sqrt()->hvp({x}, {1.0})[0];
+    std::printf("second derivative of sqrt at 2: grad %.12g, hvp %.12g, exact %.12g\n",
+                d2x->get_data_value(), hvp, -0.25 * std::pow(2.0, -1.5));
+}
+
+// Three Gaussian clusters in the plane, one class each.
+void train_classifier() {
+    std::mt19937 gen(42);
+    std::normal_distribution<double> noise(0.0, 0.6);
+    const double centers[3][2] = {{-2.0, 0.0}, {2.0, 0.0}, {0.0, 2.5}};
+    std::vector<std::vector<Pointer>> X;
+    std::vector<size_t> Y;
+    for (size_t i = 0; i < 300; ++i) {
+        size_t label = i % 3;
+        X.push_back(leaves({centers[label][0] + noise(gen), centers[label][1] + noise(gen)}));
+        Y.push_back(label);
+    }
+
+    std::printf("\nclassifier 2-16-3 trained with cross_entropy_loss:\n");
+    for (bool fused : {true, false}) {
+        NN<double> nn;
+        nn.add_linear_layer(2, 16, true);
+        nn.add_linear_layer(16, 3, false);
+        Adam<double> optim(nn, 1e-2);
+
+        auto start = std::chrono::steady_clock::now();
+        double loss = 0.0;
+        for (size_t epoch = 0; epoch < 20; ++epoch) {
+            loss = 0.0;
+            for (size_t j = 0; j < X.size(); ++j) {
+                std::vector<Pointer> logits = nn(X[j]);
+                Pointer value = fused ? cross_entropy_loss(logits, Y[j]) : composed_cross_entropy(logits, Y[j]);
+                loss += value->get_data_value() / double(X.size());
+                optim.zero_grad();
+                value->backward();
+                optim.step();
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t correct = 0;
+        {
+            NoGrad no_grad;
+            for (size_t j = 0; j < X.size(); ++j) {
+                std::vector<Pointer> logits = nn(X[j]);
+                size_t best = 0;
+                for (size_t k = 1; k < logits.size(); ++k) {
+                    if (logits[k]->get_data_value() > logits[best]->get_data_value()) best = k;
+                }
+                correct += best == Y[j];
+            }
+        }
+        std::printf("%-9s final loss %.4f, accuracy %.1f%%, %.1f us per step\n", fused ? "fused" : "composed",
+                    loss, 100.0 * double(correct) / double(X.size()), 1e6 * seconds / double(20 * X.size()));
+    }
+}
+
+int main() {
+    check_losses();
+    check_primitives();
+    train_classifier();
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "../mlp/optimizers.cpp"
+#include <chrono>
+
+/*
+ * Mixed precision with float master weights. Trains the mlp_batch_test
+ * task with NN<float> in full precision and with BFloat16 and Float16
+ * weights (Float16 with dynamic loss scaling), times the tensor forward
+ * and backward passes of one large Linear layer for each weight format,
+ * and shows the loss scale recovering from a scale that overflows.
+ *
+ * The Makefile builds with -Wdouble-promotion, so a float model that
+ * silently computes in double does not compile.
+*/
+
+typedef std::shared_ptr<Tensor<float>> Pointer;
+
+const char *precision_name(Precision precision) {
+    switch (precision) {
+        case Precision::Full: return "float";
+        case Precision::BFloat16: return "bfloat16";
+        case Precision::Float16: return "float16";
+    }
+    return "";
+}
+
+void train(Precision precision) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dis(-2.0f, 2.0f);
+
+    size_t n_samples = 200, batch = 20;
+    std::vector<Pointer> inputs, targets;
+    for (size_t i = 0; i < n_samples; i += batch) {
+        std::vector<float> x(batch * 4), y(batch);
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t k = 0; k < 4; ++k) x[j * 4 + k] = dis(gen);
+            y[j] = x[j * 4] * x[j * 4 + 1] - x[j * 4 + 2] + x[j * 4 + 3] * x[j * 4 + 3];
+        }
+        inputs.push_back(std::make_shared<Tensor<float>>(std::vector<size_t>{batch, 4}, x));
+        targets.push_back(std::make_shared<Tensor<float>>(std::vector<size_t>{batch, 1}, y));
+    }
+
+    NN<float> nn;
+    nn.add_linear_layer(4, 32, true);
+    nn.add_linear_layer(32, 32, true);
+    nn.add_linear_layer(32, 1, false);
+    nn.set_precision(precision);
+
+    Adam<float> optim(nn, 3e-3f);
+    if (precision == Precision::Float16) optim.enable_loss_scaling();
+
+    float loss_per_epoch = 0.0f;
+    for (size_t epoch = 0; epoch < 300; ++epoch) {
+        loss_per_epoch = 0.0f;
+        for (size_t j = 0; j < inputs.size(); ++j) {
+            Pointer loss = mse_loss(nn(inputs[j]), targets[j]);
+            loss_per_epoch += loss->get_data_value() / static_cast<float>(inputs.size());
+            optim.zero_grad();
+            optim.scale_loss(loss)->backward();
+            optim.step();
+        }
+    }
+    std::cout << "  " << precision_name(precision) << " weights: final mse " << loss_per_epoch
+              << ", loss scale " << optim.get_loss_scale() << std::endl;
+}
+
+void time_layer(size_t batch, size_t size, size_t steps) {
+    std::cout << "Linear " << size << " x " << size << ", batch " << batch << std::endl;
+
+    NN<float> nn;
+    nn.add_linear_layer(size, size, false);
+    std::vector<float> values(batch * size, 0.5f);
+    Pointer x = std::make_shared<Tensor<float>>(std::vector<size_t>{batch, size}, values);
+
+    double full_forward = 0.0, full_step = 0.0;
+    for (Precision precision : {Precision::Full, Precision::BFloat16, Precision::Float16}) {
+        nn.set_precision(precision);
+        size_t weight_bytes = size * size * (precision == Precision::Full ? sizeof(float) : 2);
+
+        nn(x)->mean()->backward();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < steps; ++i) nn(x);
+        double forward = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < steps; ++i) nn(x)->mean()->backward();
+        double step = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+        if (precision == Precision::Full) full_forward = forward, full_step = step;
+
+        std::cout << "  " << precision_name(precision) << " weights (" << weight_bytes / 1024 << " kB): "
+                  << forward << " ms forward (" << full_forward / forward << "x), "
+                  << step << " ms forward + backward (" << full_step / step << "x)" << std::endl;
+    }
+}
+
+void loss_scale_recovery() {
+    NN<float> nn;
+    nn.add_linear_layer(4, 8, true);
+    nn.add_linear_layer(8, 1, false);
+    nn.set_precision(Precision::Float16);
+
+    optimizer<float> optim(nn, 1e-3f);
+    optim.enable_loss_scaling(1e38f, 1000);
+    Pointer x = std::make_shared<Tensor<float>>(std::vector<size_t>{4, 4}, std::vector<float>(16, 1.0f));
+    Pointer y = std::make_shared<Tensor<float>>(std::vector<size_t>{4, 1}, 10.0f);
+
+    size_t skipped = 0;
+    for (size_t i = 0; i < 200; ++i) {
+        optim.zero_grad();
+        optim.scale_loss(mse_loss(nn(x), y))->backward();
+        skipped += !optim.step();
+    }
+    std::cout << "Loss scale starting at 1e38: " << skipped << " steps skipped, scale "
+              << optim.get_loss_scale() << std::endl;
+}
+
+int main() {
+    std::cout << "x1 * x2 - x3 + x4^2, 4-32-32-1 MLP, Adam, 300 epochs" << std::endl;
+    for (Precision precision : {Precision::Full, Precision::BFloat16, Precision::Float16}) train(precision);
+
+    time_layer(1, 2048, 100);
+    time_layer(8, 2048, 50);
+    time_layer(64, 2048, 20);
+    loss_scale_recovery();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "data_parallel.hpp"
+
+/*
+ * n_workers = 0 uses one worker per thread of the pool.
+*/
+template <typename T>
+DataParallelTrainer<T>::DataParallelTrainer(NN<T> &model, optimizer<T> &optim, size_t n_workers, ThreadPool &pool)
+    : model_(model), optimizer_(optim), pool_(pool) {
+    n_workers_ = n_workers == 0 ? pool.get_size() : n_workers;
+    replicas_.resize(n_workers_);
+    shard_weights_.resize(n_workers_);
+    shard_losses_.resize(n_workers_);
+
+    // The parameter tensors follow the layout of the flat buffer.
+    std::vector<std::shared_ptr<Tensor<T>>> tensors = model_.parameter_tensors();
+    for (size_t t = 0, offset = 0; t < tensors.size(); offset += tensors[t++]->get_size()) {
+        for (size_t begin = 0; begin < tensors[t]->get_size(); begin += CHUNK_SIZE) {
+            chunks_.push_back({t, begin, std::min(begin + CHUNK_SIZE, tensors[t]->get_size()), offset + begin});
+        }
+    }
+    optimizer_.zero_grad();
+}
+
+template <typename T>
+size_t DataParallelTrainer<T>::get_workers() const {
+    return n_workers_;
+}
+
+/*
+ * Forward and backward of the rows [row_begin, row_end) on the replica of
+ * the worker. An empty shard leaves the replica with zero weight.
+*/
+template <typename T>
+void DataParallelTrainer<T>::run_shard(size_t worker, const std::shared_ptr<Tensor<T>> &inputs,
+                                       const std::shared_ptr<Tensor<T>> &targets, size_t row_begin, size_t row_end) {
+    shard_weights_[worker] = T(0.0);
+    shard_losses_[worker] = T(0.0);
+    if (row_begin == row_end) return;
+
+    size_t in_features = inputs->get_size() / inputs->get_shape()[0];
+    size_t out_features = targets->get_size() / targets->get_shape()[0];
+    size_t rows = row_end - row_begin;
+
+    auto x = std::make_shared<Tensor<T>>(std::vector<size_t>{rows, in_features});
+    auto y = std::make_shared<Tensor<T>>(std::vector<size_t>{rows, out_features});
+    std::copy(inputs->get_data() + row_begin * in_features, inputs->get_data() + row_end * in_features, x->get_data());
+    std::copy(targets->get_data() + row_begin * out_features, targets->get_data() + row_end * out_features, y->get_data());
+
+    replicas_[worker] = model_.parameter_tensors();
+    auto loss = mse_loss(model_(x, replicas_[worker]), y);
+    loss->backward();
+
+    shard_weights_[worker] = T(rows) / T(inputs->get_shape()[0]);
+    shard_losses_[worker] = loss->get_data_value();
+}
+
+template <typename T>
+void DataParallelTrainer<T>::all_reduce() {
+    pool_.parallel_for(chunks_.size(), [&](size_t c) {
+        const Chunk &chunk = chunks_[c];
+        T *__restrict sum = model_.get_parameter_grad() + chunk.offset;
+
+        for (size_t w = 0; w < n_workers_; ++w) {
+            if (shard_weights_[w] == T(0.0)) continue;
+            const T *__restrict grad = replicas_[w][chunk.tensor]->get_grad() + chunk.begin;
+            const T weight = shard_weights_[w];
+            for (size_t i = 0; i < chunk.end - chunk.begin; ++i) sum[i] += weight * grad[i];
+        }
+    });
+}
+
+/*
+ * One synchronous step on a (batch, in) input and (batch, out) target:
+ * returns the MSE over the whole batch.
+*/
+template <typename T>
+T DataParallelTrainer<T>::step(const std::shared_ptr<Tensor<T>> &inputs, const std::shared_ptr<Tensor<T>> &targets) {
+    if (inputs->get_shape().size() != 2 || targets->get_shape().size() != 2 ||
+        inputs->get_shape()[0] != targets->get_shape()[0]) {
+        throw std::invalid_argument("DataParallelTrainer expects (batch, in) inputs and (batch, out) targets with the same batch");
+    }
+
+    size_t batch = inputs->get_shape()[0];
+    size_t shard = (batch + n_workers_ - 1) / n_workers_;
+
+    pool_.parallel_for(n_workers_, [&](size_t worker) {
+        size_t row_begin = std::min(batch, worker * shard);
+        size_t row_end = std::min(batch, row_begin + shard);
+        run_shard(worker, inputs, targets, row_begin, row_end);
+    });
+
+    // Gradients are added, so accumulation_steps of the optimizer still applies.
+    all_reduce();
+    if (optimizer_.step()) optimizer_.zero_grad();
+
+    T loss = T(0.0);
+    for (size_t w = 0; w < n_workers_; ++w) loss += shard_weights_[w] * shard_losses_[w];
+    return loss;
+}
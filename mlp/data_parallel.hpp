@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mlp.cpp"
+
+/*
+ * Synchronous data-parallel training of an NN on tensor batches.
+ *
+ * step() splits the batch into one shard of rows per worker. Every worker
+ * runs forward and backward on its own replica of the parameters
+ * (NN::parameter_tensors()), so gradients are accumulated in buffers owned
+ * by that worker and the shared Variables are only read.
+ *
+ * The replica gradients are then all-reduced reduce-scatter style: the
+ * parameters are cut into chunks, every chunk is summed over all workers by
+ * a single task into the flat gradient buffer of the model, so no two
+ * threads touch the same gradient and no lock is needed. Each shard is
+ * weighted by its share of the batch, which gives exactly the gradient of
+ * the mean loss over the whole batch. Finally the optimizer step is
+ * applied and, when it updated the parameters, the gradients are reset.
+*/
+
+template <typename T = double>
+class DataParallelTrainer {
+private:
+    NN<T> model_;
+    optimizer<T> &optimizer_;
+    ThreadPool &pool_;
+    size_t n_workers_;
+
+    std::vector<std::vector<std::shared_ptr<Tensor<T>>>> replicas_;
+    std::vector<T> shard_weights_;
+    std::vector<T> shard_losses_;
+
+    // Elements [begin, end) of a parameter tensor, at offset in the flat buffer.
+    struct Chunk {
+        size_t tensor;
+        size_t begin;
+        size_t end;
+        size_t offset;
+    };
+    std::vector<Chunk> chunks_;
+
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    void run_shard(size_t worker, const std::shared_ptr<Tensor<T>> &inputs,
+                   const std::shared_ptr<Tensor<T>> &targets, size_t row_begin, size_t row_end);
+    void all_reduce();
+
+public:
+    DataParallelTrainer(NN<T> &model, optimizer<T> &optim, size_t n_workers = 0,
+                        ThreadPool &pool = ThreadPool::global());
+
+    size_t get_workers() const;
+    T step(const std::shared_ptr<Tensor<T>> &inputs, const std::shared_ptr<Tensor<T>> &targets);
+};
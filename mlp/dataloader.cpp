@@ -0,0 +1,323 @@
+#pragma once
+
+#include "dataloader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char DATASET_FILE_MAGIC[8] = {'A', 'G', 'R', 'A', 'D', 'D', 'S', '\0'};
+constexpr uint32_t DATASET_FILE_BYTE_ORDER = 0x01020304;
+constexpr size_t DATASET_FILE_ALIGNMENT = 64;
+
+template <typename T>
+Dataset<T>::Dataset() {
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+    rows_ = nullptr;
+    n_samples_ = 0;
+    n_features_ = 0;
+    n_targets_ = 0;
+}
+
+template <typename T>
+Dataset<T>::~Dataset() {
+    if (mapping_) ::munmap(mapping_, mapping_size_);
+}
+
+/*
+ * Maps the whole file read-only into dataset.mapping_; an empty file maps
+ * to nothing.
+*/
+template <typename T>
+void Dataset<T>::map_file(const std::string &path, Dataset<T> &dataset) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Dataset: cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Dataset: cannot stat " + path + ": " + std::strerror(errno));
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void *mapping = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Dataset: cannot map " + path + ": " + std::strerror(errno));
+    }
+    dataset.mapping_ = mapping;
+    dataset.mapping_size_ = size;
+}
+
+template <typename T>
+std::shared_ptr<Dataset<T>> Dataset<T>::map(const std::string &path) {
+    std::shared_ptr<Dataset<T>> dataset(new Dataset<T>());
+    map_file(path, *dataset);
+
+    DatasetFileHeader header;
+    if (dataset->mapping_size_ < sizeof(header)) {
+        throw std::invalid_argument("Dataset: not a dataset file");
+    }
+    std::memcpy(&header, dataset->mapping_, sizeof(header));
+    if (std::memcmp(header.magic, DATASET_FILE_MAGIC, sizeof(DATASET_FILE_MAGIC)) != 0) {
+        throw std::invalid_argument("Dataset: not a dataset file");
+    }
+    if (header.version != DATASET_FILE_VERSION || header.byte_order != DATASET_FILE_BYTE_ORDER ||
+        header.element_size != sizeof(T)) {
+        throw std::invalid_argument("Dataset: written with another version, byte order or element type");
+    }
+
+    // Sizes are checked by division, so that no product can overflow.
+    size_t available = dataset->mapping_size_ - std::min(dataset->mapping_size_, static_cast<size_t>(header.data_offset));
+    size_t row = header.n_features + header.n_targets;
+    if (header.data_offset < sizeof(header) || header.data_offset % alignof(T) != 0 || row < header.n_features ||
+        (row && header.n_samples > available / sizeof(T) / row)) {
+        throw std::invalid_argument("Dataset: truncated");
+    }
+
+    dataset->rows_ = reinterpret_cast<const T *>(static_cast<const char *>(dataset->mapping_) + header.data_offset);
+    dataset->n_samples_ = header.n_samples;
+    dataset->n_features_ = header.n_features;
+    dataset->n_targets_ = header.n_targets;
+    return dataset;
+}
+
+template <typename T>
+std::shared_ptr<Dataset<T>> Dataset<T>::read_csv(const std::string &path, size_t n_targets, bool has_header) {
+    std::shared_ptr<Dataset<T>> dataset(new Dataset<T>());
+    map_file(path, *dataset);
+
+    const char *text = static_cast<const char *>(dataset->mapping_);
+    const char *end = text + dataset->mapping_size_;
+    size_t columns = 0, line = 0;
+
+    for (const char *begin = text; begin < end; ++line) {
+        const char *line_end = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        if (!line_end) line_end = end;
+        const char *cursor = begin;
+        begin = line_end + 1;
+        if ((line == 0 && has_header) || cursor == line_end || (*cursor == '\r' && cursor + 1 == line_end)) continue;
+
+        size_t count = 0;
+        while (true) {
+            while (cursor < line_end && (*cursor == ' ' || *cursor == '\t')) ++cursor;
+            T value;
+            auto [next, error] = std::from_chars(cursor, line_end, value);
+            if (error != std::errc()) {
+                throw std::invalid_argument("Dataset::read_csv: line " + std::to_string(line + 1) + ": not a number");
+            }
+            dataset->values_.push_back(value);
+            ++count;
+
+            cursor = next;
+            while (cursor < line_end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) ++cursor;
+            if (cursor == line_end) break;
+            if (*cursor++ != ',') {
+                throw std::invalid_argument("Dataset::read_csv: line " + std::to_string(line + 1) + ": expected a comma");
+            }
+        }
+
+        if (columns == 0) columns = count;
+        if (count != columns || columns <= n_targets) {
+            throw std::invalid_argument("Dataset::read_csv: line " + std::to_string(line + 1) + ": expected " +
+                                        std::to_string(std::max(columns, n_targets + 1)) + " columns");
+        }
+    }
+
+    ::munmap(dataset->mapping_, dataset->mapping_size_);
+    dataset->mapping_ = nullptr;
+    dataset->rows_ = dataset->values_.data();
+    dataset->n_samples_ = columns ? dataset->values_.size() / columns : 0;
+    dataset->n_features_ = columns ? columns - n_targets : 0;
+    dataset->n_targets_ = n_targets;
+    return dataset;
+}
+
+template <typename T>
+size_t Dataset<T>::get_size() const {
+    return n_samples_;
+}
+
+template <typename T>
+size_t Dataset<T>::get_feature_count() const {
+    return n_features_;
+}
+
+template <typename T>
+size_t Dataset<T>::get_target_count() const {
+    return n_targets_;
+}
+
+template <typename T>
+const T *Dataset<T>::get_row(size_t index) const {
+    return rows_ + index * (n_features_ + n_targets_);
+}
+
+template <typename T>
+DatasetWriter<T>::DatasetWriter(const std::string &path, size_t n_features, size_t n_targets)
+    : file_(path, std::ios::binary | std::ios::trunc) {
+    if (!file_) {
+        throw std::runtime_error("DatasetWriter: cannot open " + path);
+    }
+    header_ = DatasetFileHeader{};
+    std::memcpy(header_.magic, DATASET_FILE_MAGIC, sizeof(DATASET_FILE_MAGIC));
+    header_.version = DATASET_FILE_VERSION;
+    header_.byte_order = DATASET_FILE_BYTE_ORDER;
+    header_.element_size = sizeof(T);
+    header_.n_samples = 0;
+    header_.n_features = n_features;
+    header_.n_targets = n_targets;
+    header_.data_offset = DATASET_FILE_ALIGNMENT;
+
+    static_assert(sizeof(DatasetFileHeader) <= DATASET_FILE_ALIGNMENT);
+    static const char zeros[DATASET_FILE_ALIGNMENT] = {};
+    file_.write(zeros, DATASET_FILE_ALIGNMENT);
+}
+
+template <typename T>
+DatasetWriter<T>::~DatasetWriter() {
+    if (!file_.is_open()) return;
+    // Destructors must not throw: callers that need to know call close() first.
+    try {
+        close();
+    } catch (const std::exception &) {
+    }
+}
+
+template <typename T>
+void DatasetWriter<T>::write(const T *features, const T *targets) {
+    file_.write(reinterpret_cast<const char *>(features), static_cast<std::streamsize>(header_.n_features * sizeof(T)));
+    file_.write(reinterpret_cast<const char *>(targets), static_cast<std::streamsize>(header_.n_targets * sizeof(T)));
+    ++header_.n_samples;
+}
+
+template <typename T>
+void DatasetWriter<T>::close() {
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    bool failed = !file_.flush();
+    file_.close();
+    if (failed) {
+        throw std::runtime_error("DatasetWriter: cannot write the dataset");
+    }
+}
+
+template <typename T>
+DataLoader<T>::DataLoader(std::shared_ptr<Dataset<T>> dataset, size_t batch_size, bool shuffle,
+                          size_t prefetch, uint64_t seed) : generator_(seed) {
+    if (batch_size == 0) {
+        throw std::invalid_argument("DataLoader: batch_size must be positive");
+    }
+    dataset_ = std::move(dataset);
+    batch_size_ = batch_size;
+    shuffle_ = shuffle;
+    prefetch_ = prefetch;
+    order_.resize(dataset_->get_size());
+    for (size_t i = 0; i < order_.size(); ++i) order_[i] = i;
+    position_ = 0;
+    stop_ = false;
+
+    if (prefetch_) worker_ = std::thread([this]() { worker_loop(); });
+}
+
+template <typename T>
+DataLoader<T>::~DataLoader() {
+    if (!worker_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    consumed_.notify_all();
+    worker_.join();
+}
+
+template <typename T>
+size_t DataLoader<T>::get_batch_count() const {
+    return (order_.size() + batch_size_ - 1) / batch_size_;
+}
+
+/*
+ * Gathers the next batch of the permutation, or returns nothing at the
+ * end of the epoch. Rows a few samples ahead are prefetched into the
+ * cache, since a shuffled order jumps all over the dataset.
+*/
+template <typename T>
+std::optional<Batch<T>> DataLoader<T>::produce() {
+    if (position_ == order_.size()) {
+        position_ = 0;
+        return std::nullopt;
+    }
+    if (position_ == 0 && shuffle_) std::shuffle(order_.begin(), order_.end(), generator_);
+
+    constexpr size_t LOOKAHEAD = 8;
+    const size_t rows = std::min(batch_size_, order_.size() - position_);
+    const size_t n_features = dataset_->get_feature_count(), n_targets = dataset_->get_target_count();
+    Batch<T> batch{
+        std::make_shared<Tensor<T>>(std::vector<size_t>{rows, n_features}),
+        std::make_shared<Tensor<T>>(std::vector<size_t>{rows, n_targets})
+    };
+
+    T *inputs = batch.inputs->get_data(), *targets = batch.targets->get_data();
+    for (size_t r = 0; r < rows; ++r) {
+        if (position_ + r + LOOKAHEAD < order_.size()) {
+            __builtin_prefetch(dataset_->get_row(order_[position_ + r + LOOKAHEAD]));
+        }
+        const T *row = dataset_->get_row(order_[position_ + r]);
+        std::copy(row, row + n_features, inputs + r * n_features);
+        std::copy(row + n_features, row + n_features + n_targets, targets + r * n_targets);
+    }
+    position_ += rows;
+    return batch;
+}
+
+template <typename T>
+void DataLoader<T>::worker_loop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            consumed_.wait(lock, [&]() { return stop_ || queue_.size() < prefetch_; });
+            if (stop_) return;
+        }
+
+        std::optional<Batch<T>> batch;
+        std::exception_ptr error;
+        try {
+            batch = produce();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error) {
+            error_ = error;
+            produced_.notify_one();
+            return;
+        }
+        queue_.push_back(std::move(batch));
+        produced_.notify_one();
+    }
+}
+
+template <typename T>
+bool DataLoader<T>::next(Batch<T> &batch) {
+    std::optional<Batch<T>> item;
+    if (!prefetch_) {
+        item = produce();
+    } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        produced_.wait(lock, [&]() { return !queue_.empty() || error_; });
+        if (queue_.empty()) std::rethrow_exception(error_);
+        item = std::move(queue_.front());
+        queue_.pop_front();
+        consumed_.notify_one();
+    }
+
+    if (!item) return false;
+    batch = std::move(*item);
+    return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "mlp.cpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+/*
+ * Datasets of fixed-size samples and a loader that turns them into batch
+ * tensors for training.
+ *
+ * A Dataset is one contiguous row-major array: every row holds the
+ * features of a sample followed by its targets. Dataset::map() uses a
+ * binary dataset file in place (see DatasetWriter) through a read-only
+ * memory mapping, so opening one costs the same at any size and the
+ * pages are read as the loader touches them. Dataset::read_csv() parses a
+ * CSV file, mapped as well, into such an array once.
+ *
+ * Binary files have a DatasetFileHeader and the rows from data_offset on,
+ * in host byte order. Malformed files throw std::invalid_argument, I/O
+ * errors std::runtime_error.
+*/
+
+constexpr uint32_t DATASET_FILE_VERSION = 1;
+
+struct DatasetFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t element_size;
+    uint32_t reserved;
+    uint64_t n_samples;
+    uint64_t n_features;
+    uint64_t n_targets;
+    uint64_t data_offset;
+};
+
+template <typename T = double>
+class Dataset {
+private:
+    void *mapping_;
+    size_t mapping_size_;
+    AlignedVector<T> values_;
+    const T *rows_;
+    size_t n_samples_;
+    size_t n_features_;
+    size_t n_targets_;
+
+    Dataset();
+    static void map_file(const std::string &path, Dataset<T> &dataset);
+
+public:
+    ~Dataset();
+
+    Dataset(const Dataset &) = delete;
+    Dataset &operator=(const Dataset &) = delete;
+
+    static std::shared_ptr<Dataset<T>> map(const std::string &path);
+
+    /*
+     * Every line of numbers separated by commas is a sample whose last
+     * n_targets columns are the targets. Empty lines are skipped, and so
+     * is the first line if has_header is set.
+    */
+    static std::shared_ptr<Dataset<T>> read_csv(const std::string &path, size_t n_targets = 1, bool has_header = true);
+
+    size_t get_size() const;
+    size_t get_feature_count() const;
+    size_t get_target_count() const;
+
+    // get_feature_count() features, then get_target_count() targets.
+    const T *get_row(size_t index) const;
+};
+
+/*
+ * Writes a binary dataset file one sample at a time, so datasets larger
+ * than memory can be generated. The sample count in the header is filled
+ * in by close(), which the destructor calls. Only close() reports write
+ * errors: the destructor cannot throw them.
+*/
+template <typename T = double>
+class DatasetWriter {
+private:
+    std::ofstream file_;
+    DatasetFileHeader header_;
+
+public:
+    DatasetWriter(const std::string &path, size_t n_features, size_t n_targets = 1);
+    ~DatasetWriter();
+
+    void write(const T *features, const T *targets);
+    void close();
+};
+
+template <typename T = double>
+struct Batch {
+    std::shared_ptr<Tensor<T>> inputs;
+    std::shared_ptr<Tensor<T>> targets;
+};
+
+/*
+ * Iterates over a dataset in batches of (batch_size, features) inputs and
+ * (batch_size, targets) targets, ready for NN::operator() and mse_loss();
+ * the last batch of an epoch holds the remaining samples. With shuffle,
+ * every epoch visits the samples in a new random permutation of the
+ * indices.
+ *
+ * With prefetch > 0, a background thread gathers up to prefetch batches
+ * ahead while the caller trains on the current one, across epoch
+ * boundaries too; with 0, next() gathers the batch itself. An exception
+ * thrown while the thread gathers a batch stops it and is rethrown by
+ * next() once the batches gathered before are consumed.
+ *
+ *     Batch<T> batch;
+ *     while (loader.next(batch)) { ... }  // one epoch
+*/
+template <typename T = double>
+class DataLoader {
+private:
+    std::shared_ptr<Dataset<T>> dataset_;
+    size_t batch_size_;
+    bool shuffle_;
+    size_t prefetch_;
+    std::mt19937_64 generator_;
+    std::vector<size_t> order_;
+    size_t position_;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable produced_;
+    std::condition_variable consumed_;
+    std::deque<std::optional<Batch<T>>> queue_;
+    std::exception_ptr error_;
+    bool stop_;
+
+    std::optional<Batch<T>> produce();
+    void worker_loop();
+
+public:
+    DataLoader(std::shared_ptr<Dataset<T>> dataset, size_t batch_size, bool shuffle = true,
+               size_t prefetch = 2, uint64_t seed = 42);
+    ~DataLoader();
+
+    DataLoader(const DataLoader &) = delete;
+    DataLoader &operator=(const DataLoader &) = delete;
+
+    size_t get_batch_count() const;
+
+    // The next batch of the epoch, or false once at the end of every epoch.
+    bool next(Batch<T> &batch);
+};
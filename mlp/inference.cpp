@@ -0,0 +1,118 @@
+#pragma once
+
+#include "inference.hpp"
+
+/*
+ * Lays the layers out one after another with rows of stride values, and
+ * sizes the activation buffers for the widest one.
+*/
+template <typename T>
+void InferenceNN<T>::add_layers(const std::vector<LayerShape> &shapes, bool padded) {
+    constexpr size_t LANES = Simd<T>::LANES;
+    size_t size = 0, width = 0;
+    for (auto & shape : shapes) {
+        Layer layer;
+        layer.input_size = shape.input_size;
+        layer.output_size = shape.output_size;
+        layer.stride = padded ? (shape.output_size + LANES - 1) / LANES * LANES : shape.output_size;
+        layer.offset = size;
+        layer.use_activation = shape.use_activation;
+        layers_.push_back(layer);
+
+        size += (layer.input_size + 1) * layer.stride;
+        width = std::max(width, layer.stride);
+    }
+    buffers_[0].assign(width, T(0.0));
+    buffers_[1].assign(width, T(0.0));
+}
+
+template <typename T>
+InferenceNN<T>::InferenceNN(NN<T> &model) {
+    std::vector<LayerShape> shapes;
+    for (auto & linear : model.get_layers()) {
+        shapes.push_back({linear.get_input_size(), linear.get_output_size(), linear.has_activation()});
+    }
+    add_layers(shapes, true);
+    borrowed_ = nullptr;
+
+    const Layer *last = layers_.empty() ? nullptr : &layers_.back();
+    parameters_.assign(last ? last->offset + (last->input_size + 1) * last->stride : 0, T(0.0));
+    const T *source = model.get_parameter_data();
+    for (auto & layer : layers_) {
+        T *target = parameters_.data() + layer.offset;
+        for (size_t i = 0; i <= layer.input_size; ++i) {
+            std::copy(source, source + layer.output_size, target + i * layer.stride);
+            source += layer.output_size;
+        }
+    }
+}
+
+template <typename T>
+InferenceNN<T>::InferenceNN(const std::vector<LayerShape> &shapes, const T *parameters) {
+    add_layers(shapes, false);
+    borrowed_ = parameters;
+}
+
+template <typename T>
+size_t InferenceNN<T>::get_input_size() const {
+    return layers_.empty() ? 0 : layers_.front().input_size;
+}
+
+template <typename T>
+size_t InferenceNN<T>::get_output_size() const {
+    return layers_.empty() ? 0 : layers_.back().output_size;
+}
+
+/*
+ * y = x * W + b. A narrow layer is computed one vector of outputs at a
+ * time, kept in a register while the inputs are accumulated into it. A
+ * wide one would then walk W by columns, a page per load, so it streams
+ * the rows of W into y instead. The padding columns of W and b are zero,
+ * so padded outputs are zero and the next layer, which only reads
+ * input_size values, never sees them.
+*/
+template <typename T>
+inline void InferenceNN<T>::run_layer(const Layer &layer, const T *__restrict x, T *__restrict y) const {
+    const T *__restrict w = (borrowed_ ? borrowed_ : parameters_.data()) + layer.offset;
+    const T *__restrict b = w + layer.input_size * layer.stride;
+
+    if (layer.stride <= REGISTER_VECTORS * Simd<T>::LANES) {
+        simd_for<T>(layer.stride, [&](size_t j, auto lanes) {
+            using V = decltype(lanes);
+            V sum = simd_load<V>(b + j);
+            for (size_t i = 0; i < layer.input_size; ++i) {
+                sum += x[i] * simd_load<V>(w + i * layer.stride + j);
+            }
+            if (layer.use_activation) sum = sum > V{} ? sum : V{};
+            simd_store(y + j, sum);
+        });
+        return;
+    }
+
+    std::copy(b, b + layer.stride, y);
+    for (size_t i = 0; i < layer.input_size; ++i) {
+        const T xi = x[i], *__restrict row = w + i * layer.stride;
+        simd_for<T>(layer.stride, [&](size_t j, auto lanes) {
+            using V = decltype(lanes);
+            simd_store(y + j, simd_load<V>(y + j) + xi * simd_load<V>(row + j));
+        });
+    }
+    if (layer.use_activation) {
+        simd_for<T>(layer.stride, [&](size_t j, auto lanes) {
+            using V = decltype(lanes);
+            V value = simd_load<V>(y + j);
+            simd_store(y + j, value > V{} ? value : V{});
+        });
+    }
+}
+
+template <typename T>
+void InferenceNN<T>::operator()(const T *input, T *output) {
+    const T *x = input;
+    for (size_t l = 0; l < layers_.size(); ++l) {
+        T *y = buffers_[l % 2].data();
+        run_layer(layers_[l], x, y);
+        x = y;
+    }
+    std::copy(x, x + get_output_size(), output);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mlp.cpp"
+
+/*
+ * Topology of one Linear layer, as stored in model files.
+*/
+struct LayerShape {
+    size_t input_size;
+    size_t output_size;
+    bool use_activation;
+};
+
+/*
+ * Frozen copy of an NN for serving single samples.
+ *
+ * The constructor from a model copies its parameters into one aligned
+ * buffer, layer after layer: the weights as an (input, output) matrix
+ * whose rows are padded to a whole number of Simd<T> vectors, then the
+ * padded bias. A layer of up to REGISTER_VECTORS vectors of outputs is
+ * then a loop over them, each kept in a register while the inputs are
+ * accumulated into it; a wider one streams the rows of its weights. There
+ * is no graph, no remainder loop and no allocation: the activations go
+ * through two buffers sized for the widest layer.
+ *
+ * The constructor from shapes and parameters borrows them in the layout
+ * of NN::get_parameter_data() instead (rows of output_size values, see
+ * MappedModel), at the cost of a scalar tail per layer. The parameters
+ * must outlive the InferenceNN.
+ *
+ * The copy does not follow later updates of the model; build a new one
+ * after training. The buffers make a call non-reentrant, so every thread
+ * needs its own copy.
+*/
+
+template <typename T = double>
+class InferenceNN {
+private:
+    struct Layer {
+        size_t input_size;
+        size_t output_size;
+        size_t stride;
+        size_t offset;
+        bool use_activation;
+    };
+    std::vector<Layer> layers_;
+    AlignedVector<T> parameters_;
+    const T *borrowed_;
+    AlignedVector<T> buffers_[2];
+
+    static constexpr size_t REGISTER_VECTORS = 8;
+
+    void add_layers(const std::vector<LayerShape> &shapes, bool padded);
+    void run_layer(const Layer &layer, const T *__restrict x, T *__restrict y) const;
+
+public:
+    explicit InferenceNN(NN<T> &model);
+    InferenceNN(const std::vector<LayerShape> &shapes, const T *parameters);
+
+    size_t get_input_size() const;
+    size_t get_output_size() const;
+
+    // output[0, get_output_size()) = model(input[0, get_input_size())).
+    void operator()(const T *input, T *output);
+};
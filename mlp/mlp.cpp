@@ -1,3 +1,5 @@
+#pragma once
+
 #include "mlp.hpp"
 
 template <typename T>
@@ -6,7 +8,7 @@ SingleNeuron<T>::SingleNeuron(size_t input_size, bool use_activation) {
 
     std::random_device rd;
     std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(-1.0, 1.0);  
+    std::uniform_real_distribution<T> dis(T(-1.0), T(1.0));  
 
     this->weights_.reserve(input_size);
 
@@ -18,7 +20,18 @@ SingleNeuron<T>::SingleNeuron(size_t input_size, bool use_activation) {
 
 template <typename T>
 std::shared_ptr<Variable<T>> SingleNeuron<T>::operator()(std::vector<std::shared_ptr<Variable<T>>> &x) {
-    std::shared_ptr<Variable<T>> sum = std::make_shared<Variable<T>>(0.0);
+    if (!NoGrad::grad_enabled()) {
+        // One node per neuron instead of two per input, summed in the same order.
+        T value = T(0.0);
+        for (size_t i = 0; i < x.size(); ++i) {
+            value += x[i]->get_data_value() * weights_[i]->get_data_value();
+        }
+        value += bias_->get_data_value();
+        if (use_activation_ && value < T(0.0)) value = T(0.0);
+        return std::make_shared<Variable<T>>(value);
+    }
+
+    std::shared_ptr<Variable<T>> sum = std::make_shared<Variable<T>>(T(0.0));
     for (size_t i = 0; i < x.size(); ++i) {
         sum = sum + (x[i] * weights_[i]);
     }
@@ -28,6 +41,17 @@ std::shared_ptr<Variable<T>> SingleNeuron<T>::operator()(std::vector<std::shared
     return sum;
 }
 
+template <typename T>
+TapeVariable<T> SingleNeuron<T>::operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x) {
+    TapeVariable<T> sum = tape.bind(bias_);
+    for (size_t i = 0; i < x.size(); ++i) {
+        sum = sum + (x[i] * tape.bind(weights_[i]));
+    }
+
+    if (use_activation_) return sum.ReLU();
+    return sum;
+}
+
 template <typename T>
 std::vector<std::shared_ptr<Variable<T>>> SingleNeuron<T>::parameters() {
     std::vector<std::shared_ptr<Variable<T>>> params;
@@ -44,12 +68,29 @@ std::vector<std::shared_ptr<Variable<T>>> SingleNeuron<T>::parameters() {
 template <typename T>
 Linear<T>::Linear(size_t input_size, size_t output_size, bool use_activation) { 
     n_parameters_ = (input_size + 1) * output_size;
+    input_size_ = input_size;
+    use_activation_ = use_activation;
     neurons_.reserve(output_size);
 
     for (size_t i = 0; i < output_size; ++i) {
         SingleNeuron<T> neuron(input_size, use_activation);
         neurons_.emplace_back(neuron);
     }
+
+    // Parameters in the layout of the tensor path: weights as an (input, output) matrix and a bias row.
+    weight_variables_.resize(input_size * output_size);
+    bias_variables_.resize(output_size);
+    for (size_t i = 0; i < output_size; ++i) {
+        std::vector<std::shared_ptr<Variable<T>>> params = neurons_[i].parameters();
+        for (size_t j = 0; j < input_size; ++j) {
+            weight_variables_[j * output_size + i] = params[j];
+        }
+        bias_variables_[i] = params[input_size];
+    }
+    parameter_data_ = nullptr;
+    parameter_grad_ = nullptr;
+    bfloat16_weights_ = nullptr;
+    float16_weights_ = nullptr;
 }
 
 template <typename T>
@@ -62,13 +103,75 @@ std::vector<std::shared_ptr<Variable<T>>> Linear<T>::operator()(std::vector<std:
     return output;
 }
 
+template <typename T>
+void Linear<T>::operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x, std::vector<TapeVariable<T>> &output) {
+    output.resize(neurons_.size());
+    for (size_t i = 0; i < neurons_.size(); ++i) {
+        output[i] = neurons_[i](tape, x);
+    }
+}
+
+/*
+ * Tensor forward pass over a batch: x is (batch, input_size) and the result
+ * is (batch, output_size). The whole layer is three graph nodes plus the
+ * two parameter leaves.
+*/
+template <typename T>
+std::shared_ptr<Tensor<T>> Linear<T>::operator()(const std::shared_ptr<Tensor<T>> &x) {
+    if (!parameter_data_) {
+        auto weights = Tensor<T>::from_variables(weight_variables_, {input_size_, neurons_.size()});
+        auto bias = Tensor<T>::from_variables(bias_variables_, {neurons_.size()});
+        return (*this)(x, weights, bias);
+    }
+
+    size_t n_weights = weight_variables_.size();
+    auto weights = Tensor<T>::from_buffer({input_size_, neurons_.size()}, parameter_data_, parameter_grad_);
+    auto bias = Tensor<T>::from_buffer({neurons_.size()}, parameter_data_ + n_weights, parameter_grad_ + n_weights);
+    if (!bfloat16_weights_ && !float16_weights_) return (*this)(x, weights, bias);
+
+    std::shared_ptr<Tensor<T>> output = bfloat16_weights_
+        ? x->matmul(weights, bfloat16_weights_) + bias
+        : x->matmul(weights, float16_weights_) + bias;
+    if (use_activation_) return output->ReLU();
+    return output;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> Linear<T>::operator()(
+    const std::shared_ptr<Tensor<T>> &x,
+    const std::shared_ptr<Tensor<T>> &weights,
+    const std::shared_ptr<Tensor<T>> &bias) {
+
+    std::shared_ptr<Tensor<T>> output = x->matmul(weights) + bias;
+    if (use_activation_) return output->ReLU();
+    return output;
+}
+
+/*
+ * Detached copies of the weights and the bias in the tensor layout. They are
+ * plain leaves: their gradients stay in the tensors and are not added to
+ * the parameters, which lets several threads run backward on the same model.
+*/
+template <typename T>
+std::vector<std::shared_ptr<Tensor<T>>> Linear<T>::parameter_tensors() {
+    auto weights = std::make_shared<Tensor<T>>(std::vector<size_t>{input_size_, neurons_.size()});
+    auto bias = std::make_shared<Tensor<T>>(std::vector<size_t>{neurons_.size()});
+    for (size_t i = 0; i < weight_variables_.size(); ++i) {
+        weights->get_data()[i] = weight_variables_[i]->get_data_value();
+    }
+    for (size_t i = 0; i < bias_variables_.size(); ++i) {
+        bias->get_data()[i] = bias_variables_[i]->get_data_value();
+    }
+    return {weights, bias};
+}
+
 template <typename T>
 std::vector<std::shared_ptr<Variable<T>>> Linear<T>::parameters() {
     std::vector<std::shared_ptr<Variable<T>>> params;
     params.reserve(n_parameters_);
 
-    for (auto neuron : neurons_) {
-        for (auto weight : neuron.parameters()) {
+    for (auto & neuron : neurons_) {
+        for (auto & weight : neuron.parameters()) {
             params.emplace_back(weight);
         }
     }
@@ -76,57 +179,346 @@ std::vector<std::shared_ptr<Variable<T>>> Linear<T>::parameters() {
     return params;
 }
 
+template <typename T>
+size_t Linear<T>::get_parameter_count() const {
+    return n_parameters_;
+}
+
+template <typename T>
+size_t Linear<T>::get_input_size() const {
+    return input_size_;
+}
+
+template <typename T>
+size_t Linear<T>::get_output_size() const {
+    return neurons_.size();
+}
+
+template <typename T>
+bool Linear<T>::has_activation() const {
+    return use_activation_;
+}
+
+/*
+ * Moves the parameters of the layer to data[0, n_parameters) and
+ * grad[0, n_parameters): the weights in the (input, output) layout of the
+ * tensor path, then the bias.
+*/
+template <typename T>
+void Linear<T>::bind_parameters(T *data, T *grad) {
+    size_t n_weights = weight_variables_.size();
+    for (size_t i = 0; i < n_weights; ++i) {
+        weight_variables_[i]->bind_storage(data + i, grad + i);
+    }
+    for (size_t i = 0; i < bias_variables_.size(); ++i) {
+        bias_variables_[i]->bind_storage(data + n_weights + i, grad + n_weights + i);
+    }
+    parameter_data_ = data;
+    parameter_grad_ = grad;
+}
+
+/*
+ * 16-bit copies of the weights in the layout of bind_parameters(), read by
+ * the tensor forward pass instead of the T values; null for full precision.
+*/
+template <typename T>
+void Linear<T>::bind_low_precision(const BFloat16 *bfloat16_weights, const Float16 *float16_weights) {
+    bfloat16_weights_ = bfloat16_weights;
+    float16_weights_ = float16_weights;
+}
+
 template <typename T>
 NN<T>::NN() {
     layers_.reserve(10);
     n_parameters_ = 0;
+    parameter_data_ = std::make_shared<AlignedVector<T>>();
+    parameter_grad_ = std::make_shared<AlignedVector<T>>();
+    checkpoint_policy_ = CheckpointPolicy::None;
+    checkpoint_layers_ = 1;
+    precision_ = Precision::Full;
+    bfloat16_data_ = std::make_shared<AlignedVector<BFloat16>>();
+    float16_data_ = std::make_shared<AlignedVector<Float16>>();
 }
 
+/*
+ * The parameter buffers are reallocated for the new size and all layers
+ * are bound to the new ones; the old values are copied over.
+*/
 template <typename T>
 void NN<T>::add_linear_layer(size_t input_size, size_t output_size, bool use_activation) {
-    layers_.emplace_back(Linear(input_size, output_size, use_activation));
+    layers_.emplace_back(Linear<T>(input_size, output_size, use_activation));
     n_parameters_ += (input_size + 1) * output_size;
+
+    AlignedVector<T> data(n_parameters_), grad(n_parameters_);
+    for (size_t i = 0, offset = 0; i < layers_.size(); offset += layers_[i++].get_parameter_count()) {
+        layers_[i].bind_parameters(data.data() + offset, grad.data() + offset);
+    }
+    *parameter_data_ = std::move(data);
+    *parameter_grad_ = std::move(grad);
+
+    for (auto & param : layers_.back().parameters()) {
+        parameters_.emplace_back(param);
+    }
+    if (precision_ != Precision::Full) set_precision(precision_);
+}
+
+/*
+ * The 16-bit copy lives in one of two buffers shared by the copies of the
+ * model, and only the one in use is non-empty, so the copy held by an
+ * optimizer knows what to refresh.
+*/
+template <typename T>
+void NN<T>::set_precision(Precision precision) {
+    precision_ = precision;
+    bfloat16_data_->clear();
+    float16_data_->clear();
+    if (precision == Precision::BFloat16) bfloat16_data_->resize(n_parameters_);
+    if (precision == Precision::Float16) float16_data_->resize(n_parameters_);
+
+    for (size_t i = 0, offset = 0; i < layers_.size(); offset += layers_[i++].get_parameter_count()) {
+        layers_[i].bind_low_precision(
+            precision == Precision::BFloat16 ? bfloat16_data_->data() + offset : nullptr,
+            precision == Precision::Float16 ? float16_data_->data() + offset : nullptr
+        );
+    }
+    refresh_low_precision();
+}
+
+template <typename T>
+void NN<T>::refresh_low_precision() {
+    if (!bfloat16_data_->empty()) convert_precision(parameter_data_->data(), bfloat16_data_->data(), n_parameters_);
+    if (!float16_data_->empty()) convert_precision(parameter_data_->data(), float16_data_->data(), n_parameters_);
+}
+
+template <typename T>
+void NN<T>::set_checkpointing(CheckpointPolicy policy, size_t segment_layers) {
+    if (policy == CheckpointPolicy::Fixed && segment_layers == 0) {
+        throw std::invalid_argument("set_checkpointing: a segment needs at least one layer");
+    }
+    checkpoint_policy_ = policy;
+    checkpoint_layers_ = segment_layers;
 }
 
 template <typename T>
 std::vector<std::shared_ptr<Variable<T>>> NN<T>::operator()(std::vector<std::shared_ptr<Variable<T>>> x) {
-    for (auto layer : layers_) {
+    AUTOGRAD_PROFILE_SCOPE("NN::operator()");
+    if (checkpoint_policy_ == CheckpointPolicy::None) {
+        for (auto & layer : layers_) {
+            x = layer(x);
+        }
+        return x;
+    }
+
+    size_t n_layers = layers_.size();
+    size_t segment_layers = checkpoint_policy_ == CheckpointPolicy::Sqrt
+        ? static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n_layers))))
+        : checkpoint_layers_;
+    for (size_t begin = 0; begin < n_layers; begin += segment_layers) {
+        size_t end = std::min(begin + segment_layers, n_layers);
+        x = Checkpoint<T>::run([this, begin, end](const std::vector<std::shared_ptr<Variable<T>>> &input) {
+            std::vector<std::shared_ptr<Variable<T>>> output = input;
+            for (size_t i = begin; i < end; ++i) {
+                output = layers_[i](output);
+            }
+            return output;
+        }, x);
+    }
+    return x;
+}
+
+/*
+ * Tape forward pass. Intermediate layer outputs are kept in two buffers owned
+ * by the model, so repeated calls do not allocate once the buffers have grown.
+ * The returned reference is valid until the next call.
+*/
+template <typename T>
+const std::vector<TapeVariable<T>> &NN<T>::operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x) {
+    const std::vector<TapeVariable<T>> *input = &x;
+    for (size_t i = 0; i < layers_.size(); ++i) {
+        std::vector<TapeVariable<T>> &output = tape_buffers_[i % 2];
+        layers_[i](tape, *input, output);
+        input = &output;
+    }
+    return *input;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> NN<T>::operator()(std::shared_ptr<Tensor<T>> x) {
+    AUTOGRAD_PROFILE_SCOPE("NN::operator()");
+    for (auto & layer : layers_) {
         x = layer(x);
     }
     return x;
 }
 
+/*
+ * Forward pass with the parameters given as tensors, two per layer, in the
+ * order of parameter_tensors().
+*/
 template <typename T>
-std::vector<std::shared_ptr<Variable<T>>> NN<T>::parameters() {
-    std::vector<std::shared_ptr<Variable<T>>> params;
-    params.reserve(n_parameters_);
+std::shared_ptr<Tensor<T>> NN<T>::operator()(std::shared_ptr<Tensor<T>> x, const std::vector<std::shared_ptr<Tensor<T>>> &params) {
+    AUTOGRAD_PROFILE_SCOPE("NN::operator()");
+    for (size_t i = 0; i < layers_.size(); ++i) {
+        x = layers_[i](x, params[2 * i], params[2 * i + 1]);
+    }
+    return x;
+}
 
-    for (auto layer : layers_) {
-        for (auto param : layer.parameters()) {
+template <typename T>
+std::vector<std::shared_ptr<Tensor<T>>> NN<T>::parameter_tensors() {
+    std::vector<std::shared_ptr<Tensor<T>>> params;
+    for (auto & layer : layers_) {
+        for (auto & param : layer.parameter_tensors()) {
             params.emplace_back(param);
         }
     }
-
     return params;
 }
 
+/*
+ * Parameter Variables, neuron by neuron (weights, then bias). The list is
+ * built once when the layers are added.
+*/
+template <typename T>
+const std::vector<std::shared_ptr<Variable<T>>> &NN<T>::parameters() const {
+    return parameters_;
+}
+
+template <typename T>
+const std::vector<Linear<T>> &NN<T>::get_layers() const {
+    return layers_;
+}
+
+template <typename T>
+size_t NN<T>::get_parameter_count() const {
+    return n_parameters_;
+}
+
+template <typename T>
+T *NN<T>::get_parameter_data() {
+    return parameter_data_->data();
+}
+
+template <typename T>
+T *NN<T>::get_parameter_grad() {
+    return parameter_grad_->data();
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> mse_loss(const std::shared_ptr<Tensor<T>> &output, const std::shared_ptr<Tensor<T>> &target) {
+    std::shared_ptr<Tensor<T>> error = output - target;
+    return (error * error)->mean();
+}
+
 template <typename T>
-optimizer<T>::optimizer(NN<T> &model, T learning_rate) {
+optimizer<T>::optimizer(NN<T> &model, T learning_rate, size_t accumulation_steps) {
     lr_ = learning_rate;
     model_ = model;
+    accumulation_steps_ = accumulation_steps;
+    accumulated_ = 0;
+    steps_ = 0;
+    loss_scaling_ = false;
+    loss_scale_ = T(1.0);
+    growth_interval_ = 0;
+    good_steps_ = 0;
 }
 
 template <typename T>
 void optimizer<T>::zero_grad() {
-    for (auto param : model_.parameters()) {
-        param->set_grad(0.0);
-    }
+    std::memset(model_.get_parameter_grad(), 0, model_.get_parameter_count() * sizeof(T));
 }
 
 template <typename T>
-void optimizer<T>::step() {
-    for (auto param : model_.parameters()) {
-        param->set_data(param->get_data_value() - lr_ * param->get_grad_value());
+bool optimizer<T>::step() {
+    AUTOGRAD_PROFILE_SCOPE("optimizer::step");
+    if (++accumulated_ < accumulation_steps_) return false;
+    accumulated_ = 0;
+
+    const T scale = loss_scale_;
+    if (loss_scaling_) {
+        const T *grad = model_.get_parameter_grad();
+        bool finite = true;
+        for (size_t i = 0; i < model_.get_parameter_count(); ++i) finite &= std::isfinite(grad[i]);
+        if (!finite) {
+            // The gradients are dropped with the step, as step() callers only zero them after an update.
+            loss_scale_ /= T(2.0);
+            good_steps_ = 0;
+            zero_grad();
+            return false;
+        }
+        if (++good_steps_ == growth_interval_) {
+            loss_scale_ *= T(2.0);
+            good_steps_ = 0;
+        }
     }
+
+    ++steps_;
+    update(model_.get_parameter_data(), model_.get_parameter_grad(), model_.get_parameter_count(),
+           T(1.0) / (static_cast<T>(accumulation_steps_) * scale));
+    model_.refresh_low_precision();
+    return true;
+}
+
+template <typename T>
+void optimizer<T>::enable_loss_scaling(T initial_scale, size_t growth_interval) {
+    loss_scaling_ = true;
+    loss_scale_ = initial_scale;
+    growth_interval_ = growth_interval;
+    good_steps_ = 0;
+}
+
+template <typename T>
+T optimizer<T>::get_loss_scale() const {
+    return loss_scale_;
+}
+
+template <typename T>
+size_t optimizer<T>::get_parameter_count() const {
+    return model_.get_parameter_count();
+}
+
+template <typename T>
+typename optimizer<T>::Counters optimizer<T>::get_counters() const {
+    return Counters{steps_, accumulated_, good_steps_, loss_scale_};
+}
+
+template <typename T>
+void optimizer<T>::set_counters(const Counters &counters) {
+    steps_ = counters.steps;
+    accumulated_ = counters.accumulated;
+    good_steps_ = counters.good_steps;
+    loss_scale_ = counters.loss_scale;
+}
+
+template <typename T>
+std::vector<T *> optimizer<T>::state_buffers() {
+    return {};
+}
+
+template <typename T>
+const char *optimizer<T>::get_name() const {
+    return "SGD";
 }
 
+template <typename T>
+std::shared_ptr<Variable<T>> optimizer<T>::scale_loss(const std::shared_ptr<Variable<T>> &loss) const {
+    return loss * loss_scale_;
+}
+
+template <typename T>
+std::shared_ptr<Tensor<T>> optimizer<T>::scale_loss(const std::shared_ptr<Tensor<T>> &loss) const {
+    return loss * std::make_shared<Tensor<T>>(std::vector<size_t>{1}, loss_scale_);
+}
+
+/*
+ * One pass over the flat parameter buffer; grad_scale turns the
+ * accumulated gradients into their mean.
+*/
+template <typename T>
+void optimizer<T>::update(T *data, const T *grad, size_t n, T grad_scale) {
+    const T lr = lr_ * grad_scale;
+    simd_for<T>(n, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        simd_store(data + i, simd_load<V>(data + i) - lr * simd_load<V>(grad + i));
+    });
+}
@@ -1,6 +1,12 @@
 #pragma once
 #include "../autograd/autograd_variable.cpp"
 #include "../autograd/autograd_variable.hpp"
+#include "../autograd/autograd_tape.cpp"
+#include "../autograd/static_graph.cpp"
+#include "../autograd/checkpoint.cpp"
+#include "../autograd/losses.cpp"
+#include "../autograd/autograd_tensor.cpp"
+#include "../autograd/simd.hpp"
 #include <random>
 
 
@@ -15,6 +21,7 @@ public:
     SingleNeuron(size_t input_size, bool use_activation=true);
     std::vector<std::shared_ptr<Variable<T>>> parameters();
     std::shared_ptr<Variable<T>> operator()(std::vector<std::shared_ptr<Variable<T>>> &x);
+    TapeVariable<T> operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x);
 };
 
 
@@ -23,32 +30,153 @@ class Linear {
 private:
     std::vector<SingleNeuron<T>> neurons_;
     size_t n_parameters_;
+    size_t input_size_;
+    bool use_activation_;
+    std::vector<std::shared_ptr<Variable<T>>> weight_variables_;
+    std::vector<std::shared_ptr<Variable<T>>> bias_variables_;
+    T *parameter_data_;
+    T *parameter_grad_;
+    const BFloat16 *bfloat16_weights_;
+    const Float16 *float16_weights_;
 public:
     Linear(size_t input_size, size_t output_size, bool use_activation=true);
     std::vector<std::shared_ptr<Variable<T>>> operator()(std::vector<std::shared_ptr<Variable<T>>> x);
+    void operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x, std::vector<TapeVariable<T>> &output);
+    std::shared_ptr<Tensor<T>> operator()(const std::shared_ptr<Tensor<T>> &x);
+    std::shared_ptr<Tensor<T>> operator()(
+        const std::shared_ptr<Tensor<T>> &x,
+        const std::shared_ptr<Tensor<T>> &weights,
+        const std::shared_ptr<Tensor<T>> &bias
+    );
+    std::vector<std::shared_ptr<Tensor<T>>> parameter_tensors();
     std::vector<std::shared_ptr<Variable<T>>> parameters();
+    size_t get_parameter_count() const;
+    size_t get_input_size() const;
+    size_t get_output_size() const;
+    bool has_activation() const;
+    void bind_parameters(T *data, T *grad);
+    void bind_low_precision(const BFloat16 *bfloat16_weights, const Float16 *float16_weights);
 };
 
 
+/*
+ * Multilayer perceptron.
+ *
+ * The values and gradients of all parameters live in two contiguous,
+ * cache-line aligned buffers owned by the model (shared by its copies):
+ * layer after layer, the weights as an (input, output) matrix followed by
+ * the bias. The parameter Variables and the tensor views of the layers
+ * point into them, so optimizers work on plain arrays.
+ *
+ * With checkpointing, the Variable forward pass runs groups of consecutive
+ * layers as Checkpoint segments: only the outputs of each group are kept
+ * for backward, which recomputes the rest. The Sqrt policy uses groups of
+ * ceil(sqrt(layers)) layers, so about 2 sqrt(layers) layer outputs are
+ * alive instead of all of them, Fixed uses groups of segment_layers. The
+ * model must outlive the backward pass of a checkpointed forward pass.
+ *
+ * With a 16-bit precision, the model also keeps a BFloat16 or Float16 copy
+ * of the parameter buffer, and the tensor forward pass reads the weights
+ * from it (see Tensor::matmul). The T buffer stays the master copy that
+ * gradients and optimizers work on; optimizer::step() refreshes the copy
+ * after every update. Activations and gradients stay in T.
+*/
+enum class CheckpointPolicy : uint8_t {None, Sqrt, Fixed};
+
+enum class Precision : uint8_t {Full, BFloat16, Float16};
+
 template <typename T = double>
 class NN {
 private:
     std::vector<Linear<T>> layers_;
     size_t n_parameters_;
+    std::vector<TapeVariable<T>> tape_buffers_[2];
+    std::vector<std::shared_ptr<Variable<T>>> parameters_;
+    std::shared_ptr<AlignedVector<T>> parameter_data_;
+    std::shared_ptr<AlignedVector<T>> parameter_grad_;
+    CheckpointPolicy checkpoint_policy_;
+    size_t checkpoint_layers_;
+    Precision precision_;
+    std::shared_ptr<AlignedVector<BFloat16>> bfloat16_data_;
+    std::shared_ptr<AlignedVector<Float16>> float16_data_;
 public:
     NN();
     void add_linear_layer(size_t input_size, size_t output_size, bool use_activation);
+    void set_checkpointing(CheckpointPolicy policy, size_t segment_layers = 1);
+    void set_precision(Precision precision);
+    void refresh_low_precision();
     std::vector<std::shared_ptr<Variable<T>>> operator()(std::vector<std::shared_ptr<Variable<T>>> x);
-    std::vector<std::shared_ptr<Variable<T>>> parameters();
+    const std::vector<TapeVariable<T>> &operator()(Tape<T> &tape, const std::vector<TapeVariable<T>> &x);
+    std::shared_ptr<Tensor<T>> operator()(std::shared_ptr<Tensor<T>> x);
+    std::shared_ptr<Tensor<T>> operator()(std::shared_ptr<Tensor<T>> x, const std::vector<std::shared_ptr<Tensor<T>>> &params);
+    std::vector<std::shared_ptr<Tensor<T>>> parameter_tensors();
+    const std::vector<std::shared_ptr<Variable<T>>> &parameters() const;
+    const std::vector<Linear<T>> &get_layers() const;
+    size_t get_parameter_count() const;
+    T *get_parameter_data();
+    T *get_parameter_grad();
 };
 
+/*
+ * Mean squared error over a batch, reduced to a single value.
+*/
+template <typename T = double>
+std::shared_ptr<Tensor<T>> mse_loss(const std::shared_ptr<Tensor<T>> &output, const std::shared_ptr<Tensor<T>> &target);
+
+/*
+ * Stochastic gradient descent, and the base class of the other optimizers
+ * (see optimizers.hpp), which override update().
+ *
+ * With accumulation_steps = k, gradients of k consecutive backward() calls
+ * (micro-batches) are averaged into one update: step() only changes the
+ * parameters on every k-th call and returns whether it did.
+ *
+ * Dynamic loss scaling, for 16-bit training: backpropagate scale_loss(loss)
+ * instead of loss, and step() divides the gradients by the scale. A step
+ * whose gradients are not finite is skipped and halves the scale; after
+ * growth_interval good steps in a row the scale doubles.
+ *
+ * get_counters() and state_buffers() expose everything an update depends
+ * on besides the parameters and the hyperparameters, so that training can
+ * be resumed from a model file (see model_file.hpp).
+*/
 template <typename T = double>
 class optimizer {
-private:
+protected:
     NN<T> model_;
     T lr_;
+    size_t accumulation_steps_;
+    size_t accumulated_;
+    size_t steps_;
+    bool loss_scaling_;
+    T loss_scale_;
+    size_t growth_interval_;
+    size_t good_steps_;
+
+    virtual void update(T *data, const T *grad, size_t n, T grad_scale);
 public:
-    optimizer(NN<T> &model, T learning_rate);
+    optimizer(NN<T> &model, T learning_rate, size_t accumulation_steps = 1);
+    virtual ~optimizer() = default;
     void zero_grad();
-    void step();
+    bool step();
+
+    void enable_loss_scaling(T initial_scale = T(65536.0), size_t growth_interval = 2000);
+    T get_loss_scale() const;
+    std::shared_ptr<Variable<T>> scale_loss(const std::shared_ptr<Variable<T>> &loss) const;
+    std::shared_ptr<Tensor<T>> scale_loss(const std::shared_ptr<Tensor<T>> &loss) const;
+
+    struct Counters {
+        size_t steps;
+        size_t accumulated;
+        size_t good_steps;
+        T loss_scale;
+    };
+    size_t get_parameter_count() const;
+    Counters get_counters() const;
+    void set_counters(const Counters &counters);
+
+    // Per-parameter arrays (momentum, moments), each get_parameter_count() long.
+    virtual std::vector<T *> state_buffers();
+    // The kind of optimizer, saved with its state so that another kind refuses to load it.
+    virtual const char *get_name() const;
 };
\ No newline at end of file
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "model_file.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char MODEL_FILE_MAGIC[8] = {'A', 'G', 'R', 'A', 'D', 'N', 'N', '\0'};
+constexpr uint32_t MODEL_FILE_BYTE_ORDER = 0x01020304;
+
+template <typename T>
+constexpr uint32_t model_file_dtype() {
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "model files hold float or double");
+    return std::is_same_v<T, float> ? 1 : 2;
+}
+
+inline size_t model_file_align(size_t offset) {
+    return (offset + MODEL_FILE_ALIGNMENT - 1) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+}
+
+/*
+ * Offset of every optimizer state buffer, each aligned, after the counters.
+*/
+template <typename T>
+std::vector<size_t> model_file_buffer_offsets(size_t optimizer_offset, size_t n_buffers, size_t n_parameters) {
+    std::vector<size_t> offsets;
+    size_t offset = optimizer_offset + sizeof(ModelFileOptimizer);
+    for (size_t k = 0; k < n_buffers; ++k) {
+        offset = model_file_align(offset);
+        offsets.push_back(offset);
+        offset += n_parameters * sizeof(T);
+    }
+    return offsets;
+}
+
+/*
+ * Checks everything the header promises against the size of the file,
+ * before any count in it is used to size or address memory.
+*/
+template <typename T>
+void check_model_header(const ModelFileHeader &header, size_t file_size) {
+    if (std::memcmp(header.magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC)) != 0) {
+        throw std::invalid_argument("model file: not a model file");
+    }
+    if (header.version != MODEL_FILE_VERSION) {
+        throw std::invalid_argument("model file: unsupported version " + std::to_string(header.version));
+    }
+    if (header.byte_order != MODEL_FILE_BYTE_ORDER) {
+        throw std::invalid_argument("model file: written with another byte order");
+    }
+    if (header.dtype != model_file_dtype<T>() || header.element_size != sizeof(T)) {
+        throw std::invalid_argument("model file: parameters are of another type");
+    }
+    if (header.n_layers > file_size / sizeof(ModelFileLayer) || header.n_parameters > file_size / sizeof(T) ||
+        sizeof(ModelFileHeader) + header.n_layers * sizeof(ModelFileLayer) > header.parameters_offset ||
+        header.parameters_offset > file_size || header.n_parameters * sizeof(T) > file_size - header.parameters_offset) {
+        throw std::invalid_argument("model file: truncated");
+    }
+    // The parameters are read in place from a mapping.
+    if (header.parameters_offset % alignof(T) != 0) {
+        throw std::invalid_argument("model file: parameters are misaligned");
+    }
+    size_t end = header.parameters_offset + header.n_parameters * sizeof(T);
+    if (header.optimizer_offset && (header.optimizer_offset < end || header.optimizer_offset > file_size ||
+        sizeof(ModelFileOptimizer) > file_size - header.optimizer_offset)) {
+        throw std::invalid_argument("model file: truncated");
+    }
+}
+
+template <typename T>
+std::vector<LayerShape> model_file_shapes(const ModelFileHeader &header, const ModelFileLayer *layers) {
+    std::vector<LayerShape> shapes;
+    size_t n_parameters = 0;
+    for (size_t k = 0; k < header.n_layers; ++k) {
+        const ModelFileLayer &layer = layers[k];
+        // Compared by division first, so that no product can overflow.
+        if (layer.output_size == 0 || layer.input_size >= header.n_parameters / layer.output_size ||
+            (layer.input_size + 1) * layer.output_size > header.n_parameters - n_parameters ||
+            (k && layer.input_size != layers[k - 1].output_size)) {
+            throw std::invalid_argument("model file: inconsistent layer sizes");
+        }
+        n_parameters += (layer.input_size + 1) * layer.output_size;
+        shapes.push_back({layer.input_size, layer.output_size, layer.use_activation != 0});
+    }
+    if (n_parameters != header.n_parameters) {
+        throw std::invalid_argument("model file: inconsistent layer sizes");
+    }
+    return shapes;
+}
+
+template <typename T>
+void save_model(const std::string &path, const std::vector<LayerShape> &layers, const T *parameters,
+                optimizer<T> *optim) {
+    ModelFileHeader header{};
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC));
+    header.version = MODEL_FILE_VERSION;
+    header.byte_order = MODEL_FILE_BYTE_ORDER;
+    header.dtype = model_file_dtype<T>();
+    header.element_size = sizeof(T);
+    header.n_layers = layers.size();
+    header.n_parameters = 0;
+    for (auto & layer : layers) header.n_parameters += (layer.input_size + 1) * layer.output_size;
+    header.parameters_offset = model_file_align(sizeof(ModelFileHeader) + layers.size() * sizeof(ModelFileLayer));
+    header.optimizer_offset = optim ? model_file_align(header.parameters_offset + header.n_parameters * sizeof(T)) : 0;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("save_model: cannot open " + path);
+    }
+    auto write = [&](size_t offset, const void *data, size_t bytes) {
+        static const char zeros[MODEL_FILE_ALIGNMENT] = {};
+        file.write(zeros, static_cast<std::streamsize>(offset - static_cast<size_t>(file.tellp())));
+        file.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+    };
+
+    write(0, &header, sizeof(header));
+    for (auto & layer : layers) {
+        ModelFileLayer entry{layer.input_size, layer.output_size, layer.use_activation};
+        write(static_cast<size_t>(file.tellp()), &entry, sizeof(entry));
+    }
+    write(header.parameters_offset, parameters, header.n_parameters * sizeof(T));
+
+    if (optim) {
+        std::vector<T *> buffers = optim->state_buffers();
+        typename optimizer<T>::Counters counters = optim->get_counters();
+        ModelFileOptimizer state{{}, buffers.size(), counters.steps, counters.accumulated, counters.good_steps,
+                                 static_cast<double>(counters.loss_scale)};
+        std::strncpy(state.kind, optim->get_name(), sizeof(state.kind) - 1);
+        write(header.optimizer_offset, &state, sizeof(state));
+
+        auto offsets = model_file_buffer_offsets<T>(header.optimizer_offset, buffers.size(), header.n_parameters);
+        for (size_t k = 0; k < buffers.size(); ++k) {
+            write(offsets[k], buffers[k], header.n_parameters * sizeof(T));
+        }
+    }
+
+    if (!file.flush()) {
+        throw std::runtime_error("save_model: cannot write " + path);
+    }
+}
+
+template <typename T>
+void save_model(const std::string &path, NN<T> &model, optimizer<T> *optim) {
+    std::vector<LayerShape> shapes;
+    for (auto & linear : model.get_layers()) {
+        shapes.push_back({linear.get_input_size(), linear.get_output_size(), linear.has_activation()});
+    }
+    save_model(path, shapes, model.get_parameter_data(), optim);
+}
+
+/*
+ * Opens a model file for streaming and reads and checks its header.
+*/
+template <typename T>
+std::ifstream open_model_file(const std::string &path, ModelFileHeader &header, size_t &file_size) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("model file: cannot open " + path);
+    }
+    file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    if (file_size < sizeof(header) || !file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        throw std::invalid_argument("model file: truncated");
+    }
+    check_model_header<T>(header, file_size);
+    return file;
+}
+
+template <typename T>
+NN<T> load_model(const std::string &path) {
+    ModelFileHeader header;
+    size_t file_size;
+    std::ifstream file = open_model_file<T>(path, header, file_size);
+
+    std::vector<ModelFileLayer> layers(header.n_layers);
+    file.read(reinterpret_cast<char *>(layers.data()), static_cast<std::streamsize>(layers.size() * sizeof(ModelFileLayer)));
+
+    NN<T> model;
+    for (auto & shape : model_file_shapes<T>(header, layers.data())) {
+        model.add_linear_layer(shape.input_size, shape.output_size, shape.use_activation);
+    }
+
+    file.seekg(static_cast<std::streamoff>(header.parameters_offset));
+    if (!file.read(reinterpret_cast<char *>(model.get_parameter_data()),
+                   static_cast<std::streamsize>(header.n_parameters * sizeof(T)))) {
+        throw std::runtime_error("load_model: cannot read " + path);
+    }
+    return model;
+}
+
+template <typename T>
+void load_optimizer_state(const std::string &path, optimizer<T> &optim) {
+    ModelFileHeader header;
+    size_t file_size;
+    std::ifstream file = open_model_file<T>(path, header, file_size);
+    if (!header.optimizer_offset) {
+        throw std::invalid_argument("load_optimizer_state: the file has no optimizer state");
+    }
+
+    ModelFileOptimizer state;
+    file.seekg(static_cast<std::streamoff>(header.optimizer_offset));
+    file.read(reinterpret_cast<char *>(&state), sizeof(state));
+
+    std::string kind(state.kind, std::find(state.kind, std::end(state.kind), '\0'));
+    if (kind != optim.get_name()) {
+        throw std::invalid_argument("load_optimizer_state: saved by " + kind + ", not " + optim.get_name());
+    }
+    std::vector<T *> buffers = optim.state_buffers();
+    if (state.n_buffers != buffers.size() || header.n_parameters != optim.get_parameter_count()) {
+        throw std::invalid_argument("load_optimizer_state: saved by another optimizer or for another model");
+    }
+    auto offsets = model_file_buffer_offsets<T>(header.optimizer_offset, buffers.size(), header.n_parameters);
+    for (size_t k = 0; k < buffers.size(); ++k) {
+        if (offsets[k] + header.n_parameters * sizeof(T) > file_size) {
+            throw std::invalid_argument("model file: truncated");
+        }
+        file.seekg(static_cast<std::streamoff>(offsets[k]));
+        file.read(reinterpret_cast<char *>(buffers[k]), static_cast<std::streamsize>(header.n_parameters * sizeof(T)));
+    }
+    if (!file) {
+        throw std::runtime_error("load_optimizer_state: cannot read " + path);
+    }
+
+    optim.set_counters({state.steps, state.accumulated, state.good_steps, static_cast<T>(state.loss_scale)});
+}
+
+template <typename T>
+MappedModel<T>::MappedModel(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("MappedModel: cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw std::runtime_error("MappedModel: cannot stat " + path + ": " + std::strerror(errno));
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ < sizeof(ModelFileHeader)) {
+        ::close(fd);
+        throw std::invalid_argument("MappedModel: " + path + " is too small for a model file");
+    }
+    mapping_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (mapping_ == MAP_FAILED) {
+        throw std::runtime_error("MappedModel: cannot map " + path + ": " + std::strerror(error));
+    }
+
+    try {
+        const char *base = static_cast<const char *>(mapping_);
+        const ModelFileHeader &header = *reinterpret_cast<const ModelFileHeader *>(base);
+        check_model_header<T>(header, size_);
+        layers_ = model_file_shapes<T>(header, reinterpret_cast<const ModelFileLayer *>(base + sizeof(ModelFileHeader)));
+        parameters_ = reinterpret_cast<const T *>(base + header.parameters_offset);
+    } catch (...) {
+        ::munmap(mapping_, size_);
+        throw;
+    }
+}
+
+template <typename T>
+MappedModel<T>::~MappedModel() {
+    ::munmap(mapping_, size_);
+}
+
+template <typename T>
+const std::vector<LayerShape> &MappedModel<T>::get_layers() const {
+    return layers_;
+}
+
+template <typename T>
+size_t MappedModel<T>::get_parameter_count() const {
+    size_t n_parameters = 0;
+    for (auto & layer : layers_) n_parameters += (layer.input_size + 1) * layer.output_size;
+    return n_parameters;
+}
+
+template <typename T>
+const T *MappedModel<T>::get_parameter_data() const {
+    return parameters_;
+}
+
+template <typename T>
+InferenceNN<T> MappedModel<T>::inference() const {
+    return InferenceNN<T>(layers_, parameters_);
+}
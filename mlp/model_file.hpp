@@ -0,0 +1,105 @@
+#pragma once
+
+#include "inference.cpp"
+#include <cstring>
+#include <fstream>
+#include <string>
+
+/*
+ * Binary model files.
+ *
+ * Layout, in host byte order, every block starting on a 64-byte boundary:
+ *
+ *   ModelFileHeader     magic, version, byte order, element type and size,
+ *                       number of layers and parameters, block offsets
+ *   ModelFileLayer[]    the topology, one entry per Linear layer
+ *   parameters          the flat parameter buffer of the model, exactly as
+ *                       NN::get_parameter_data() holds it
+ *   optimizer state     optional: ModelFileOptimizer (kind and counters),
+ *                       then every state buffer of the optimizer, each
+ *                       64-byte aligned
+ *
+ * Nothing needs parsing besides the header and the topology, so a file can
+ * be used in place: MappedModel maps it read-only and serves an
+ * InferenceNN straight from the mapped parameters, and opening a model
+ * costs a few system calls however large it is; the pages are read on
+ * first use. load_model() streams the parameters into a new NN for
+ * further training, and load_optimizer_state() restores the state of an
+ * optimizer of the same kind built on it.
+ *
+ * Malformed files (bad magic, another version, element type, byte order
+ * or optimizer, truncated blocks) throw std::invalid_argument, I/O errors
+ * std::runtime_error.
+*/
+
+constexpr uint32_t MODEL_FILE_VERSION = 2;
+constexpr size_t MODEL_FILE_ALIGNMENT = 64;
+
+struct ModelFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t dtype;
+    uint32_t element_size;
+    uint64_t n_layers;
+    uint64_t n_parameters;
+    uint64_t parameters_offset;
+    uint64_t optimizer_offset;
+};
+
+struct ModelFileLayer {
+    uint64_t input_size;
+    uint64_t output_size;
+    uint64_t use_activation;
+};
+
+struct ModelFileOptimizer {
+    char kind[16];
+    uint64_t n_buffers;
+    uint64_t steps;
+    uint64_t accumulated;
+    uint64_t good_steps;
+    double loss_scale;
+};
+
+template <typename T = double>
+void save_model(const std::string &path, const std::vector<LayerShape> &layers, const T *parameters,
+                optimizer<T> *optim = nullptr);
+
+template <typename T = double>
+void save_model(const std::string &path, NN<T> &model, optimizer<T> *optim = nullptr);
+
+template <typename T = double>
+NN<T> load_model(const std::string &path);
+
+/*
+ * Restores the counters and state buffers saved with the model into optim,
+ * which must be of the kind that saved them and built on a model of the
+ * same size. Loss scaling has to be enabled before, since enabling it
+ * resets the scale.
+*/
+template <typename T = double>
+void load_optimizer_state(const std::string &path, optimizer<T> &optim);
+
+template <typename T = double>
+class MappedModel {
+private:
+    void *mapping_;
+    size_t size_;
+    std::vector<LayerShape> layers_;
+    const T *parameters_;
+
+public:
+    explicit MappedModel(const std::string &path);
+    ~MappedModel();
+
+    MappedModel(const MappedModel &) = delete;
+    MappedModel &operator=(const MappedModel &) = delete;
+
+    const std::vector<LayerShape> &get_layers() const;
+    size_t get_parameter_count() const;
+    const T *get_parameter_data() const;
+
+    // Borrows the mapped parameters: the MappedModel must outlive it.
+    InferenceNN<T> inference() const;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "optimizers.hpp"
+
+template <typename T>
+SGD<T>::SGD(NN<T> &model, T learning_rate, T momentum, bool nesterov, T weight_decay, size_t accumulation_steps)
+    : optimizer<T>(model, learning_rate, accumulation_steps) {
+    momentum_ = momentum;
+    nesterov_ = nesterov;
+    weight_decay_ = weight_decay;
+    velocity_.assign(model.get_parameter_count(), T(0.0));
+}
+
+template <typename T>
+void SGD<T>::update(T *data, const T *grad, size_t n, T grad_scale) {
+    const T lr = this->lr_, momentum = momentum_, weight_decay = weight_decay_;
+    const bool nesterov = nesterov_;
+    T *velocity = velocity_.data();
+
+    simd_for<T>(n, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        V p = simd_load<V>(data + i);
+        V g = grad_scale * simd_load<V>(grad + i) + weight_decay * p;
+        V v = momentum * simd_load<V>(velocity + i) + g;
+        simd_store(velocity + i, v);
+        simd_store(data + i, p - lr * (nesterov ? g + momentum * v : v));
+    });
+}
+
+template <typename T>
+std::vector<T *> SGD<T>::state_buffers() {
+    return {velocity_.data()};
+}
+
+template <typename T>
+const char *SGD<T>::get_name() const {
+    return "SGD momentum";
+}
+
+template <typename T>
+Adam<T>::Adam(NN<T> &model, T learning_rate, T beta1, T beta2, T eps, T weight_decay, size_t accumulation_steps)
+    : optimizer<T>(model, learning_rate, accumulation_steps) {
+    beta1_ = beta1;
+    beta2_ = beta2;
+    eps_ = eps;
+    weight_decay_ = weight_decay;
+    decoupled_weight_decay_ = false;
+    m_.assign(model.get_parameter_count(), T(0.0));
+    v_.assign(model.get_parameter_count(), T(0.0));
+}
+
+/*
+ * The bias corrections are folded into the step size and epsilon:
+ * lr * m_hat / (sqrt(v_hat) + eps) = step * m / (sqrt(v) + eps_hat).
+*/
+template <typename T>
+void Adam<T>::update(T *data, const T *grad, size_t n, T grad_scale) {
+    const T beta1 = beta1_, beta2 = beta2_;
+    const T correction1 = T(1.0) - std::pow(beta1, T(this->steps_));
+    const T correction2 = std::sqrt(T(1.0) - std::pow(beta2, T(this->steps_)));
+    const T step = this->lr_ * correction2 / correction1;
+    const T eps = eps_ * correction2;
+    const T l2 = decoupled_weight_decay_ ? T(0.0) : weight_decay_;
+    const T decay = decoupled_weight_decay_ ? T(1.0) - this->lr_ * weight_decay_ : T(1.0);
+    T *m_data = m_.data(), *v_data = v_.data();
+
+    simd_for<T>(n, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        V p = simd_load<V>(data + i);
+        V g = grad_scale * simd_load<V>(grad + i) + l2 * p;
+        V m = beta1 * simd_load<V>(m_data + i) + (T(1.0) - beta1) * g;
+        V v = beta2 * simd_load<V>(v_data + i) + (T(1.0) - beta2) * g * g;
+        simd_store(m_data + i, m);
+        simd_store(v_data + i, v);
+        simd_store(data + i, decay * p - step * m / (simd_sqrt(v) + eps));
+    });
+}
+
+template <typename T>
+std::vector<T *> Adam<T>::state_buffers() {
+    return {m_.data(), v_.data()};
+}
+
+template <typename T>
+const char *Adam<T>::get_name() const {
+    return "Adam";
+}
+
+template <typename T>
+AdamW<T>::AdamW(NN<T> &model, T learning_rate, T weight_decay, T beta1, T beta2, T eps, size_t accumulation_steps)
+    : Adam<T>(model, learning_rate, beta1, beta2, eps, weight_decay, accumulation_steps) {
+    this->decoupled_weight_decay_ = true;
+}
+
+template <typename T>
+const char *AdamW<T>::get_name() const {
+    return "AdamW";
+}
+
+template <typename T>
+RMSProp<T>::RMSProp(NN<T> &model, T learning_rate, T alpha, T eps, T momentum, size_t accumulation_steps)
+    : optimizer<T>(model, learning_rate, accumulation_steps) {
+    alpha_ = alpha;
+    eps_ = eps;
+    momentum_ = momentum;
+    square_avg_.assign(model.get_parameter_count(), T(0.0));
+    velocity_.assign(model.get_parameter_count(), T(0.0));
+}
+
+template <typename T>
+void RMSProp<T>::update(T *data, const T *grad, size_t n, T grad_scale) {
+    const T lr = this->lr_, alpha = alpha_, eps = eps_, momentum = momentum_;
+    T *square_avg = square_avg_.data(), *velocity = velocity_.data();
+
+    simd_for<T>(n, [&](size_t i, auto lanes) {
+        using V = decltype(lanes);
+        V g = grad_scale * simd_load<V>(grad + i);
+        V s = alpha * simd_load<V>(square_avg + i) + (T(1.0) - alpha) * g * g;
+        V v = momentum * simd_load<V>(velocity + i) + g / (simd_sqrt(s) + eps);
+        simd_store(square_avg + i, s);
+        simd_store(velocity + i, v);
+        simd_store(data + i, simd_load<V>(data + i) - lr * v);
+    });
+}
+
+template <typename T>
+std::vector<T *> RMSProp<T>::state_buffers() {
+    return {square_avg_.data(), velocity_.data()};
+}
+
+template <typename T>
+const char *RMSProp<T>::get_name() const {
+    return "RMSProp";
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mlp.cpp"
+
+/*
+ * Optimizers with per-parameter state.
+ *
+ * The state (momentum, moment estimates) is kept in aligned arrays laid out
+ * like the flat parameter buffer of the model, and every update is a single
+ * vectorized pass that reads the gradient once and writes the parameter
+ * and the state in place.
+ *
+ * All of them are used through the optimizer<T> interface: zero_grad(),
+ * step() and gradient accumulation work the same way as for plain SGD.
+*/
+
+/*
+ * SGD with momentum: v = momentum * v + g, then p -= lr * v, or
+ * p -= lr * (g + momentum * v) with Nesterov momentum. weight_decay adds
+ * weight_decay * p to the gradient.
+*/
+template <typename T = double>
+class SGD : public optimizer<T> {
+private:
+    T momentum_;
+    bool nesterov_;
+    T weight_decay_;
+    AlignedVector<T> velocity_;
+
+protected:
+    void update(T *data, const T *grad, size_t n, T grad_scale) override;
+
+public:
+    SGD(NN<T> &model, T learning_rate, T momentum = T(0.9), bool nesterov = false,
+        T weight_decay = T(0.0), size_t accumulation_steps = 1);
+
+    std::vector<T *> state_buffers() override;
+    const char *get_name() const override;
+};
+
+/*
+ * Adam with bias-corrected moment estimates. weight_decay is added to the
+ * gradient (L2 regularization); AdamW decouples it instead.
+*/
+template <typename T = double>
+class Adam : public optimizer<T> {
+private:
+    T beta1_;
+    T beta2_;
+    T eps_;
+    T weight_decay_;
+    AlignedVector<T> m_;
+    AlignedVector<T> v_;
+
+protected:
+    bool decoupled_weight_decay_;
+
+    void update(T *data, const T *grad, size_t n, T grad_scale) override;
+
+public:
+    Adam(NN<T> &model, T learning_rate = T(1e-3), T beta1 = T(0.9), T beta2 = T(0.999),
+         T eps = T(1e-8), T weight_decay = T(0.0), size_t accumulation_steps = 1);
+
+    std::vector<T *> state_buffers() override;
+    const char *get_name() const override;
+};
+
+/*
+ * Adam with decoupled weight decay: p -= lr * weight_decay * p on every
+ * step, independently of the adaptive gradient step.
+*/
+template <typename T = double>
+class AdamW : public Adam<T> {
+public:
+    AdamW(NN<T> &model, T learning_rate = T(1e-3), T weight_decay = T(1e-2), T beta1 = T(0.9),
+          T beta2 = T(0.999), T eps = T(1e-8), size_t accumulation_steps = 1);
+
+    const char *get_name() const override;
+};
+
+/*
+ * RMSProp: s = alpha * s + (1 - alpha) * g^2, p -= lr * g / (sqrt(s) + eps),
+ * with optional momentum on the scaled step.
+*/
+template <typename T = double>
+class RMSProp : public optimizer<T> {
+private:
+    T alpha_;
+    T eps_;
+    T momentum_;
+    AlignedVector<T> square_avg_;
+    AlignedVector<T> velocity_;
+
+protected:
+    void update(T *data, const T *grad, size_t n, T grad_scale) override;
+
+public:
+    RMSProp(NN<T> &model, T learning_rate = T(1e-3), T alpha = T(0.99), T eps = T(1e-8),
+            T momentum = 0.0, size_t accumulation_steps = 1);
+
+    std::vector<T *> state_buffers() override;
+    const char *get_name() const override;
+};
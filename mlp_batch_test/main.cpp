@@ -0,0 +1,91 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+
+/*
+ * The mlp_test task trained with mini-batches: every step runs one
+ * forward / backward over a (batch, 4) tensor with a mean-reduced loss.
+ * A batch of 20 is split into two micro-batches of 10 whose gradients
+ * are accumulated by the optimizer before the update.
+*/
+
+double function(double x1, double x2, double x3, double x4) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(-0.01, 0.01);
+
+    return x1 * x2 - x3 + x4 * x4 + dis(gen);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(-5.0, 5.0);
+
+    size_t n_samples = 100, micro_batch = 10, accumulation_steps = 2;
+    std::vector<double> X(n_samples * 4), Y(n_samples);
+    for (size_t i = 0; i < n_samples; ++i) {
+        for (size_t k = 0; k < 4; ++k) X[i * 4 + k] = dis(gen);
+        Y[i] = function(X[i * 4], X[i * 4 + 1], X[i * 4 + 2], X[i * 4 + 3]);
+    }
+
+    std::vector<std::shared_ptr<Tensor<double>>> inputs, targets;
+    for (size_t i = 0; i < n_samples; i += micro_batch) {
+        inputs.emplace_back(std::make_shared<Tensor<double>>(
+            std::vector<size_t>{micro_batch, 4},
+            std::vector<double>(X.begin() + i * 4, X.begin() + (i + micro_batch) * 4)
+        ));
+        targets.emplace_back(std::make_shared<Tensor<double>>(
+            std::vector<size_t>{micro_batch, 1},
+            std::vector<double>(Y.begin() + i, Y.begin() + i + micro_batch)
+        ));
+    }
+
+    NN nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+
+    optimizer<double> optim(nn, 0.002, accumulation_steps);
+
+    size_t epoches = 1000;
+    auto start = std::chrono::steady_clock::now();
+
+    optim.zero_grad();
+    for (size_t i = 0; i < epoches; ++i) {
+        double loss_per_epoch = 0.0;
+        for (size_t j = 0; j < inputs.size(); ++j) {
+            std::shared_ptr<Tensor<double>> loss = mse_loss(nn(inputs[j]), targets[j]);
+            loss_per_epoch += loss->get_data_value() / inputs.size();
+
+            loss->backward();
+            if (optim.step()) optim.zero_grad();
+        }
+        if (i == 0 || (i + 1) % 100 == 0) std::cout << "Epoch " << i + 1 << " Loss: " << loss_per_epoch << std::endl;
+    }
+    double batch_time = seconds_since(start);
+
+    // The same number of samples through the per-sample scalar loop of mlp_test.
+    std::vector<std::vector<std::shared_ptr<Variable<double>>>> samples(n_samples);
+    for (size_t i = 0; i < n_samples; ++i) {
+        for (size_t k = 0; k < 4; ++k) samples[i].emplace_back(std::make_shared<Variable<double>>(X[i * 4 + k]));
+    }
+    size_t scalar_epoches = 20;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scalar_epoches; ++i) {
+        for (size_t j = 0; j < n_samples; ++j) {
+            std::shared_ptr<Variable<double>> loss = (Y[j] - nn(samples[j])[0])->square();
+            optim.zero_grad();
+            loss->backward();
+        }
+    }
+    double scalar_time = seconds_since(start);
+
+    std::cout << std::endl;
+    std::cout << "Mini-batch training: " << epoches * n_samples / batch_time << " samples/s" << std::endl;
+    std::cout << "Per-sample training: " << scalar_epoches * n_samples / scalar_time << " samples/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "../mlp/mlp.cpp"
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <unistd.h>
+
+/*
+ * Trains the mlp_test network for many steps and checks that neither the
+ * number of live heap blocks nor the resident set size grows over time.
+*/
+static long live_allocations = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    ++live_allocations;
+    if (void *ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    if (ptr) --live_allocations;
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept {
+    if (ptr) --live_allocations;
+    std::free(ptr);
+}
+
+long resident_kb() {
+    long pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-5.0, 5.0);
+
+    NN nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+
+    optimizer<double> optim(nn, 0.0001);
+
+    size_t steps = 20000;
+    long baseline_allocations = 0, baseline_rss = 0;
+
+    std::vector<std::shared_ptr<Variable<double>>> x(4);
+
+    for (size_t i = 1; i <= steps; ++i) {
+        for (auto & input : x) input = std::make_shared<Variable<double>>(dis(gen));
+        double target = x[0]->get_data_value() * x[1]->get_data_value() - x[2]->get_data_value();
+
+        {
+            std::shared_ptr<Variable<double>> loss = (target - nn(x)[0])->square();
+
+            optim.zero_grad();
+            loss->backward();
+            optim.step();
+        }
+
+        if (i == 1000 || i % 5000 == 0) {
+            std::cout << "Step " << i << " live allocations: " << live_allocations << ", RSS: " << resident_kb() << " kB" << std::endl;
+        }
+        if (i == 1000) {
+            baseline_allocations = live_allocations;
+            baseline_rss = resident_kb();
+        }
+    }
+
+    bool flat = live_allocations == baseline_allocations && resident_kb() <= baseline_rss + 1024;
+    std::cout << std::endl;
+    std::cout << (flat ? "Memory is flat" : "Memory grows") << " after " << steps << " steps" << std::endl;
+    return flat ? 0 : 1;
+}
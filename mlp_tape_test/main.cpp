@@ -0,0 +1,94 @@
+#include "../mlp/mlp.cpp"
+#include <cstdlib>
+#include <new>
+
+/*
+ * Counts every heap allocation of the program, to check that a tape
+ * training step, optimizer included, does not allocate once the tape has
+ * been warmed up.
+*/
+static size_t allocations = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    ++allocations;
+    if (void *ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+double function(double x1, double x2, double x3, double x4) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(-0.01, 0.01);
+
+    return x1 * x2 - x3 + x4 * x4 + dis(gen);
+}
+
+int main() {
+    /*
+     * Same task as mlp_test, but the data is stored as plain doubles
+     * and every step is recorded on a Tape.
+    */
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(-5.0, 5.0);
+
+    std::vector<std::vector<double>> X(100, std::vector<double>(4));
+    std::vector<double> Y(100);
+    for (int i = 0; i < 100; ++i) {
+        for (auto & x : X[i]) x = dis(gen);
+        Y[i] = function(X[i][0], X[i][1], X[i][2], X[i][3]);
+    }
+
+    NN nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+
+    optimizer<double> optim(nn, 0.0001);
+
+    Tape<double> tape;
+    std::vector<TapeVariable<double>> input(4);
+
+    size_t step_allocations = 0;
+
+    auto train_step = [&](int j) {
+        size_t before = allocations;
+        optim.zero_grad();
+        tape.clear();
+        for (size_t k = 0; k < 4; ++k) {
+            input[k] = tape.variable(X[j][k]);
+        }
+        const std::vector<TapeVariable<double>> &output = nn(tape, input);
+        TapeVariable<double> loss = (tape.variable(Y[j]) - output[0]).pow(tape.variable(2.0));
+
+        loss.backward();
+        optim.step();
+        step_allocations += allocations - before;
+        return loss.get_data_value();
+    };
+
+    train_step(0); // warmup: grows the tape and the layer buffers;
+    std::cout << "Tape nodes per step: " << tape.size() << std::endl;
+    step_allocations = 0;
+
+    size_t epoches = 100;
+
+    for (size_t i = 0; i < epoches; ++i) {
+        double loss_per_epoch = 0.0;
+        for (int j = 0; j < 100; ++j) {
+            loss_per_epoch += train_step(j) / 100.0;
+        }
+        if (i == 0 || (i + 1) % 10 == 0) std::cout << "Epoch " << i + 1 << " Loss: " << loss_per_epoch << std::endl;
+    }
+    std::cout << std::endl;
+    std::cout << "Heap allocations during tape forward + backward + optimizer step: " << step_allocations << std::endl;
+    return step_allocations == 0 ? 0 : 1;
+}
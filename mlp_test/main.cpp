@@ -56,8 +56,7 @@ int main() {
         double loss_per_epoch = 0.0;
         for (int j = 0; j < 100; ++j) {
             std::vector<std::shared_ptr<Variable<double>>> output = nn(X[j]);
-            std::shared_ptr<Variable<double>> loss = Y[j] - output[0];
-            loss = loss->pow(std::make_shared<Variable<double>>(2.0));
+            std::shared_ptr<Variable<double>> loss = (Y[j] - output[0])->square();
 
             loss_per_epoch += loss->get_data_value() / 100.0;
 
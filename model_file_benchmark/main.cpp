@@ -0,0 +1,160 @@
+#include "../mlp/model_file.cpp"
+#include "../mlp/optimizers.cpp"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Model files: training resumed from a file (parameters and Adam state)
+ * must continue exactly like the original run, the state must not load
+ * into another kind of optimizer, a mapped model must predict like the
+ * model it was saved from, and a damaged file must be rejected. Then a
+ * 1 GB model is saved and opened by mapping and by reading: opening the
+ * mapping costs the same for any size, the pages are faulted in by the
+ * first prediction.
+*/
+
+typedef std::shared_ptr<Tensor<double>> Pointer;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double max_difference(const double *a, const double *b, size_t n) {
+    double difference = 0.0;
+    for (size_t i = 0; i < n; ++i) difference = std::max(difference, std::abs(a[i] - b[i]));
+    return difference;
+}
+
+void round_trip(const std::string &path) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dis(-2.0, 2.0);
+    std::vector<Pointer> inputs, targets;
+    for (size_t b = 0; b < 10; ++b) {
+        std::vector<double> x(20 * 4), y(20);
+        for (size_t j = 0; j < 20; ++j) {
+            for (size_t k = 0; k < 4; ++k) x[j * 4 + k] = dis(gen);
+            y[j] = x[j * 4] * x[j * 4 + 1] - x[j * 4 + 2] + x[j * 4 + 3] * x[j * 4 + 3];
+        }
+        inputs.push_back(std::make_shared<Tensor<double>>(std::vector<size_t>{20, 4}, x));
+        targets.push_back(std::make_shared<Tensor<double>>(std::vector<size_t>{20, 1}, y));
+    }
+    auto train = [&](NN<double> &nn, optimizer<double> &optim, size_t epochs) {
+        for (size_t epoch = 0; epoch < epochs; ++epoch) {
+            for (size_t j = 0; j < inputs.size(); ++j) {
+                optim.zero_grad();
+                mse_loss(nn(inputs[j]), targets[j])->backward();
+                optim.step();
+            }
+        }
+    };
+
+    NN<double> nn;
+    nn.add_linear_layer(4, 32, true);
+    nn.add_linear_layer(32, 32, true);
+    nn.add_linear_layer(32, 1, false);
+    Adam<double> optim(nn, 3e-3);
+    train(nn, optim, 50);
+    save_model(path, nn, &optim);
+
+    NN<double> restored = load_model<double>(path);
+    Adam<double> restored_optim(restored, 3e-3);
+    load_optimizer_state(path, restored_optim);
+
+    train(nn, optim, 50);
+    train(restored, restored_optim, 50);
+    std::cout << "Training resumed from the file, after 50 more epochs: max parameter difference "
+              << max_difference(nn.get_parameter_data(), restored.get_parameter_data(), nn.get_parameter_count())
+              << std::endl;
+    try {
+        AdamW<double> other_optim(restored, 3e-3);
+        load_optimizer_state(path, other_optim);
+        std::cout << "Adam state accepted by AdamW" << std::endl;
+    } catch (const std::invalid_argument &error) {
+        std::cout << "Adam state rejected by AdamW: " << error.what() << std::endl;
+    }
+
+    save_model(path, nn);
+    MappedModel<double> mapped(path);
+    InferenceNN<double> from_file = mapped.inference(), from_model(nn);
+    double difference = 0.0;
+    for (size_t j = 0; j < inputs.size(); ++j) {
+        for (size_t r = 0; r < 20; ++r) {
+            double a, b;
+            from_file(inputs[j]->get_data() + r * 4, &a);
+            from_model(inputs[j]->get_data() + r * 4, &b);
+            difference = std::max(difference, std::abs(a - b));
+        }
+    }
+    std::cout << "Mapped model vs model: max prediction difference " << difference << std::endl;
+
+    {
+        // Moves the parameters by 4 bytes, still within the file.
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        ModelFileHeader header;
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        header.parameters_offset += 4;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.seekp(0, std::ios::end);
+        file.write("\0\0\0\0", 4);
+    }
+    try {
+        MappedModel<double> misaligned(path);
+        std::cout << "Misaligned parameters accepted" << std::endl;
+    } catch (const std::invalid_argument &error) {
+        std::cout << "Misaligned parameters rejected: " << error.what() << std::endl;
+    }
+
+    if (::truncate(path.c_str(), 100) != 0) return;
+    try {
+        MappedModel<double> damaged(path);
+        std::cout << "Truncated file accepted" << std::endl;
+    } catch (const std::invalid_argument &error) {
+        std::cout << "Truncated file rejected: " << error.what() << std::endl;
+    }
+    std::remove(path.c_str());
+}
+
+void large_model(const std::string &path, size_t width) {
+    std::vector<LayerShape> shapes = {{width, width, true}, {width, 1, false}};
+    size_t n_parameters = (width + 1) * width + width + 1;
+    {
+        AlignedVector<float> parameters(n_parameters, 0.001f);
+        auto start = std::chrono::steady_clock::now();
+        save_model(path, shapes, parameters.data());
+        std::cout << std::endl << "Model of " << n_parameters * sizeof(float) / (1 << 20) << " MB: saved in "
+                  << seconds_since(start) << " s" << std::endl;
+    }
+
+    std::vector<float> input(width, 1.0f);
+    float output;
+    {
+        auto start = std::chrono::steady_clock::now();
+        MappedModel<float> mapped(path);
+        InferenceNN<float> model = mapped.inference();
+        std::cout << "  mapped:   opened in " << seconds_since(start) * 1e6 << " us";
+
+        start = std::chrono::steady_clock::now();
+        model(input.data(), &output);
+        std::cout << ", first prediction (page faults) " << seconds_since(start) * 1e3 << " ms";
+
+        start = std::chrono::steady_clock::now();
+        model(input.data(), &output);
+        std::cout << ", second " << seconds_since(start) * 1e3 << " ms" << std::endl;
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        AlignedVector<float> parameters(n_parameters);
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(model_file_align(sizeof(ModelFileHeader) + 2 * sizeof(ModelFileLayer))));
+        file.read(reinterpret_cast<char *>(parameters.data()), static_cast<std::streamsize>(n_parameters * sizeof(float)));
+        std::cout << "  streamed: parameters read in " << seconds_since(start) * 1e3 << " ms" << std::endl;
+    }
+    std::remove(path.c_str());
+}
+
+int main() {
+    round_trip("/tmp/model_file_benchmark.bin");
+    large_model("/tmp/model_file_benchmark_large.bin", 16384);
+    return 0;
+}
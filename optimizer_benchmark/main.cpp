@@ -0,0 +1,94 @@
+#include "../mlp/optimizers.cpp"
+#include <chrono>
+#include <functional>
+
+/*
+ * Convergence against wall-clock time on the mlp_test task (4-10-10-1 MLP,
+ * 100 samples, one update per sample) for plain SGD and the optimizers of
+ * optimizers.hpp. All runs start from the same weights; the forward and
+ * backward passes are recorded on a Tape so that the time is dominated by
+ * the training itself.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-5.0, 5.0);
+    std::uniform_real_distribution<> noise(-0.01, 0.01);
+
+    size_t n_samples = 100, epoches = 100;
+    double target_loss = 5.0;
+    std::vector<std::vector<double>> X(n_samples, std::vector<double>(4));
+    std::vector<double> Y(n_samples);
+    for (size_t i = 0; i < n_samples; ++i) {
+        for (auto & x : X[i]) x = dis(gen);
+        Y[i] = X[i][0] * X[i][1] - X[i][2] + X[i][3] * X[i][3] + noise(gen);
+    }
+
+    auto make_model = []() {
+        NN<double> nn;
+        nn.add_linear_layer(4, 10, true);
+        nn.add_linear_layer(10, 10, true);
+        nn.add_linear_layer(10, 1, false);
+        return nn;
+    };
+    // Every run starts from these weights, drawn like the default initialization but from the seeded generator.
+    NN<double> reference = make_model();
+    std::uniform_real_distribution<> init(-1.0, 1.0);
+    for (size_t i = 0; i < reference.get_parameter_count(); ++i) reference.get_parameter_data()[i] = init(gen);
+
+    std::vector<std::pair<std::string, std::function<std::unique_ptr<optimizer<double>>(NN<double> &)>>> runs = {
+        {"SGD lr=1e-4", [](NN<double> &nn) { return std::make_unique<optimizer<double>>(nn, 1e-4); }},
+        {"SGD momentum=0.9 lr=1e-4", [](NN<double> &nn) { return std::make_unique<SGD<double>>(nn, 1e-4, 0.9); }},
+        {"SGD nesterov=0.9 lr=1e-4", [](NN<double> &nn) { return std::make_unique<SGD<double>>(nn, 1e-4, 0.9, true); }},
+        {"RMSProp lr=1e-3", [](NN<double> &nn) { return std::make_unique<RMSProp<double>>(nn, 1e-3); }},
+        {"Adam lr=1e-2", [](NN<double> &nn) { return std::make_unique<Adam<double>>(nn, 1e-2); }},
+        {"AdamW lr=1e-2 wd=1e-4", [](NN<double> &nn) { return std::make_unique<AdamW<double>>(nn, 1e-2, 1e-4); }},
+    };
+
+    std::cout << "Mean loss per epoch, and time until it first drops below " << target_loss << std::endl << std::endl;
+    for (auto & [name, make_optimizer] : runs) {
+        NN<double> nn = make_model();
+        std::copy(reference.get_parameter_data(), reference.get_parameter_data() + reference.get_parameter_count(),
+                  nn.get_parameter_data());
+        std::unique_ptr<optimizer<double>> optim = make_optimizer(nn);
+
+        Tape<double> tape;
+        std::vector<TapeVariable<double>> input(4);
+        double time_to_target = -1.0;
+        size_t epoch_to_target = 0;
+        std::vector<double> losses;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < epoches; ++i) {
+            double loss_per_epoch = 0.0;
+            for (size_t j = 0; j < n_samples; ++j) {
+                optim->zero_grad();
+                tape.clear();
+                for (size_t k = 0; k < 4; ++k) input[k] = tape.variable(X[j][k]);
+                TapeVariable<double> error = tape.variable(Y[j]) - nn(tape, input)[0];
+                TapeVariable<double> loss = error * error;
+                loss.backward();
+                optim->step();
+                loss_per_epoch += loss.get_data_value() / n_samples;
+            }
+            losses.push_back(loss_per_epoch);
+            if (time_to_target < 0.0 && loss_per_epoch < target_loss) {
+                time_to_target = seconds_since(start);
+                epoch_to_target = i + 1;
+            }
+        }
+        double total = seconds_since(start);
+
+        std::cout << name << ":" << std::endl;
+        std::cout << "  loss at epoch 1 / 10 / 50 / 100: " << losses[0] << " / " << losses[9] << " / "
+                  << losses[49] << " / " << losses[99] << std::endl;
+        std::cout << "  " << epoches << " epochs in " << total * 1e3 << " ms, ";
+        if (time_to_target < 0.0) std::cout << "loss < " << target_loss << " not reached" << std::endl;
+        else std::cout << "loss < " << target_loss << " after " << time_to_target * 1e3 << " ms (epoch " << epoch_to_target << ")" << std::endl;
+    }
+    return 0;
+}
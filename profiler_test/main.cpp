@@ -0,0 +1,58 @@
+#include "../mlp/mlp.cpp"
+#include <cstdio>
+
+/*
+ * Built with -DAUTOGRAD_PROFILE (see the Makefile): the mlp_test model is
+ * trained for a few epochs inside one ProfileScope per step, with a small
+ * regularizer that uses the transcendental ops, then the per-op table is
+ * printed and the step timeline written as a Chrome trace.
+*/
+
+typedef std::shared_ptr<Variable<double>> Pointer;
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dis(-5.0, 5.0);
+    std::vector<std::vector<Pointer>> X;
+    std::vector<Pointer> Y;
+    for (int i = 0; i < 100; ++i) {
+        double x1 = dis(gen), x2 = dis(gen), x3 = dis(gen), x4 = dis(gen);
+        X.push_back({std::make_shared<Variable<double>>(x1), std::make_shared<Variable<double>>(x2),
+                     std::make_shared<Variable<double>>(x3), std::make_shared<Variable<double>>(x4)});
+        Y.push_back(std::make_shared<Variable<double>>(x1 * x2 - x3 + x4 * x4));
+    }
+
+    NN<double> nn;
+    nn.add_linear_layer(4, 10, true);
+    nn.add_linear_layer(10, 10, true);
+    nn.add_linear_layer(10, 1, false);
+    optimizer<double> optim(nn, 0.0001);
+
+    Profiler &profiler = Profiler::global();
+    profiler.reset();
+    for (size_t epoch = 0; epoch < 5; ++epoch) {
+        for (size_t j = 0; j < X.size(); ++j) {
+            ProfileScope step("step");
+            std::vector<Pointer> output = nn(X[j]);
+            Pointer loss = (Y[j] - output[0])->square();
+            Pointer penalty = output[0]->Tanh()->pow(2.0) + output[0]->Sigmoid() * (-output[0])->exp();
+            loss = loss + penalty * 1e-3;
+
+            optim.zero_grad();
+            loss->backward();
+            optim.step();
+        }
+    }
+
+    profiler.report(std::cout);
+
+    std::cout << std::endl;
+    OpProfile mul = profiler.get_op(VariableOp::Mul);
+    std::vector<GraphProfile> graphs = profiler.get_graphs();
+    std::cout << "backward calls of * equal its nodes: " << (mul.backward_calls == mul.nodes ? "yes" : "no") << std::endl;
+    std::cout << "graph of one step: " << graphs.back().nodes << " nodes, " << graphs.back().depth << " deep" << std::endl;
+
+    profiler.write_chrome_trace("profiler_trace.json");
+    std::cout << "timeline written to profiler_trace.json" << std::endl;
+    return 0;
+}
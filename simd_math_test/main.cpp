@@ -0,0 +1,181 @@
+#include "../autograd/autograd_tensor.cpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+/*
+ * The kernels of simd_math.hpp against libm: the largest error in ulp over
+ * random and small arguments for several bounds, the results at the
+ * limits of the range, and the time per element of one pass over an
+ * array next to a loop of libm calls.
+ *
+ * The references are libm in long double, and the libm rows evaluate the
+ * same stable formulas as the kernels with libm calls in T. exp has to be
+ * within the bound and the other functions within 3 ulp more, except
+ * GELU: the rounding of its gate in T is amplified by up to |gate| for
+ * negative inputs, with libm as well, so its error is only reported.
+*/
+
+typedef long double Exact;
+
+template <typename T>
+Exact ulp_error(T value, Exact exact) {
+    if (std::isnan(exact)) return std::isnan(value) ? 0.0 : INFINITY;
+    T rounded = T(exact);
+    if (!std::isfinite(rounded)) return value == rounded ? 0.0 : INFINITY;
+    Exact ulp = std::fpclassify(rounded) == FP_NORMAL
+        ? std::ldexp(Exact(1.0), std::ilogb(rounded) - std::numeric_limits<T>::digits + 1)
+        : Exact(std::numeric_limits<T>::denorm_min());
+    return std::abs(Exact(value) - exact) / ulp;
+}
+
+Exact exact_sigmoid(Exact x) { return 1.0L / (1.0L + std::exp(-x)); }
+
+Exact exact_gelu(Exact x) { return x * exact_sigmoid(1.5957691216057308L * (x + 0.044715L * x * x * x)); }
+
+template <typename T>
+T libm_sigmoid(T x) {
+    T e = std::exp(-std::abs(x));
+    return (x < T(0.0) ? e : T(1.0)) / (T(1.0) + e);
+}
+
+// Arguments spread over [-range, range], and as many of magnitude 1e-30 to 1.
+template <typename T>
+std::vector<T> arguments(T range, size_t n) {
+    std::mt19937_64 generator(7);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0), exponent(-30.0, 0.0);
+    std::vector<T> x;
+    for (size_t i = 0; i < n; ++i) x.push_back(T(range * uniform(generator)));
+    for (size_t i = 0; i < n; ++i) x.push_back(T((i % 2 ? -1.0 : 1.0) * std::pow(10.0, exponent(generator))));
+    return x;
+}
+
+template <typename T, typename Approximate, typename Reference>
+Exact max_ulp(const std::vector<T> &x, Approximate approximate, Reference reference) {
+    Exact worst = 0.0;
+    for (T value : x) worst = std::max(worst, ulp_error(approximate(value), reference(value)));
+    return worst;
+}
+
+// exp and expm1, then tanh, sigmoid, SiLU and GELU; libm itself when Ulp is 0.
+template <typename T, size_t Ulp>
+std::array<Exact, 6> accuracy() {
+    const size_t n = 1 << 19;
+    const T range = std::is_same_v<T, double> ? T(700.0) : T(87.0);
+    std::vector<T> wide = arguments<T>(range, n), narrow = arguments<T>(T(40.0), n);
+    if constexpr (Ulp == 0) {
+        return {
+            max_ulp(wide, [](T x) { return std::exp(x); }, [](T x) { return std::exp(Exact(x)); }),
+            max_ulp(wide, [](T x) { return std::expm1(x); }, [](T x) { return std::expm1(Exact(x)); }),
+            max_ulp(narrow, [](T x) { return std::tanh(x); }, [](T x) { return std::tanh(Exact(x)); }),
+            max_ulp(narrow, [](T x) { return libm_sigmoid(x); }, [](T x) { return exact_sigmoid(x); }),
+            max_ulp(narrow, [](T x) { return x * libm_sigmoid(x); }, [](T x) { return x * exact_sigmoid(x); }),
+            max_ulp(narrow, [](T x) { return x * libm_sigmoid(simd_gelu_gate(x)); }, [](T x) { return exact_gelu(x); }),
+        };
+    } else {
+        return {
+            max_ulp(wide, [](T x) { return simd_exp<Ulp>(x); }, [](T x) { return std::exp(Exact(x)); }),
+            max_ulp(wide, [](T x) { return simd_expm1<Ulp>(x); }, [](T x) { return std::expm1(Exact(x)); }),
+            max_ulp(narrow, [](T x) { return simd_tanh<Ulp>(x); }, [](T x) { return std::tanh(Exact(x)); }),
+            max_ulp(narrow, [](T x) { return simd_sigmoid<Ulp>(x); }, [](T x) { return exact_sigmoid(x); }),
+            max_ulp(narrow, [](T x) { return simd_silu<Ulp>(x); }, [](T x) { return x * exact_sigmoid(x); }),
+            max_ulp(narrow, [](T x) { return simd_gelu<Ulp>(x); }, [](T x) { return exact_gelu(x); }),
+        };
+    }
+}
+
+bool failed = false;
+
+template <typename T, size_t Ulp>
+void report(const char *type) {
+    std::array<Exact, 6> errors = accuracy<T, Ulp>();
+    char bound[32] = "libm";
+    if (Ulp) std::snprintf(bound, sizeof(bound), "%zu ulp", Ulp);
+    std::printf("%-6s %-8s", type, bound);
+    for (Exact error : errors) std::printf(" %9.2f", double(error));
+
+    bool within = true;
+    for (size_t k = 0; k + 1 < errors.size(); ++k) within &= !Ulp || errors[k] <= Exact(Ulp + (k ? 3 : 0));
+    std::printf("%s\n", within ? "" : "  over the bound");
+    failed |= !within;
+}
+
+template <typename T>
+void limits(const char *type) {
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+    std::printf("%-6s exp(1000) %g, exp(-1000) %g, exp(nan) %g, tanh(+-1000) %g %g, tanh(-0) %g, sigmoid(+-1000) %g %g, "
+                "SiLU(-1000) %g, GELU(-1000) %g\n", type,
+                double(simd_exp(T(1000.0))), double(simd_exp(T(-1000.0))), double(simd_exp(nan)),
+                double(simd_tanh(T(1000.0))), double(simd_tanh(T(-1000.0))), double(simd_tanh(T(-0.0))),
+                double(simd_sigmoid(T(1000.0))), double(simd_sigmoid(T(-1000.0))),
+                double(simd_silu(T(-1000.0))), double(simd_gelu(T(-1000.0))));
+}
+
+// Nanoseconds per element of the fastest of several passes over x.
+template <typename T, typename Pass>
+double time_pass(const std::vector<T> &x, std::vector<T> &y, Pass pass) {
+    double best = INFINITY;
+    for (size_t repeat = 0; repeat < 7; ++repeat) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < 50; ++k) pass(x.data(), y.data(), x.size());
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / double(50 * x.size()));
+    }
+    return best;
+}
+
+template <typename T, typename Kernel, typename Libm>
+void throughput(const char *type, const char *name, Kernel kernel, Libm libm) {
+    std::vector<T> x = arguments<T>(T(10.0), 2048), y(x.size());
+    double vector = time_pass(x, y, [&](const T *in, T *out, size_t n) {
+        simd_for<T>(n, [&](size_t i, auto lanes) {
+            using V = decltype(lanes);
+            simd_store(out + i, kernel(simd_load<V>(in + i)));
+        });
+    });
+    double scalar = time_pass(x, y, [&](const T *in, T *out, size_t n) {
+        for (size_t i = 0; i < n; ++i) out[i] = libm(in[i]);
+    });
+    std::printf("%-6s %-8s %8.2f %8.2f %7.1fx\n", type, name, vector, scalar, scalar / vector);
+}
+
+template <typename T>
+void throughputs(const char *type) {
+    throughput<T>(type, "exp", [](auto x) { return simd_exp(x); }, [](T x) { return std::exp(x); });
+    throughput<T>(type, "tanh", [](auto x) { return simd_tanh(x); }, [](T x) { return std::tanh(x); });
+    throughput<T>(type, "sigmoid", [](auto x) { return simd_sigmoid(x); }, [](T x) { return libm_sigmoid(x); });
+    throughput<T>(type, "SiLU", [](auto x) { return simd_silu(x); }, [](T x) { return x * libm_sigmoid(x); });
+    throughput<T>(type, "GELU", [](auto x) { return simd_gelu(x); }, [](T x) { return x * libm_sigmoid(simd_gelu_gate(x)); });
+}
+
+int main() {
+    std::printf("largest error in ulp        exp     expm1      tanh   sigmoid      SiLU      GELU\n");
+    report<double, 0>("double");
+    report<double, 1>("double");
+    report<double, 2>("double");
+    report<double, 16>("double");
+    report<double, 1024>("double");
+    report<float, 0>("float");
+    report<float, 1>("float");
+    report<float, 2>("float");
+    report<float, 16>("float");
+    report<float, 1024>("float");
+
+    std::printf("\nat the limits:\n");
+    limits<double>("double");
+    limits<float>("float");
+
+    auto x = std::make_shared<Variable<double>>(1000.0);
+    std::printf("Variable tanh(1000) %g, tanh(-1000) %g\n", x->Tanh()->get_data_value(), (-x)->Tanh()->get_data_value());
+
+    std::printf("\nns per element, %zu lanes of double\n", Simd<double>::LANES);
+    std::printf("              vector     libm\n");
+    throughputs<double>("double");
+    throughputs<float>("float");
+
+    if (failed) {
+        std::printf("\nsome errors are over their bound\n");
+        return 1;
+    }
+    return 0;
+}
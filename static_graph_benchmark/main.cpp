@@ -0,0 +1,99 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+
+/*
+ * Per-sample training step (forward, backward, SGD update) of the mlp_test
+ * MLP and of a wider one, run three ways: eagerly on Variables (one graph
+ * per step), on a Tape (cleared every step) and as a StaticGraph captured
+ * once and replayed. Checks that the three produce the same gradients and
+ * reports steps per second.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void run(size_t in_size, size_t hidden, size_t steps) {
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    const std::vector<std::shared_ptr<Variable<double>>> &params = nn.parameters();
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> sample(in_size + 1);
+    for (auto & value : sample) value = dis(gen);
+
+    // Learning rate 0 keeps the parameters fixed, so every step computes the same gradient.
+    optimizer<double> optim(nn, 0.0);
+
+    auto eager_step = [&]() {
+        optim.zero_grad();
+        std::vector<std::shared_ptr<Variable<double>>> x(in_size);
+        for (size_t i = 0; i < in_size; ++i) x[i] = std::make_shared<Variable<double>>(sample[i]);
+        std::shared_ptr<Variable<double>> error = std::make_shared<Variable<double>>(sample[in_size]) - nn(x)[0];
+        (error * error)->backward();
+        optim.step();
+    };
+
+    Tape<double> tape;
+    std::vector<TapeVariable<double>> x(in_size);
+    auto tape_step = [&]() {
+        optim.zero_grad();
+        tape.clear();
+        for (size_t i = 0; i < in_size; ++i) x[i] = tape.variable(sample[i]);
+        TapeVariable<double> error = tape.variable(sample[in_size]) - nn(tape, x)[0];
+        (error * error).backward();
+        optim.step();
+    };
+
+    StaticGraph<double> graph = StaticGraph<double>::capture(sample, [&](Tape<double> &tape, const std::vector<TapeVariable<double>> &inputs) {
+        std::vector<TapeVariable<double>> x(inputs.begin(), inputs.begin() + in_size);
+        TapeVariable<double> error = inputs[in_size] - nn(tape, x)[0];
+        return std::vector<TapeVariable<double>>{error * error};
+    });
+    auto replay_step = [&]() {
+        optim.zero_grad();
+        graph.forward(sample);
+        graph.backward();
+        optim.step();
+    };
+
+    auto gradient = [&]() {
+        std::vector<double> grad;
+        for (auto & param : params) grad.push_back(param->get_grad_value());
+        return grad;
+    };
+    auto steps_per_second = [&](auto step) {
+        step();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < steps; ++s) step();
+        return steps / seconds_since(start);
+    };
+
+    double eager = steps_per_second(eager_step);
+    std::vector<double> eager_grad = gradient();
+    double tape_rate = steps_per_second(tape_step);
+    std::vector<double> tape_grad = gradient();
+    double replay = steps_per_second(replay_step);
+    std::vector<double> replay_grad = gradient();
+
+    double difference = 0.0;
+    for (size_t i = 0; i < params.size(); ++i) {
+        difference = std::max({difference, std::abs(eager_grad[i] - tape_grad[i]), std::abs(eager_grad[i] - replay_grad[i])});
+    }
+
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, " << params.size() << " parameters, "
+              << graph.get_instruction_count() << " instructions" << std::endl;
+    std::cout << "  max gradient difference: " << difference << std::endl;
+    std::cout << "  eager:  " << eager << " steps/s" << std::endl;
+    std::cout << "  tape:   " << tape_rate << " steps/s (" << tape_rate / eager << "x)" << std::endl;
+    std::cout << "  replay: " << replay << " steps/s (" << replay / eager << "x)" << std::endl;
+}
+
+int main() {
+    run(4, 10, 20000);
+    run(16, 64, 2000);
+    return 0;
+}
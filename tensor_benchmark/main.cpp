@@ -0,0 +1,80 @@
+#include "../mlp/mlp.cpp"
+#include <chrono>
+
+/*
+ * Forward + backward of one mini-batch through the same NN, once through
+ * the scalar Variable path (one graph per sample) and once through the
+ * Tensor path (one graph per batch), checking that both produce the same
+ * parameter gradients.
+*/
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    size_t batch = 64, in_size = 64, hidden = 128;
+
+    NN nn;
+    nn.add_linear_layer(in_size, hidden, true);
+    nn.add_linear_layer(hidden, hidden, true);
+    nn.add_linear_layer(hidden, 1, false);
+    std::vector<std::shared_ptr<Variable<double>>> params = nn.parameters();
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> inputs(batch * in_size), targets(batch);
+    for (auto & x : inputs) x = dis(gen);
+    for (auto & y : targets) y = dis(gen);
+
+    auto zero_grad = [&]() {
+        for (auto & param : params) param->set_grad(0.0);
+    };
+
+    auto scalar_step = [&]() {
+        for (size_t b = 0; b < batch; ++b) {
+            std::vector<std::shared_ptr<Variable<double>>> x(in_size);
+            for (size_t i = 0; i < in_size; ++i) x[i] = std::make_shared<Variable<double>>(inputs[b * in_size + i]);
+            std::shared_ptr<Variable<double>> error = std::make_shared<Variable<double>>(targets[b]) - nn(x)[0];
+            (error * error * std::make_shared<Variable<double>>(1.0 / batch))->backward();
+        }
+    };
+
+    auto tensor_x = std::make_shared<Tensor<double>>(std::vector<size_t>{batch, in_size}, inputs);
+    auto tensor_y = std::make_shared<Tensor<double>>(std::vector<size_t>{batch, 1}, targets);
+    auto tensor_step = [&]() {
+        std::shared_ptr<Tensor<double>> error = nn(tensor_x) - tensor_y;
+        (error * error)->mean()->backward();
+    };
+
+    zero_grad();
+    scalar_step();
+    std::vector<double> scalar_grads;
+    for (auto & param : params) scalar_grads.push_back(param->get_grad_value());
+
+    zero_grad();
+    tensor_step();
+    double max_error = 0.0;
+    for (size_t i = 0; i < params.size(); ++i) {
+        max_error = std::max(max_error, std::abs(params[i]->get_grad_value() - scalar_grads[i]));
+    }
+
+    std::cout << "MLP " << in_size << "-" << hidden << "-" << hidden << "-1, batch " << batch << ", " << params.size() << " parameters" << std::endl;
+    std::cout << "Max gradient difference between paths: " << max_error << std::endl;
+    std::cout << std::endl;
+
+    size_t scalar_steps = 3, tensor_steps = 300;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scalar_steps; ++i) scalar_step();
+    double scalar_time = seconds_since(start) / scalar_steps;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tensor_steps; ++i) tensor_step();
+    double tensor_time = seconds_since(start) / tensor_steps;
+
+    std::cout << "Scalar Variable path: " << scalar_time * 1e3 << " ms per batch" << std::endl;
+    std::cout << "Tensor path: " << tensor_time * 1e3 << " ms per batch" << std::endl;
+    std::cout << "Speedup: " << scalar_time / tensor_time << "x" << std::endl;
+    return 0;
+}